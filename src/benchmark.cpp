@@ -0,0 +1,680 @@
+#include "chunk.hpp"
+#include "chunk_scheduler.hpp"
+#include "confparse.hpp"
+#include "cpu_features.hpp"
+#include "kernels.hpp"
+#include "logger.h"
+#include "noise.hpp"
+#include "noise_graph.hpp"
+#include "task_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <random>
+#include <string.h>
+
+#ifndef DATA_FOLDER
+#define DATA_FOLDER "data"
+#endif
+
+// Checks that the noise kernels of every instruction set supported by the CPU match
+// NoiseGenerator::at() within NOISE_KERNEL_TOLERANCE, and the behaviour of the chunk pipeline, and
+// fails if one of the checks does. Then measures the cost
+// of NoiseMap::create_noise_map per pixel, against the cost of the noise
+// evaluations alone, for the terrain and moisture settings in config.txt. Then measures adaptive
+// octave sampling for a few tolerances, with its largest difference from the exact noise map, and
+// the octave and spectral backends over a large area for several octave counts, and a few noise
+// graphs against the plain terrain noise map. Then the domain warp kernel against FastNoiseLite
+// and the terrain noise map at warped positions. Last, the whole chunk pipeline with the pixel
+// layers run a band of rows at a time against one layer at a time, for several chunk sizes, the
+// time to generate one chunk with the independent layers run in order and at the same time, and
+// the time to generate a grid of chunks one by one and with ChunkScheduler, and the time to
+// generate a chunk at a few levels of detail
+
+using clock_type = std::chrono::steady_clock;
+
+static auto elapsed_ns(clock_type::time_point start) -> double
+{
+    return std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+}
+
+// Largest absolute difference between the OpenSimplex2S kernels of a table and NoiseGenerator::at()
+// over random positions for a few seeds, for the batch kernel and for the row kernel. The other
+// noise types have no kernels, at_batch() and at_row() call at() for them
+static auto max_kernel_difference(const KernelTable &table) -> std::pair<float, float>
+{
+    constexpr size_t rows = 1000, columns = 100;
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> position(-1e4f, 1e4f);
+    std::vector<float> xs(columns), ys(columns), out(columns);
+    float batch_error = 0.0f, row_error = 0.0f;
+    for (int seed : {0, 8322, -77})
+    {
+        NoiseGenerator generator(seed);
+        for (size_t row = 0; row < rows; ++row)
+        {
+            for (size_t i = 0; i < columns; ++i)
+            {
+                xs[i] = position(random);
+                ys[i] = position(random);
+            }
+            table.opensimplex2s(seed, generator.frequency(), xs.data(), ys.data(), out.data(),
+                                columns);
+            for (size_t i = 0; i < columns; ++i)
+                batch_error = std::max(batch_error, std::abs(out[i] - generator.at(xs[i], ys[i])));
+            table.opensimplex2s_row(seed, generator.frequency(), xs.data(), ys[0], out.data(),
+                                    columns);
+            for (size_t i = 0; i < columns; ++i)
+                row_error = std::max(row_error, std::abs(out[i] - generator.at(xs[i], ys[0])));
+        }
+    }
+    return {batch_error, row_error};
+}
+
+// True if both chunks have the same size, position and channels, with the same bits
+static auto identical(const Chunk &a, const Chunk &b) -> bool
+{
+    if (a.x != b.x || a.y != b.y || a.width != b.width || a.height != b.height ||
+        a.halo != b.halo || a.lod != b.lod || a.channels != b.channels ||
+        a.biome_palette != b.biome_palette)
+        return false;
+    for (int id = 0; id < MAX_CHANNELS; ++id)
+    {
+        if (!a.has(id))
+            continue;
+        auto size = a.pixels() * channel_type_size(channel_registry().info(id).type);
+        if (memcmp(a.data(id), b.data(id), size) != 0)
+            return false;
+    }
+    return true;
+}
+
+// Prints the result of a check, returns passed
+static auto check(const std::string &name, bool passed) -> bool
+{
+    fmt::print("{:<64} {:>8}\n", name, passed ? "ok" : "FAILED");
+    return passed;
+}
+
+// Time taken by the layers of the factory for a row of chunks, in nanoseconds per pixel
+static auto time_pipeline(const ChunkFactory &factory, Registry &registry, int side, int chunks)
+    -> double
+{
+    Chunk chunk;
+    auto start = clock_type::now();
+    for (int i = 0; i < chunks; ++i)
+    {
+        chunk.x = i;
+        chunk.y = 0;
+        factory.run_layers(chunk, registry);
+    }
+    return elapsed_ns(start) / (static_cast<double>(side) * side * chunks);
+}
+
+// Time taken by create_noise_map for a grid of chunks, in nanoseconds per pixel
+static auto time_noise_map(const NoiseMap &noisemap, int side, float scale, int chunks) -> double
+{
+    std::vector<float> output(static_cast<size_t>(side) * side);
+    auto start = clock_type::now();
+    for (int i = 0; i < chunks; ++i)
+        noisemap.create_noise_map(static_cast<float>(i % 8), static_cast<float>(i / 8), side, side,
+                                  scale, output);
+    return elapsed_ns(start) / (static_cast<double>(side) * side * chunks);
+}
+
+// Time taken by the noise evaluations alone for the same number of samples, the lower bound for
+// create_noise_map
+static auto time_noise_only(const NoiseMap &noisemap, int side, int chunks) -> double
+{
+    std::vector<float> xs(side), samples(side);
+    for (int x = 0; x < side; ++x)
+        xs[x] = static_cast<float>(x);
+
+    auto start = clock_type::now();
+    for (int i = 0; i < chunks; ++i)
+        for (int y = 0; y < side; ++y)
+            for (size_t octave = 0; octave < noisemap.octave_count(); ++octave)
+                noisemap.generator(octave).at_row(xs.data(), static_cast<float>(y), samples.data(),
+                                                  side);
+    return elapsed_ns(start) / (static_cast<double>(side) * side * chunks);
+}
+
+// Largest absolute difference between two noise maps over a few chunks
+static auto max_difference(const NoiseMap &exact, const NoiseMap &approximate, int side,
+                           float scale) -> float
+{
+    std::vector<float> expected(static_cast<size_t>(side) * side), actual(expected.size());
+    float difference = 0.0f;
+    for (int i = 0; i < 4; ++i)
+    {
+        exact.create_noise_map(static_cast<float>(i), 0.0f, side, side, scale, expected);
+        approximate.create_noise_map(static_cast<float>(i), 0.0f, side, side, scale, actual);
+        for (size_t j = 0; j < expected.size(); ++j)
+            difference = std::max(difference, std::fabs(expected[j] - actual[j]));
+    }
+    return difference;
+}
+
+// Time taken by create_noise_map for a square area of chunks, generated row by row like a map
+// export, in nanoseconds per pixel
+static auto time_area(const NoiseMap &noisemap, int side, float scale, int chunks) -> double
+{
+    std::vector<float> output(static_cast<size_t>(side) * side);
+    auto start = clock_type::now();
+    for (int y = 0; y < chunks; ++y)
+        for (int x = 0; x < chunks; ++x)
+            noisemap.create_noise_map(static_cast<float>(x), static_cast<float>(y), side, side,
+                                      scale, output);
+    return elapsed_ns(start) / (static_cast<double>(side) * side * chunks * chunks);
+}
+
+// Time taken by NoiseGraph::create for a grid of chunks, in nanoseconds per pixel
+static auto time_graph(const NoiseGraph &graph, int side, float scale, int chunks) -> double
+{
+    std::vector<float> output(static_cast<size_t>(side) * side);
+    auto start = clock_type::now();
+    for (int i = 0; i < chunks; ++i)
+    {
+        ChunkCoordinates chunk(static_cast<float>(i % 8), static_cast<float>(i / 8), side, side);
+        graph.create(chunk, scale, output.data());
+    }
+    return elapsed_ns(start) / (static_cast<double>(side) * side * chunks);
+}
+
+auto main(int argc, char *argv[]) -> int
+{
+    auto config_path = (std::filesystem::path(DATA_FOLDER) / "config.txt").generic_string();
+    auto cfg = confparse::ConfigParser().from_file(config_path);
+    auto seed = cfg.get("seed").parse<int>();
+    auto global_map_scale = cfg.get("global_map_scale").parse<float>();
+
+    logger::info("Using {} kernels", kernels().name);
+    fmt::print("{:<10} {:>16} {:>16}\n", "kernels", "batch max error", "row max error");
+    const auto &features = cpu_features();
+    bool kernels_exact = true;
+    for (const auto *table : {scalar_kernels(), features.sse2 ? sse2_kernels() : nullptr,
+                              features.avx2 ? avx2_kernels() : nullptr,
+                              features.avx512 ? avx512_kernels() : nullptr})
+    {
+        if (!table)
+            continue;
+        auto [batch_error, row_error] = max_kernel_difference(*table);
+        fmt::print("{:<10} {:>16.2e} {:>16.2e}\n", table->name, batch_error, row_error);
+        if (batch_error > NOISE_KERNEL_TOLERANCE || row_error > NOISE_KERNEL_TOLERANCE)
+            kernels_exact = false;
+    }
+    if (!kernels_exact)
+    {
+        logger::error("Noise kernels differ from NoiseGenerator::at() by more than {}",
+                      NOISE_KERNEL_TOLERANCE);
+        return 1;
+    }
+
+    Registry registry;
+    registry.load(DATA_FOLDER);
+    auto checks_cfg = cfg;
+    checks_cfg.set("noise_cache_megabytes", 0);
+    checks_cfg.set("layer_cache_megabytes", 0);
+    bool checks_passed = true;
+    fmt::print("\n{:<64} {:>8}\n", "check", "result");
+    {
+        // Restoring the outputs of every layer gives the chunk that running them gives, for a miss
+        // and for a hit
+        ChunkFactory uncached, cached;
+        uncached.from_config(checks_cfg);
+        auto cached_cfg = checks_cfg;
+        cached_cfg.set("layer_cache_megabytes", 16);
+        cached.from_config(cached_cfg);
+        bool same = true;
+        for (int lod : {0, 1, 3})
+        {
+            for (auto [x, y] : {std::pair<int, int>{0, 0}, {3, -2}})
+            {
+                auto expected = uncached.execute(registry, x, y, lod);
+                auto miss = cached.execute(registry, x, y, lod);
+                auto hit = cached.execute(registry, x, y, lod);
+                same = same && identical(expected, miss) && identical(expected, hit);
+            }
+        }
+        checks_passed &= check("layer cache hit equals an uncached run", same);
+    }
+    {
+        // Truncated noise fields only have to pick the same biomes as the exact ones
+        bool same = true;
+        for (int check_seed : {seed, 1, 77})
+        {
+            auto exact_cfg = checks_cfg;
+            exact_cfg.set("seed", check_seed);
+            exact_cfg.set("classification_only", false);
+            auto truncated_cfg = exact_cfg;
+            truncated_cfg.set("classification_only", true);
+            ChunkFactory exact, truncated;
+            exact.from_config(exact_cfg);
+            truncated.from_config(truncated_cfg);
+            for (int y = -2; y < 2; ++y)
+            {
+                for (int x = -2; x < 2; ++x)
+                {
+                    auto expected = exact.execute(registry, x, y);
+                    auto chunk = truncated.execute(registry, x, y);
+                    same = same && std::equal(expected.biome.data(),
+                                              expected.biome.data() + expected.pixels(),
+                                              chunk.biome.data());
+                }
+            }
+        }
+        checks_passed &= check("classification_only gives the biomes of the exact fields", same);
+    }
+    {
+        // Quantized storage keeps the values within half a step and maps back to the biome ids
+        auto quantized_cfg = checks_cfg;
+        quantized_cfg.set("chunk_storage", std::string("quantized"));
+        ChunkFactory exact, quantized;
+        exact.from_config(checks_cfg);
+        quantized.from_config(quantized_cfg);
+        bool within = true, same_biomes = true;
+        for (auto [x, y] : {std::pair<int, int>{0, 0}, {5, -3}})
+        {
+            auto expected = exact.execute(registry, x, y);
+            auto chunk = quantized.execute(registry, x, y);
+            same_biomes = same_biomes && chunk.is_quantized();
+            for (size_t i = 0; same_biomes && i < chunk.pixels(); ++i)
+                same_biomes = chunk.biome_palette[chunk.biome8[i]] == expected.biome[i];
+            chunk.dequantize();
+            for (size_t i = 0; i < chunk.pixels(); ++i)
+            {
+                float elevation = std::clamp(expected.elevation[i], 0.0f, 1.0f);
+                float moisture = std::clamp(expected.moisture[i], 0.0f, 1.0f);
+                within = within && std::abs(chunk.elevation[i] - elevation) <= 0.5f / UNORM16_MAX &&
+                         std::abs(chunk.moisture[i] - moisture) <= 0.5f / UNORM16_MAX;
+            }
+        }
+        checks_passed &= check("quantized values are within half a step", within);
+        checks_passed &= check("quantized biomes map back to the biome ids", same_biomes);
+    }
+    {
+        // A partial update only runs the layers that read what a change invalidates, the chunk
+        // must still be the one that the new config generates
+        ChunkFactory before;
+        before.from_config(checks_cfg);
+        bool same = true;
+        for (const auto &keys : std::vector<std::vector<std::string>>{
+                 {"terrain.scale"}, {"moisture.fudge"}, {"terrain.fudge", "moisture.scale"}})
+        {
+            auto changed_cfg = checks_cfg;
+            for (const auto &key : keys)
+                changed_cfg.set(key, checks_cfg.get(key).parse<float>() * 0.75f);
+            ChunkFactory after;
+            after.from_config(changed_cfg);
+            auto invalidated = ChunkFactory::invalidated_channels(changed_cfg, keys, false);
+            auto chunk = before.execute(registry, 2, 1);
+            after.execute_update(registry, 2, 1, chunk, invalidated);
+            same = same && identical(chunk, after.execute(registry, 2, 1));
+        }
+        checks_passed &= check("partial update equals a full regeneration", same);
+    }
+    {
+        // The halo of a chunk holds the pixels of its neighbours, the stages stop before the halo
+        // is cropped
+        auto halo_cfg = checks_cfg;
+        halo_cfg.set("chunk_halo", 3);
+        ChunkFactory factory;
+        factory.from_config(halo_cfg);
+        auto stages = [&](int x, int y) {
+            Chunk chunk;
+            chunk.x = x;
+            chunk.y = y;
+            factory.run_stage(chunk, registry, STATUS_NOISE);
+            factory.run_stage(chunk, registry, STATUS_BIOME);
+            return chunk;
+        };
+        auto center = stages(1, 1), right = stages(2, 1), above = stages(1, 0);
+        bool same = center.halo == 3;
+        for (int k = 0; same && k < center.halo; ++k)
+        {
+            for (int j = 0; j < center.height; ++j)
+            {
+                auto i = center.index(center.width + k, j), r = right.index(k, j);
+                same = same && center.elevation[i] == right.elevation[r] &&
+                       center.moisture[i] == right.moisture[r] && center.biome[i] == right.biome[r];
+            }
+            for (int j = 0; j < center.width; ++j)
+            {
+                auto i = center.index(j, -1 - k), a = above.index(j, above.height - 1 - k);
+                same = same && center.elevation[i] == above.elevation[a] &&
+                       center.moisture[i] == above.moisture[a] && center.biome[i] == above.biome[a];
+            }
+        }
+        checks_passed &= check("halo pixels equal the edge pixels of the neighbours", same);
+    }
+    {
+        // Without feature layers the scheduler gives the chunks that the factory gives one by
+        // one, in any order, also with the layers run a band of rows at a time
+        bool same_order = true, same_as_factory = true;
+        for (int tile_pixels : {0, 1024})
+        {
+            auto scheduler_cfg = checks_cfg;
+            scheduler_cfg.set("layer_tile_pixels", tile_pixels);
+            ChunkFactory factory;
+            factory.from_config(scheduler_cfg);
+            std::vector<std::pair<int, int>> positions;
+            for (int y = -1; y < 2; ++y)
+            {
+                for (int x = -1; x < 2; ++x)
+                    positions.push_back({x, y});
+            }
+            auto reversed = positions;
+            std::reverse(reversed.begin(), reversed.end());
+            ChunkScheduler forward(factory, registry), backward(factory, registry);
+            forward.generate(positions, factory.last_status());
+            for (const auto &position : reversed)
+                backward.generate({position}, factory.last_status());
+            for (const auto &[x, y] : positions)
+            {
+                auto chunk = forward.finish(x, y);
+                same_order = same_order && identical(chunk, backward.finish(x, y));
+                same_as_factory =
+                    same_as_factory && identical(chunk, factory.execute(registry, x, y));
+            }
+        }
+        checks_passed &= check("scheduler output does not depend on the order", same_order);
+        checks_passed &= check("scheduler output equals one by one generation", same_as_factory);
+    }
+    {
+        // At a level of detail the spectral backend samples the pixels of level 0, pixel (i, j)
+        // of a chunk at level lod is pixel (i, j) * 2^lod of the full chunk
+        auto spectral_cfg = checks_cfg;
+        spectral_cfg.set("terrain.backend", std::string("spectral"));
+        spectral_cfg.set("moisture.backend", std::string("spectral"));
+        ChunkFactory factory;
+        factory.from_config(spectral_cfg);
+        bool same = true;
+        for (auto [x, y] : {std::pair<int, int>{0, 0}, {-3, 2}})
+        {
+            auto full = factory.execute(registry, x, y);
+            for (int lod : {1, 2, 3})
+            {
+                auto chunk = factory.execute(registry, x, y, lod);
+                for (int j = 0; j < chunk.height; ++j)
+                {
+                    for (int i = 0; i < chunk.width; ++i)
+                    {
+                        auto k = chunk.index(i, j), f = full.index(i << lod, j << lod);
+                        same = same && chunk.elevation[k] == full.elevation[f] &&
+                               chunk.moisture[k] == full.moisture[f];
+                    }
+                }
+            }
+        }
+        checks_passed &= check("spectral levels of detail sample the full chunk", same);
+    }
+    if (!checks_passed)
+    {
+        logger::error("A check of the chunk pipeline failed");
+        return 1;
+    }
+
+    fmt::print("\n{:<10} {:>6} {:>8} {:>16} {:>16} {:>16}\n", "field", "side", "octaves",
+               "noise map ns/px", "noise ns/px", "overhead ns/px");
+
+    for (std::string field : {"terrain", "moisture"})
+    {
+        auto noisemap = NoiseMap::from_config(cfg, field, seed);
+        auto scale = cfg.get(field + ".scale").parse<float>() * global_map_scale;
+        for (int side : {64, 128, 256})
+        {
+            int chunks = std::max(4, (1 << 22) / (side * side));
+            auto total = time_noise_map(noisemap, side, scale, chunks);
+            auto noise = time_noise_only(noisemap, side, chunks);
+            fmt::print("{:<10} {:>6} {:>8} {:>16.2f} {:>16.2f} {:>16.2f}\n", field, side,
+                       noisemap.octave_count(), total, noise, total - noise);
+        }
+    }
+
+    fmt::print("\n{:<10} {:>6} {:>10} {:>16} {:>16}\n", "field", "side", "tolerance",
+               "noise map ns/px", "max error");
+    for (std::string field : {"terrain", "moisture"})
+    {
+        auto exact = NoiseMap::from_config(cfg, field, seed);
+        exact.set_adaptive_tolerance(0.0f);
+        auto scale = cfg.get(field + ".scale").parse<float>() * global_map_scale;
+        for (int side : {64, 128, 256})
+        {
+            int chunks = std::max(4, (1 << 22) / (side * side));
+            for (float tolerance : {1e-4f, 1e-3f, 1e-2f})
+            {
+                auto adaptive = exact;
+                adaptive.set_adaptive_tolerance(tolerance);
+                auto total = time_noise_map(adaptive, side, scale, chunks);
+                auto error = max_difference(exact, adaptive, side, scale);
+                fmt::print("{:<10} {:>6} {:>10g} {:>16.2f} {:>16.2e}\n", field, side, tolerance,
+                           total, error);
+            }
+        }
+    }
+
+    // Octaves double in frequency and halve in amplitude, starting from the terrain settings
+    auto side = cfg.get("chunk_side_length").parse<int>();
+    auto scale = cfg.get("terrain.scale").parse<float>() * global_map_scale;
+    int chunks = 16;
+    fmt::print("\n{:<10} {:>8} {:>16} {:>16}\n", "area", "octaves", "octaves ns/px",
+               "spectral ns/px");
+    for (int octaves : {2, 4, 8, 16})
+    {
+        std::vector<float> frequencies, amplitudes;
+        for (int i = 0; i < octaves; ++i)
+        {
+            frequencies.push_back(static_cast<float>(1 << i));
+            amplitudes.push_back(1.0f / static_cast<float>(1 << i));
+        }
+        NoiseMap noisemap(frequencies, amplitudes, NoiseGenerator(seed), 1.0f, 1.0f);
+        auto octave_time = time_area(noisemap, side, scale, chunks);
+        noisemap.set_backend(NoiseBackend::SPECTRAL);
+        auto spectral_time = time_area(noisemap, side, scale, chunks);
+        fmt::print("{:<10} {:>8} {:>16.2f} {:>16.2f}\n",
+                   fmt::format("{}x{}", side * chunks, side * chunks), octaves, octave_time,
+                   spectral_time);
+    }
+
+    // The graph "octaves" is the terrain noise map itself, the difference is the cost of running
+    // the graph
+    auto terrain = NoiseMap::from_config(cfg, "terrain", seed);
+    chunks = std::max(4, (1 << 22) / (side * side));
+    fmt::print("\n{:<80} {:>6} {:>10} {:>10}\n", "graph", "instr", "registers", "ns/px");
+    fmt::print("{:<80} {:>6} {:>10} {:>10.2f}\n", "terrain noise map", "-", "-",
+               time_noise_map(terrain, side, scale, chunks));
+    for (std::string expression :
+         {"octaves", "clamp(remap(octaves, 0, 1, -0.1, 1.1), 0, 1)",
+          "add(mul(octaves, 0.8), mul(ridged(opensimplex2s(8)), 0.2))",
+          "warp(octaves, opensimplex2s(2), opensimplex2s(2, 1), 0.05)",
+          "clamp(add(octaves, mul(ridged(warp(opensimplex2s(4), opensimplex2s(2), "
+          "opensimplex2s(2, 1), 0.1)), 0.3)), 0, 1)"})
+    {
+        NoiseGraph graph(expression, terrain, seed);
+        fmt::print("{:<80} {:>6} {:>10} {:>10.2f}\n", expression, graph.instructions().size(),
+                   graph.registers(), time_graph(graph, side, scale, chunks));
+    }
+
+    // The warp of a whole chunk, then the noise map at the warped positions (as DomainWarpLayer and
+    // the terrain layer do), against the noise map on the pixel grid
+    fmt::print("\n{:<22} {:>16} {:>16} {:>16} {:>16}\n", "warp type", "kernel ns/px",
+               "scalar ns/px", "warped ns/px", "grid ns/px");
+    ChunkCoordinates coordinates(0.0f, 0.0f, side, side);
+    auto pixels = static_cast<size_t>(side) * side;
+    std::vector<float> grid_x(pixels), grid_y(pixels), warp_x(pixels), warp_y(pixels);
+    for (int y = 0; y < side; ++y)
+    {
+        for (int x = 0; x < side; ++x)
+        {
+            grid_x[static_cast<size_t>(y) * side + x] = scale * coordinates.columns[x];
+            grid_y[static_cast<size_t>(y) * side + x] = scale * coordinates.rows[y];
+        }
+    }
+    for (std::string type : {"opensimplex2", "opensimplex2_reduced", "basic_grid"})
+    {
+        NoiseGenerator generator(seed);
+        generator.set_domain_warp(parse_domain_warp_type(type), 20.0f);
+
+        auto start = clock_type::now();
+        for (int i = 0; i < chunks; ++i)
+        {
+            warp_x = grid_x;
+            warp_y = grid_y;
+            generator.warp_batch(warp_x.data(), warp_y.data(), pixels);
+        }
+        auto kernel_time = elapsed_ns(start) / static_cast<double>(pixels * chunks);
+
+        start = clock_type::now();
+        for (int i = 0; i < chunks; ++i)
+        {
+            warp_x = grid_x;
+            warp_y = grid_y;
+            for (size_t j = 0; j < pixels; ++j)
+                generator.warp(warp_x[j], warp_y[j]);
+        }
+        auto scalar_time = elapsed_ns(start) / static_cast<double>(pixels * chunks);
+
+        // Back to chunk units, as stored in Chunk::warp_x
+        for (size_t j = 0; j < pixels; ++j)
+        {
+            warp_x[j] /= scale;
+            warp_y[j] /= scale;
+        }
+        std::vector<float> output(pixels);
+        NoiseField field{&terrain, scale, output.data()};
+        field.warp_x = warp_x.data();
+        field.warp_y = warp_y.data();
+        start = clock_type::now();
+        for (int i = 0; i < chunks; ++i)
+            create_noise_maps(0.0f, 0.0f, side, side, {field});
+        auto warped_time = elapsed_ns(start) / static_cast<double>(pixels * chunks);
+        field.warp_x = field.warp_y = nullptr;
+        start = clock_type::now();
+        for (int i = 0; i < chunks; ++i)
+            create_noise_maps(0.0f, 0.0f, side, side, {field});
+        auto grid_time = elapsed_ns(start) / static_cast<double>(pixels * chunks);
+        fmt::print("{:<22} {:>16.2f} {:>16.2f} {:>16.2f} {:>16.2f}\n", type, kernel_time,
+                   scalar_time, warped_time, grid_time);
+    }
+
+    // Without the octave cache, which would serve every chunk after the first one and creates the
+    // noise fields a whole chunk at a time, nor the layer cache, which runs every layer over the
+    // whole chunk
+    auto pipeline_cfg = cfg;
+    pipeline_cfg.set("noise_cache_megabytes", 0);
+    pipeline_cfg.set("layer_cache_megabytes", 0);
+    pipeline_cfg.set("parallel_layers", false);
+    fmt::print("\n{:<8} {:>6} {:>16} {:>16} {:>16}\n", "warp", "side", "whole ns/px",
+               "4096 px ns/px", "1024 px ns/px");
+    for (bool warp : {false, true})
+    {
+        pipeline_cfg.set("warp.enabled", warp);
+        for (int side : {32, 64, 128, 256, 512, 1024})
+        {
+            pipeline_cfg.set("chunk_side_length", side);
+            chunks = std::max(4, (1 << 22) / (side * side));
+            double times[3];
+            int tiles[3] = {0, 4096, 1024};
+            for (int i = 0; i < 3; ++i)
+            {
+                pipeline_cfg.set("layer_tile_pixels", tiles[i]);
+                ChunkFactory factory;
+                factory.from_config(pipeline_cfg);
+                times[i] = time_pipeline(factory, registry, side, chunks);
+            }
+            fmt::print("{:<8} {:>6} {:>16.2f} {:>16.2f} {:>16.2f}\n", warp, side, times[0],
+                       times[1], times[2]);
+        }
+    }
+
+    // Time to generate one chunk, with the independent layers run in order and at the same time
+    fmt::print("\n{} worker threads\n{:<8} {:>6} {:>16} {:>16}\n", task_pool().size(), "warp",
+               "side", "in order us", "parallel us");
+    pipeline_cfg.set("layer_tile_pixels", 0);
+    for (bool warp : {false, true})
+    {
+        pipeline_cfg.set("warp.enabled", warp);
+        for (int side : {64, 128, 256, 512})
+        {
+            pipeline_cfg.set("chunk_side_length", side);
+            chunks = std::max(4, (1 << 22) / (side * side));
+            double times[2];
+            for (int i = 0; i < 2; ++i)
+            {
+                pipeline_cfg.set("parallel_layers", i == 1);
+                ChunkFactory factory;
+                factory.from_config(pipeline_cfg);
+                times[i] = time_pipeline(factory, registry, side, chunks) * side * side / 1000.0;
+            }
+            fmt::print("{:<8} {:>6} {:>16.1f} {:>16.1f}\n", warp, side, times[0], times[1]);
+        }
+    }
+
+    // Time to generate a grid of chunks one by one, and with the scheduler which generates the
+    // chunks of a stage at the same time
+    fmt::print("\n{:<6} {:>8} {:>16} {:>16}\n", "side", "chunks", "one by one ms", "scheduler ms");
+    pipeline_cfg.set("warp.enabled", false);
+    pipeline_cfg.set("parallel_layers", true);
+    for (int side : {64, 128, 256})
+    {
+        pipeline_cfg.set("chunk_side_length", side);
+        int grid = std::max(2, 1024 / side);
+        std::vector<std::pair<int, int>> positions;
+        for (int y = 0; y < grid; ++y)
+        {
+            for (int x = 0; x < grid; ++x)
+                positions.push_back({x, y});
+        }
+        ChunkFactory factory;
+        factory.from_config(pipeline_cfg);
+        auto start = clock_type::now();
+        for (const auto &[x, y] : positions)
+        {
+            Chunk chunk;
+            chunk.x = x;
+            chunk.y = y;
+            factory.run_layers(chunk, registry);
+        }
+        auto one_by_one = elapsed_ns(start) / 1e6;
+        ChunkScheduler scheduler(factory, registry);
+        start = clock_type::now();
+        scheduler.generate(positions, factory.last_status());
+        for (const auto &[x, y] : positions)
+            scheduler.finish(x, y);
+        auto scheduled = elapsed_ns(start) / 1e6;
+        fmt::print("{:<6} {:>8} {:>16.1f} {:>16.1f}\n", side, positions.size(), one_by_one,
+                   scheduled);
+    }
+
+    // Time to generate one chunk at a few levels of detail, with every octave and without the
+    // octaves finer than a pixel
+    fmt::print("\n{:<6} {:>4} {:>8} {:>16} {:>16}\n", "side", "lod", "pixels", "all octaves us",
+               "skipped us");
+    pipeline_cfg.set("chunk_side_length", 256);
+    for (int lod = 0; lod <= 3; ++lod)
+    {
+        int side = 256 >> lod;
+        chunks = std::max(4, (1 << 22) / (side * side));
+        double times[2];
+        for (int i = 0; i < 2; ++i)
+        {
+            pipeline_cfg.set("lod_skip_octaves", i == 1);
+            ChunkFactory factory;
+            factory.from_config(pipeline_cfg);
+            Chunk chunk;
+            chunk.lod = lod;
+            auto start = clock_type::now();
+            for (int j = 0; j < chunks; ++j)
+            {
+                chunk.x = j;
+                chunk.y = 0;
+                factory.run_layers(chunk, registry);
+            }
+            times[i] = elapsed_ns(start) / chunks / 1000.0;
+        }
+        fmt::print("{:<6} {:>4} {:>8} {:>16.1f} {:>16.1f}\n", 256, lod, side * side, times[0],
+                   times[1]);
+    }
+    return 0;
+}
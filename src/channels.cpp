@@ -0,0 +1,82 @@
+#include "channels.hpp"
+#include <stdexcept>
+
+auto channel_type_size(ChannelType type) -> size_t
+{
+    switch (type)
+    {
+    case ChannelType::FLOAT32:
+        return sizeof(float);
+    case ChannelType::UNORM16:
+        return sizeof(uint16_t);
+    case ChannelType::INT32:
+        return sizeof(int32_t);
+    case ChannelType::UINT8:
+        return sizeof(uint8_t);
+    }
+    return 0;
+}
+
+ChannelRegistry::ChannelRegistry()
+{
+    channels.reserve(MAX_CHANNELS);
+    // Same order as ChunkChannel
+    channels.push_back({"elevation", ChannelType::FLOAT32, true, 0.5f, 7});
+    channels.push_back({"elevation_dx", ChannelType::FLOAT32, false, 0.0f, -1});
+    channels.push_back({"elevation_dy", ChannelType::FLOAT32, false, 0.0f, -1});
+    channels.push_back({"moisture", ChannelType::FLOAT32, true, 0.5f, 8});
+    channels.push_back({"biome", ChannelType::INT32, true, -1.0f, 9});
+    channels.push_back({"warp_x", ChannelType::FLOAT32, false, 0.0f, -1});
+    channels.push_back({"warp_y", ChannelType::FLOAT32, false, 0.0f, -1});
+    channels.push_back({"elevation16", ChannelType::UNORM16, false, 0.0f, -1});
+    channels.push_back({"moisture16", ChannelType::UNORM16, false, 0.0f, -1});
+    // Indices into Chunk::biome_palette
+    channels.push_back({"biome8", ChannelType::UINT8, false, 0.0f, -1});
+}
+
+auto ChannelRegistry::add(const std::string &name, ChannelType type, bool initialized,
+                          float initial) -> int
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < channels.size(); ++i)
+    {
+        if (channels[i].name != name)
+            continue;
+        if (channels[i].type != type)
+            throw std::runtime_error("Channel " + name + " is registered with another type");
+        return static_cast<int>(i);
+    }
+    if (channels.size() == MAX_CHANNELS)
+        throw std::runtime_error("Cannot register channel " + name + ", too many channels");
+    channels.push_back({name, type, initialized, initial, -1});
+    return static_cast<int>(channels.size() - 1);
+}
+
+auto ChannelRegistry::find(const std::string &name) const -> int
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < channels.size(); ++i)
+    {
+        if (channels[i].name == name)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+auto ChannelRegistry::info(int id) const -> const ChannelInfo &
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return channels.at(static_cast<size_t>(id));
+}
+
+auto ChannelRegistry::size() const -> size_t
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return channels.size();
+}
+
+auto channel_registry() -> ChannelRegistry &
+{
+    static ChannelRegistry registry;
+    return registry;
+}
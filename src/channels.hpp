@@ -0,0 +1,91 @@
+#ifndef A_CHANNELS_H
+#define A_CHANNELS_H
+
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// A set of channels, bit i stands for the channel with id i
+using ChannelSet = uint64_t;
+
+#define MAX_CHANNELS 64
+
+// Storage type of the values of a channel
+enum class ChannelType
+{
+    FLOAT32,
+    // Unsigned normalized 16 bit values, UNORM16_MAX stands for 1
+    UNORM16,
+    INT32,
+    UINT8
+};
+
+auto channel_type_size(ChannelType type) -> size_t;
+
+// Channels that every registry has, with these ids, in this order
+enum ChunkChannel : ChannelSet
+{
+    CHANNEL_ELEVATION = 1u << 0,
+    CHANNEL_ELEVATION_DX = 1u << 1,
+    CHANNEL_ELEVATION_DY = 1u << 2,
+    CHANNEL_MOISTURE = 1u << 3,
+    CHANNEL_BIOME = 1u << 4,
+    CHANNEL_WARP_X = 1u << 5,
+    CHANNEL_WARP_Y = 1u << 6,
+    CHANNEL_ELEVATION16 = 1u << 7,
+    CHANNEL_MOISTURE16 = 1u << 8,
+    CHANNEL_BIOME8 = 1u << 9
+};
+
+// Every channel
+#define ALL_CHANNELS (~ChannelSet(0))
+
+inline auto channel_bit(int id) -> ChannelSet
+{
+    return ChannelSet(1) << id;
+}
+
+struct ChannelInfo
+{
+    std::string name;
+    ChannelType type;
+    // When initialized is set, InitializationLayer fills the channel with initial, otherwise the
+    // values stay undefined until a layer writes them
+    bool initialized;
+    float initial;
+    // Id of the channel that holds the values after Chunk::quantize(), -1 if there is none
+    int quantized;
+};
+
+// Names and types of the per pixel channels of chunks. Layers declare the channels they read and
+// write by id (see Layer::reads()), a chunk only stores the channels of its pipeline. New channels
+// are registered by name, the id of a name never changes. Safe to use from several threads
+class ChannelRegistry
+{
+    // Never grows beyond MAX_CHANNELS entries, so references to entries stay valid
+    std::vector<ChannelInfo> channels;
+    mutable std::mutex mutex;
+
+  public:
+    // Registers the built-in channels (see ChunkChannel)
+    ChannelRegistry();
+
+    // Id of the channel, registered if the name is new. Throws std::runtime_error if the name has
+    // another type, or if there are already MAX_CHANNELS channels
+    auto add(const std::string &name, ChannelType type, bool initialized = false,
+             float initial = 0.0f) -> int;
+
+    // Id of a channel, -1 if there is none with that name
+    auto find(const std::string &name) const -> int;
+
+    auto info(int id) const -> const ChannelInfo &;
+
+    auto size() const -> size_t;
+};
+
+// The channels of every chunk
+auto channel_registry() -> ChannelRegistry &;
+
+#endif // A_CHANNELS_H
@@ -1,190 +1,1617 @@
 #include "chunk.hpp"
+#include "kernels.hpp"
 #include "noise.hpp"
+#include "noise_graph.hpp"
+#include "task_pool.hpp"
+#include <algorithm>
+#include <functional>
+#include <string.h>
+#include <tuple>
+#include <type_traits>
 
 #define TERRAIN_SEED_MAGIC_NUMBER 8021
 #define MOISTURE_SEED_MAGIC_NUMBER 4712
+#define WARP_SEED_MAGIC_NUMBER 9377
 
-class InitializationLayer : public InPlaceLayer
+// Offset in bytes of channel id in the storage of a chunk with the given channels, the size of
+// the storage for id = MAX_CHANNELS
+static auto channel_offset(ChannelSet channels, size_t pixels, int id) -> size_t
 {
-    int width, height, master_seed;
+    const auto &registry = channel_registry();
+    size_t bytes = 0;
+    for (int c = 0; c < id; ++c)
+    {
+        if (channels & channel_bit(c))
+        {
+            bytes += pixels * channel_type_size(registry.info(c).type);
+            bytes = (bytes + SLAB_ALIGNMENT - 1) / SLAB_ALIGNMENT * SLAB_ALIGNMENT;
+        }
+    }
+    return bytes;
+}
+
+// Copies the given channels from one chunk to another of the same size and halo, if both have
+// them
+static auto copy_channels(const Chunk &from, Chunk &to, ChannelSet channels) -> void
+{
+    auto pixels = from.pixels();
+    channels &= from.channels & to.channels;
+    for (int c = 0; c < MAX_CHANNELS; ++c)
+    {
+        if (channels & channel_bit(c))
+            memcpy(to.data(c), from.data(c),
+                   pixels * channel_type_size(channel_registry().info(c).type));
+    }
+}
+
+auto LayerKey::operator==(const LayerKey &other) const -> bool
+{
+    return chain == other.chain && x == other.x && y == other.y && lod == other.lod;
+}
+
+auto LayerKeyHash::operator()(const LayerKey &key) const -> size_t
+{
+    size_t hash = std::hash<uint64_t>()(key.chain);
+    auto combine = [&hash](size_t value)
+    { hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2); };
+    combine(std::hash<int>()(key.x));
+    combine(std::hash<int>()(key.y));
+    combine(std::hash<int>()(key.lod));
+    return hash;
+}
+
+LayerCache::LayerCache(size_t capacity_bytes) : capacity_bytes(capacity_bytes), size_bytes(0) {}
+
+auto LayerCache::get(const LayerKey &key) -> Tile
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(key);
+    if (it == index.end())
+        return nullptr;
+    // Move the entry to the front, the back is the least recently used
+    entries.splice(entries.begin(), entries, it->second);
+    return it->second->second;
+}
+
+auto LayerCache::put(const LayerKey &key, Tile tile) -> void
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (capacity_bytes == 0)
+        return;
+    auto it = index.find(key);
+    if (it != index.end())
+    {
+        size_bytes -= it->second->second->bytes.size();
+        entries.erase(it->second);
+        index.erase(it);
+    }
+    size_bytes += tile->bytes.size();
+    entries.emplace_front(key, std::move(tile));
+    index[key] = entries.begin();
+    evict();
+}
+
+auto LayerCache::evict() -> void
+{
+    while (size_bytes > capacity_bytes && !entries.empty())
+    {
+        size_bytes -= entries.back().second->bytes.size();
+        index.erase(entries.back().first);
+        entries.pop_back();
+    }
+}
+
+auto LayerCache::set_capacity(size_t capacity_bytes) -> void
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->capacity_bytes = capacity_bytes;
+    evict();
+}
+
+auto LayerCache::capacity() const -> size_t
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return capacity_bytes;
+}
+
+auto LayerCache::clear() -> void
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    index.clear();
+    size_bytes = 0;
+}
+
+auto LayerCache::size() const -> size_t
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return size_bytes;
+}
+
+// The given channels of the chunk, for the layer cache
+static auto save_channels(const Chunk &chunk, ChannelSet channels) -> LayerCache::Tile
+{
+    auto output = std::make_shared<LayerCache::Output>();
+    output->channels = channels & chunk.channels;
+    for (int c = 0; c < MAX_CHANNELS; ++c)
+    {
+        if (!(output->channels & channel_bit(c)))
+            continue;
+        const auto *values = static_cast<const unsigned char *>(chunk.data(c));
+        output->bytes.insert(output->bytes.end(), values,
+                             values + chunk.pixels() *
+                                          channel_type_size(channel_registry().info(c).type));
+    }
+    return output;
+}
+
+// Copies the given channels from an output of the layer cache into the chunk, false if the output
+// does not hold all of them
+static auto restore_channels(const LayerCache::Tile &output, Chunk &chunk, ChannelSet channels)
+    -> bool
+{
+    channels &= chunk.channels;
+    if (!output || (output->channels & channels) != channels)
+        return false;
+    size_t offset = 0;
+    for (int c = 0; c < MAX_CHANNELS; ++c)
+    {
+        if (!(output->channels & channel_bit(c)))
+            continue;
+        auto bytes = chunk.pixels() * channel_type_size(channel_registry().info(c).type);
+        if (channels & channel_bit(c))
+            memcpy(chunk.data(c), output->bytes.data() + offset, bytes);
+        offset += bytes;
+    }
+    return true;
+}
+
+Chunk::Chunk(const Chunk &other)
+    : width(other.width), master_seed(other.master_seed), height(other.height), x(other.x),
+      y(other.y), halo(other.halo), lod(other.lod), biome_palette(other.biome_palette)
+{
+    allocate(other.channels);
+    copy_channels(other, *this, channels);
+}
+
+auto Chunk::operator=(const Chunk &other) -> Chunk &
+{
+    if (this != &other)
+    {
+        width = other.width;
+        master_seed = other.master_seed;
+        height = other.height;
+        x = other.x;
+        y = other.y;
+        halo = other.halo;
+        lod = other.lod;
+        biome_palette = other.biome_palette;
+        allocate(other.channels);
+        copy_channels(other, *this, channels);
+    }
+    return *this;
+}
+
+auto Chunk::allocate(ChannelSet channels) -> void
+{
+    auto bytes = channel_offset(channels, pixels(), MAX_CHANNELS);
+    if (bytes == 0)
+    {
+        release();
+        return;
+    }
+    // A block more than twice as large is given back, so a chunk that shrinks does not keep its
+    // memory
+    if (storage.size() < bytes || storage.size() / 2 > bytes)
+    {
+        storage.release();
+        storage = slab_pool().acquire(bytes);
+    }
+    this->channels = channels;
+
+    auto view = [&](auto &channel, int id) {
+        using T = typename std::remove_reference<decltype(channel[0])>::type;
+        channel = this->channel<T>(id);
+    };
+    view(elevation, 0);
+    view(elevation_dx, 1);
+    view(elevation_dy, 2);
+    view(moisture, 3);
+    view(biome, 4);
+    view(warp_x, 5);
+    view(warp_y, 6);
+    view(elevation16, 7);
+    view(moisture16, 8);
+    view(biome8, 9);
+}
+
+auto Chunk::allocate_like(const Chunk &other) -> void
+{
+    width = other.width;
+    master_seed = other.master_seed;
+    height = other.height;
+    x = other.x;
+    y = other.y;
+    halo = other.halo;
+    lod = other.lod;
+    biome_palette = other.biome_palette;
+    allocate(other.channels);
+}
+
+auto Chunk::release() -> void
+{
+    storage.release();
+    channels = 0;
+    elevation = {};
+    elevation_dx = {};
+    elevation_dy = {};
+    moisture = {};
+    biome = {};
+    warp_x = {};
+    warp_y = {};
+    elevation16 = {};
+    moisture16 = {};
+    biome8 = {};
+}
+
+auto Chunk::has(int id) const -> bool
+{
+    return channels & channel_bit(id);
+}
+
+auto Chunk::data(int id) const -> void *
+{
+    if (!has(id))
+        return nullptr;
+    return static_cast<char *>(storage.data()) + channel_offset(channels, pixels(), id);
+}
+
+auto Chunk::area_width() const -> int
+{
+    return width + 2 * halo;
+}
+
+auto Chunk::area_height() const -> int
+{
+    return height + 2 * halo;
+}
+
+auto Chunk::pixels() const -> size_t
+{
+    return static_cast<size_t>(area_width()) * area_height();
+}
+
+auto Chunk::index(int x, int y) const -> size_t
+{
+    return static_cast<size_t>(y + halo) * area_width() + (x + halo);
+}
+
+auto Chunk::crop() -> void
+{
+    if (halo == 0)
+        return;
+    Chunk source = std::move(*this);
+    halo = 0;
+    allocate(source.channels);
+    for (int c = 0; c < MAX_CHANNELS; ++c)
+    {
+        if (!has(c))
+            continue;
+        auto size = channel_type_size(channel_registry().info(c).type);
+        auto from = static_cast<const char *>(source.data(c));
+        auto to = static_cast<char *>(data(c));
+        for (int row = 0; row < height; ++row)
+            memcpy(to + static_cast<size_t>(row) * width * size,
+                   from + source.index(0, row) * size, static_cast<size_t>(width) * size);
+    }
+}
+
+auto Chunk::is_quantized() const -> bool
+{
+    return channels & (CHANNEL_ELEVATION16 | CHANNEL_MOISTURE16 | CHANNEL_BIOME8);
+}
+
+auto Chunk::quantize() -> void
+{
+    // Every channel with a quantized counterpart is replaced by it
+    auto floats = channels & (CHANNEL_ELEVATION | CHANNEL_MOISTURE | CHANNEL_BIOME);
+    if (!floats)
+        return;
+    ChannelSet quantized = 0;
+    for (int c = 0; c < MAX_CHANNELS; ++c)
+    {
+        if (floats & channel_bit(c))
+            quantized |= channel_bit(channel_registry().info(c).quantized);
+    }
+
+    // The float channels stay in the old storage until the quantized ones are written
+    Chunk source = std::move(*this);
+    allocate((source.channels & ~floats) | quantized);
+    copy_channels(source, *this, channels);
+    kernels().quantize_unorm16(source.elevation.data(), elevation16.data(), elevation16.size());
+    kernels().quantize_unorm16(source.moisture.data(), moisture16.data(), moisture16.size());
+
+    // Index of every biome id (from -1) in the palette, -1 until the id is found
+    biome_palette.clear();
+    const auto &ids = source.biome;
+    int max_id = ids.empty() ? -1 : *std::max_element(ids.begin(), ids.end());
+    std::vector<int> slots(static_cast<size_t>(max_id) + 2, -1);
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        auto &slot = slots[static_cast<size_t>(ids[i] + 1)];
+        if (slot == -1)
+        {
+            if (biome_palette.size() == 256)
+                throw std::runtime_error("Cannot quantize a chunk with more than 256 biomes");
+            slot = static_cast<int>(biome_palette.size());
+            biome_palette.push_back(ids[i]);
+        }
+        biome8[i] = static_cast<uint8_t>(slot);
+    }
+}
+
+auto Chunk::dequantize() -> void
+{
+    auto quantized = channels & (CHANNEL_ELEVATION16 | CHANNEL_MOISTURE16 | CHANNEL_BIOME8);
+    if (!quantized)
+        return;
+    ChannelSet floats = 0;
+    for (size_t c = 0; c < channel_registry().size(); ++c)
+    {
+        auto counterpart = channel_registry().info(static_cast<int>(c)).quantized;
+        if (counterpart >= 0 && (quantized & channel_bit(counterpart)))
+            floats |= channel_bit(static_cast<int>(c));
+    }
+
+    Chunk source = std::move(*this);
+    allocate((source.channels & ~quantized) | floats);
+    copy_channels(source, *this, channels);
+    kernels().dequantize_unorm16(source.elevation16.data(), elevation.data(), elevation.size());
+    kernels().dequantize_unorm16(source.moisture16.data(), moisture.data(), moisture.size());
+    for (size_t i = 0; i < biome.size(); ++i)
+        biome[i] = source.biome_palette[source.biome8[i]];
+    biome_palette.clear();
+}
+
+auto Chunk::elevation_at(int idx) const -> float
+{
+    return elevation16.empty() ? elevation[idx] : elevation16[idx] * (1.0f / UNORM16_MAX);
+}
+
+auto Chunk::moisture_at(int idx) const -> float
+{
+    return moisture16.empty() ? moisture[idx] : moisture16[idx] * (1.0f / UNORM16_MAX);
+}
+
+auto Chunk::biome_at(int idx) const -> int
+{
+    return biome8.empty() ? biome[idx] : biome_palette[biome8[idx]];
+}
+
+auto Chunk::stored(int id) const -> int
+{
+    if (has(id))
+        return id;
+    auto quantized = channel_registry().info(id).quantized;
+    return quantized >= 0 && has(quantized) ? quantized : -1;
+}
+
+auto Chunk::value_at(int id, int idx) const -> float
+{
+    auto stored_id = stored(id);
+    if (stored_id == -1)
+        throw std::runtime_error("The chunk has no channel " + channel_registry().info(id).name);
+    auto values = data(stored_id);
+    switch (channel_registry().info(stored_id).type)
+    {
+    case ChannelType::FLOAT32:
+        return static_cast<const float *>(values)[idx];
+    case ChannelType::UNORM16:
+        return static_cast<const uint16_t *>(values)[idx] * (1.0f / UNORM16_MAX);
+    case ChannelType::INT32:
+        return static_cast<float>(static_cast<const int32_t *>(values)[idx]);
+    case ChannelType::UINT8:
+        return static_cast<float>(static_cast<const uint8_t *>(values)[idx]);
+    }
+    return 0.0f;
+}
+
+// Fills every value of a channel with value
+template <typename T> static auto fill_channel(const Chunk &chunk, int id, T value) -> void
+{
+    auto channel = chunk.channel<T>(id);
+    std::fill(channel.begin(), channel.end(), value);
+}
+
+class InitializationLayer final : public InPlaceLayer
+{
+    int width, height, master_seed, halo;
+    // Channels read or written by the layers after this one
+    ChannelSet channels;
 
   public:
-    InitializationLayer(int width, int height, int master_seed)
-        : width(width), height(height), master_seed(master_seed)
+    InitializationLayer(int width, int height, int master_seed, int halo, ChannelSet channels)
+        : width(width), height(height), master_seed(master_seed), halo(halo), channels(channels)
+    {
+    }
+
+    // Also stores these channels in every chunk, for a layer added after the pipeline was built
+    auto add_channels(ChannelSet added) -> void { channels |= added; }
+
+    // The channels are left out, the values of the initialized ones do not depend on them. The
+    // level of detail is part of LayerKey
+    auto fingerprint(const Registry &registry) const -> uint64_t
     {
+        return Fingerprint()
+            .add("initialization")
+            .add(width)
+            .add(height)
+            .add(master_seed)
+            .add(halo)
+            .value();
     }
 
     auto execute(Chunk &chunk, Registry &registry) const -> void
     {
-        chunk.width = width;
-        chunk.height = height;
+        chunk.width = std::max(1, width >> chunk.lod);
+        chunk.height = std::max(1, height >> chunk.lod);
         chunk.master_seed = master_seed;
-        if (chunk.elevation.size() == static_cast<size_t>(width * height))
+        chunk.halo = halo;
+        // Reuses the storage of the chunk on updates
+        chunk.allocate(channels);
+        chunk.biome_palette.clear();
+        for (int c = 0; c < MAX_CHANNELS; ++c)
         {
-            for (auto &e : chunk.elevation)
-                e = 0.5f;
+            if (!chunk.has(c) || !channel_registry().info(c).initialized)
+                continue;
+            auto initial = channel_registry().info(c).initial;
+            switch (channel_registry().info(c).type)
+            {
+            case ChannelType::FLOAT32:
+                fill_channel<float>(chunk, c, initial);
+                break;
+            case ChannelType::UNORM16:
+                fill_channel<uint16_t>(chunk, c, static_cast<uint16_t>(initial * UNORM16_MAX));
+                break;
+            case ChannelType::INT32:
+                fill_channel<int32_t>(chunk, c, static_cast<int32_t>(initial));
+                break;
+            case ChannelType::UINT8:
+                fill_channel<uint8_t>(chunk, c, static_cast<uint8_t>(initial));
+                break;
+            }
         }
-        else
-            chunk.elevation = std::vector<float>(width * height, 0.5f);
+    }
+};
+
+// Moves every pixel of the chunk along a smooth random vector field once, into Chunk::warp_x and
+// Chunk::warp_y. The terrain and moisture layers then evaluate their noise at the warped
+// positions, so the warp costs one batch of domain warp kernel calls per chunk instead of one
+// warp per octave and per field
+class DomainWarpLayer final : public PixelLayer
+{
+    NoiseGenerator generator;
+    // Chunk units to the units of the warp generator
+    float map_scale;
+    uint64_t parameters;
+
+  public:
+    DomainWarpLayer(const confparse::Config &cfg)
+    {
+        auto global_map_scale = cfg.get("global_map_scale").parse<float>();
+        map_scale = cfg.get("warp.scale").parse<float>() * global_map_scale;
+        generator = NoiseGenerator(cfg.get("seed").parse<int>() + WARP_SEED_MAGIC_NUMBER);
+        auto type = parse_domain_warp_type(cfg.get("warp.type").as_string());
+        auto amplitude = cfg.get("warp.amplitude").parse<float>();
+        generator.set_domain_warp(type, amplitude);
+        parameters = Fingerprint()
+                         .add("warp")
+                         .add(generator.seed())
+                         .add(static_cast<int>(type))
+                         .add(amplitude)
+                         .add(map_scale)
+                         .value();
+    }
+
+    auto writes() const -> ChannelSet { return CHANNEL_WARP_X | CHANNEL_WARP_Y; }
 
-        if (chunk.moisture.size() == static_cast<size_t>(width * height))
+    auto fingerprint(const Registry &registry) const -> uint64_t { return parameters; }
+
+    auto execute_rows(Chunk &chunk, Registry &registry, int row_begin, int row_end) const -> void
+    {
+        ChunkCoordinates coordinates(static_cast<float>(chunk.x), static_cast<float>(chunk.y),
+                                     chunk.width, chunk.height, chunk.halo);
+        auto begin = static_cast<size_t>(row_begin) * chunk.area_width();
+        auto size = static_cast<size_t>(row_end - row_begin) * chunk.area_width();
+        for (int y = row_begin; y < row_end; ++y)
         {
-            for (auto &m : chunk.moisture)
-                m = 0.5f;
+            for (int x = 0; x < chunk.area_width(); ++x)
+            {
+                auto i = static_cast<size_t>(y) * chunk.area_width() + x;
+                chunk.warp_x[i] = map_scale * coordinates.columns[x];
+                chunk.warp_y[i] = map_scale * coordinates.rows[y];
+            }
         }
-        else
-            chunk.moisture = std::vector<float>(width * height, 0.5f);
+        generator.warp_batch(chunk.warp_x.data() + begin, chunk.warp_y.data() + begin, size);
 
-        if (chunk.biome.size() == static_cast<size_t>(width * height))
+        float inv_scale = 1.0f / map_scale;
+        for (size_t i = begin; i < begin + size; ++i)
         {
-            for (auto &b : chunk.biome)
-                b = -1;
+            chunk.warp_x[i] *= inv_scale;
+            chunk.warp_y[i] *= inv_scale;
         }
-        else
-            chunk.biome = std::vector<int>(width * height, -1);
     }
 };
 
-class TerrainGenerationLayer : public InPlaceLayer
+// A layer that fills one channel of the chunk with a noise map. All of these layers evaluate noise
+// over the same chunk coordinates, so several of them can be run together by FusedNoiseLayer
+class NoiseFieldLayer : public PixelLayer
+{
+    // Warp channels when warp.enabled is set, see check_warp()
+    ChannelSet inputs = 0;
+
+  protected:
+    // The field evaluated at the pixels of the chunk, at their warped positions when
+    // DomainWarpLayer ran on it, and 2^lod pixels of level 0 apart (see NoiseField::stride)
+    static auto placed(NoiseField field, const Chunk &chunk) -> NoiseField
+    {
+        field.stride = 1 << chunk.lod;
+        if (!chunk.warp_x.empty())
+        {
+            field.warp_x = chunk.warp_x.data();
+            field.warp_y = chunk.warp_y.data();
+        }
+        return field;
+    }
+
+    // The warp moves every pixel off the grid, which the derivatives and the spectral backend
+    // cannot follow. The layer reads the warp channels when the warp is enabled
+    auto check_warp(const confparse::Config &cfg, const std::string &prefix,
+                    const NoiseMap &noisemap, bool gradient) -> void
+    {
+        if (!cfg.get("warp.enabled").try_parse<bool>(false))
+            return;
+        inputs = CHANNEL_WARP_X | CHANNEL_WARP_Y;
+        if (gradient)
+            throw std::runtime_error(prefix + ".gradient is not supported with warp.enabled");
+        if (noisemap.backend() == NoiseBackend::SPECTRAL)
+            throw std::runtime_error("The spectral backend of " + prefix +
+                                     " is not supported with warp.enabled");
+    }
+
+    // Noise maps of the levels of detail 1 to MAX_LOD with lod_skip_octaves (see NoiseMap::lod()),
+    // empty otherwise
+    static auto lod_noisemaps(const confparse::Config &cfg, const NoiseMap &noisemap)
+        -> std::vector<NoiseMap>
+    {
+        std::vector<NoiseMap> noisemaps;
+        if (!cfg.get("lod_skip_octaves").try_parse<bool>(true))
+            return noisemaps;
+        for (int level = 1; level <= MAX_LOD; ++level)
+            noisemaps.push_back(noisemap.lod(level));
+        return noisemaps;
+    }
+
+    // The noise map of the level of detail of the chunk
+    static auto noisemap_at(const Chunk &chunk, const NoiseMap &noisemap,
+                            const std::vector<NoiseMap> &noisemaps) -> const NoiseMap *
+    {
+        if (chunk.lod == 0 || noisemaps.empty())
+            return &noisemap;
+        return &noisemaps[static_cast<size_t>(chunk.lod - 1)];
+    }
+
+    // Fingerprint of a field with these parameters. The truncated fields of classification_only
+    // also depend on the biome thresholds
+    static auto field_fingerprint(const confparse::Config &cfg, const std::string &prefix,
+                                  const NoiseMap &noisemap, float map_scale, bool gradient)
+        -> uint64_t
+    {
+        Fingerprint result;
+        result.add(prefix).add(noisemap.fingerprint()).add(map_scale).add(gradient);
+        result.add(cfg.get("warp.enabled").try_parse<bool>(false));
+        result.add(cfg.get("lod_skip_octaves").try_parse<bool>(true));
+        if (NoiseGraph::has_graph(cfg, prefix))
+            result.add(cfg.get(prefix + ".graph").as_string());
+        return result.value();
+    }
+
+    static auto field_fingerprint(uint64_t parameters, bool classification_only,
+                                  const Registry &registry) -> uint64_t
+    {
+        if (!classification_only)
+            return parameters;
+        return Fingerprint()
+            .add(parameters)
+            .add(registry.biome_registry.ranges().fingerprint())
+            .value();
+    }
+
+  public:
+    virtual auto field(Chunk &chunk, const Registry &registry) const -> NoiseField = 0;
+
+    auto reads() const -> ChannelSet { return inputs; }
+
+    auto execute_rows(Chunk &chunk, Registry &registry, int row_begin, int row_end) const -> void
+    {
+        create_noise_maps(chunk.x, chunk.y, chunk.width, chunk.height, {field(chunk, registry)},
+                          chunk.halo, row_begin, row_end);
+    }
+
+    virtual ~NoiseFieldLayer() {}
+};
+
+class TerrainGenerationLayer final : public NoiseFieldLayer
 {
     NoiseMap noisemap;
+    // See lod_noisemaps()
+    std::vector<NoiseMap> noisemaps;
+    // Replaces the noise map when terrain.graph is set
+    std::unique_ptr<NoiseGraph> graph;
     float map_scale;
+    OctaveCache *cache;
+    bool classification_only;
+    bool gradient;
+    uint64_t parameters;
 
   public:
-    TerrainGenerationLayer(const confparse::Config &cfg)
+    TerrainGenerationLayer(const confparse::Config &cfg, OctaveCache *cache = nullptr)
+        : cache(cache)
     {
+        classification_only = cfg.get("classification_only").try_parse<bool>(false);
+        gradient = cfg.get("terrain.gradient").try_parse<bool>(false);
         auto global_map_scale = cfg.get("global_map_scale").parse<float>();
         map_scale = cfg.get("terrain.scale").parse<float>() * global_map_scale;
-        auto redistribution = cfg.get("terrain.redistribution").try_parse<float>(1.0f);
-        auto fudge = cfg.get("terrain.fudge").parse<float>();
-        auto octaves = cfg.get("terrain.octaves").parse<int>();
         auto seed = cfg.get("seed").parse<int>() + TERRAIN_SEED_MAGIC_NUMBER;
-
-        std::vector<float> frequencies;
-        std::vector<float> amplitudes;
-
-        for (int i = 1; i <= octaves; ++i)
+        noisemap = NoiseMap::from_config(cfg, "terrain", seed);
+        if (NoiseGraph::has_graph(cfg, "terrain"))
         {
-            auto frequency = cfg.get("terrain.frequency" + std::to_string(i)).parse<float>();
-            auto amplitude = cfg.get("terrain.amplitude" + std::to_string(i)).parse<float>();
-            frequencies.push_back(frequency);
-            amplitudes.push_back(amplitude);
+            if (gradient)
+                throw std::runtime_error("terrain.gradient is not supported with terrain.graph");
+            graph = std::make_unique<NoiseGraph>(
+                NoiseGraph::from_config(cfg, "terrain", seed, noisemap));
         }
-        NoiseGenerator base_generator{seed};
-        noisemap = NoiseMap(frequencies, amplitudes, base_generator, fudge, redistribution);
+        check_warp(cfg, "terrain", noisemap, gradient);
+        noisemaps = lod_noisemaps(cfg, noisemap);
+        parameters = field_fingerprint(cfg, "terrain", noisemap, map_scale, gradient);
     }
 
-    auto execute(Chunk &chunk, Registry &registry) const -> void
+    auto fingerprint(const Registry &registry) const -> uint64_t
     {
-        noisemap.create_noise_map(chunk.x, chunk.y, chunk.width, chunk.height, map_scale,
-                                  chunk.elevation);
+        return field_fingerprint(parameters, classification_only && !gradient, registry);
+    }
+
+    auto writes() const -> ChannelSet
+    {
+        return gradient ? CHANNEL_ELEVATION | CHANNEL_ELEVATION_DX | CHANNEL_ELEVATION_DY
+                        : CHANNEL_ELEVATION;
+    }
+
+    auto field(Chunk &chunk, const Registry &registry) const -> NoiseField
+    {
+        const auto &thresholds = registry.biome_registry.ranges().elevation_thresholds;
+        if (graph)
+        {
+            NoiseField result{&noisemap, map_scale, chunk.elevation.data()};
+            result.graph = graph.get();
+            return placed(result, chunk);
+        }
+        const auto *map = noisemap_at(chunk, noisemap, noisemaps);
+        if (!gradient)
+            return placed({map, map_scale, chunk.elevation.data(), cache,
+                           classification_only ? &thresholds : nullptr},
+                          chunk);
+        return placed({map, map_scale, chunk.elevation.data(), cache, nullptr,
+                       chunk.elevation_dx.data(), chunk.elevation_dy.data()},
+                      chunk);
     }
 };
 
-class MoistureGenerationLayer : public InPlaceLayer
+class MoistureGenerationLayer final : public NoiseFieldLayer
 {
     NoiseMap noisemap;
+    // See lod_noisemaps()
+    std::vector<NoiseMap> noisemaps;
+    // Replaces the noise map when moisture.graph is set
+    std::unique_ptr<NoiseGraph> graph;
     float map_scale;
+    OctaveCache *cache;
+    bool classification_only;
+    uint64_t parameters;
 
   public:
-    MoistureGenerationLayer(const confparse::Config &cfg)
+    MoistureGenerationLayer(const confparse::Config &cfg, OctaveCache *cache = nullptr)
+        : cache(cache)
     {
+        classification_only = cfg.get("classification_only").try_parse<bool>(false);
         auto global_map_scale = cfg.get("global_map_scale").parse<float>();
         map_scale = cfg.get("moisture.scale").parse<float>() * global_map_scale;
-        auto redistribution = cfg.get("moisture.redistribution").try_parse<float>(1.0f);
-        auto fudge = cfg.get("moisture.fudge").parse<float>();
-        auto octaves = cfg.get("moisture.octaves").parse<int>();
         auto seed = cfg.get("seed").parse<int>() + MOISTURE_SEED_MAGIC_NUMBER;
+        noisemap = NoiseMap::from_config(cfg, "moisture", seed);
+        if (NoiseGraph::has_graph(cfg, "moisture"))
+            graph = std::make_unique<NoiseGraph>(
+                NoiseGraph::from_config(cfg, "moisture", seed, noisemap));
+        check_warp(cfg, "moisture", noisemap, false);
+        noisemaps = lod_noisemaps(cfg, noisemap);
+        parameters = field_fingerprint(cfg, "moisture", noisemap, map_scale, false);
+    }
+
+    auto fingerprint(const Registry &registry) const -> uint64_t
+    {
+        return field_fingerprint(parameters, classification_only, registry);
+    }
 
-        std::vector<float> frequencies;
-        std::vector<float> amplitudes;
+    auto writes() const -> ChannelSet { return CHANNEL_MOISTURE; }
 
-        for (int i = 1; i <= octaves; ++i)
+    auto field(Chunk &chunk, const Registry &registry) const -> NoiseField
+    {
+        const auto &thresholds = registry.biome_registry.ranges().moisture_thresholds;
+        if (graph)
         {
-            auto frequency = cfg.get("moisture.frequency" + std::to_string(i)).parse<float>();
-            auto amplitude = cfg.get("moisture.amplitude" + std::to_string(i)).parse<float>();
-            frequencies.push_back(frequency);
-            amplitudes.push_back(amplitude);
+            NoiseField result{&noisemap, map_scale, chunk.moisture.data()};
+            result.graph = graph.get();
+            return placed(result, chunk);
         }
+        return placed({noisemap_at(chunk, noisemap, noisemaps), map_scale, chunk.moisture.data(),
+                       cache, classification_only ? &thresholds : nullptr},
+                      chunk);
+    }
+};
+
+// Runs several noise field layers in one pass over the chunk, see create_noise_maps()
+template <typename... Fields> class FusedNoiseLayer final : public PixelLayer
+{
+    std::tuple<std::unique_ptr<Fields>...> field_layers;
+
+  public:
+    FusedNoiseLayer(std::unique_ptr<Fields>... field_layers)
+        : field_layers(std::move(field_layers)...)
+    {
+    }
 
-        NoiseGenerator base_generator{seed};
-        noisemap = NoiseMap(frequencies, amplitudes, base_generator, fudge, redistribution);
+    auto reads() const -> ChannelSet
+    {
+        return std::apply([](const auto &...layer) { return (layer->reads() | ...); },
+                          field_layers);
     }
 
-    auto execute(Chunk &chunk, Registry &registry) const -> void
+    auto writes() const -> ChannelSet
+    {
+        return std::apply([](const auto &...layer) { return (layer->writes() | ...); },
+                          field_layers);
+    }
+
+    auto fingerprint(const Registry &registry) const -> uint64_t
+    {
+        return std::apply(
+            [&](const auto &...layer) {
+                Fingerprint result;
+                (result.add(layer->fingerprint(registry)), ...);
+                return result.value();
+            },
+            field_layers);
+    }
+
+    auto execute_rows(Chunk &chunk, Registry &registry, int row_begin, int row_end) const -> void
     {
-        noisemap.create_noise_map(chunk.x, chunk.y, chunk.width, chunk.height, map_scale,
-                                  chunk.moisture);
+        std::apply(
+            [&](const auto &...layer) {
+                create_noise_maps(chunk.x, chunk.y, chunk.width, chunk.height,
+                                  {layer->field(chunk, registry)...}, chunk.halo, row_begin,
+                                  row_end);
+            },
+            field_layers);
     }
 };
 
-class BiomeCreationLayer : public InPlaceLayer
+class BiomeCreationLayer final : public PixelLayer
 {
 
   public:
     BiomeCreationLayer(const confparse::Config &cfg) {}
 
+    auto reads() const -> ChannelSet { return CHANNEL_ELEVATION | CHANNEL_MOISTURE; }
+
+    auto writes() const -> ChannelSet { return CHANNEL_BIOME; }
+
+    auto fingerprint(const Registry &registry) const -> uint64_t
+    {
+        return Fingerprint()
+            .add("biome")
+            .add(registry.biome_registry.ranges().fingerprint())
+            .value();
+    }
+
+    auto execute_rows(Chunk &chunk, Registry &registry, int row_begin, int row_end) const -> void
+    {
+        const auto &ranges = registry.biome_registry.ranges();
+        BiomeRangeView view{ranges.elevation_start.data(), ranges.elevation_end.data(),
+                            ranges.moisture_start.data(), ranges.moisture_end.data(),
+                            ranges.ids.data(), ranges.ids.size()};
+        auto begin = static_cast<size_t>(row_begin) * chunk.area_width();
+        auto size = static_cast<size_t>(row_end - row_begin) * chunk.area_width();
+        kernels().classify_biomes(view, chunk.moisture.data() + begin,
+                                  chunk.elevation.data() + begin, chunk.biome.data() + begin, size);
+    }
+};
+
+// Derivatives of the elevation per pixel by central differences, for the hillshade renderer. Unlike
+// terrain.gradient it works with every noise type, graph and warp. Needs a halo of one pixel, the
+// outermost ring of the halo is only differentiated one sided
+class SlopeLayer final : public InPlaceLayer
+{
+  public:
+    auto reads() const -> ChannelSet { return CHANNEL_ELEVATION; }
+
+    auto writes() const -> ChannelSet { return CHANNEL_ELEVATION_DX | CHANNEL_ELEVATION_DY; }
+
+    auto halo() const -> int { return 1; }
+
+    auto fingerprint(const Registry &registry) const -> uint64_t
+    {
+        return Fingerprint().add("slope").value();
+    }
+
     auto execute(Chunk &chunk, Registry &registry) const -> void
     {
-        int idx = 0;
-        for (int y = 0; y < chunk.height; ++y)
+        int width = chunk.area_width(), height = chunk.area_height();
+        const float *elevation = chunk.elevation.data();
+        for (int y = 0; y < height; ++y)
+        {
+            int y_above = std::max(y - 1, 0), y_below = std::min(y + 1, height - 1);
+            const float *row = elevation + static_cast<size_t>(y) * width;
+            const float *above = elevation + static_cast<size_t>(y_above) * width;
+            const float *below = elevation + static_cast<size_t>(y_below) * width;
+            float *dx = chunk.elevation_dx.data() + static_cast<size_t>(y) * width;
+            float *dy = chunk.elevation_dy.data() + static_cast<size_t>(y) * width;
+            float row_scale = (y == 0 || y == height - 1) ? 1.0f : 0.5f;
+            for (int x = 0; x < width; ++x)
+                dy[x] = row_scale * (below[x] - above[x]);
+            for (int x = 1; x < width - 1; ++x)
+                dx[x] = 0.5f * (row[x + 1] - row[x - 1]);
+            dx[0] = width > 1 ? row[1] - row[0] : 0.0f;
+            dx[width - 1] = width > 1 ? row[width - 1] - row[width - 2] : 0.0f;
+        }
+    }
+};
+
+// Drops the halo of the chunk once the layers that read it are done (see Chunk::crop)
+class CropLayer final : public InPlaceLayer
+{
+  public:
+    auto execute(Chunk &chunk, Registry &registry) const -> void { chunk.crop(); }
+
+    auto fingerprint(const Registry &registry) const -> uint64_t
+    {
+        return Fingerprint().add("crop").value();
+    }
+};
+
+// Last layer with chunk_storage = quantized, keeps only the quantized storage of the chunk (see
+// Chunk::quantize)
+class QuantizationLayer final : public InPlaceLayer
+{
+  public:
+    auto execute(Chunk &chunk, Registry &registry) const -> void { chunk.quantize(); }
+
+    auto fingerprint(const Registry &registry) const -> uint64_t
+    {
+        return Fingerprint().add("quantization").value();
+    }
+};
+
+// Rows per band when running pixel layers over a chunk a band at a time, the whole chunk for
+// tile_pixels = 0
+static auto band_rows(const Chunk &chunk, size_t tile_pixels) -> int
+{
+    if (tile_pixels == 0)
+        return chunk.area_height();
+    return std::max(1, static_cast<int>(tile_pixels / static_cast<size_t>(chunk.area_width())));
+}
+
+// Scratch chunks of the out-place layers that are not running, see run_out_place(). Every call
+// takes its own, a scratch chunk per thread is not enough: a layer that submits tasks to
+// task_pool() may run another chunk's out-place layer on the same thread while it writes its
+// output. At most one chunk per thread of task_pool() is kept, the storage of the others goes back
+// to slab_pool(), which keeps it within chunk_pool_megabytes. Safe to use from several threads
+class ScratchChunks
+{
+    std::vector<Chunk> chunks;
+    std::mutex mutex;
+
+  public:
+    // A released chunk with its storage, or an empty chunk if there is none
+    auto acquire() -> Chunk
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (chunks.empty())
+            return Chunk();
+        auto chunk = std::move(chunks.back());
+        chunks.pop_back();
+        return chunk;
+    }
+
+    auto release(Chunk &&chunk) -> void
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // The submitting thread runs tasks too
+        if (chunks.size() < task_pool().size() + 1)
+            chunks.push_back(std::move(chunk));
+        else
+            chunk.release();
+    }
+};
+
+static auto scratch_chunks() -> ScratchChunks &
+{
+    static ScratchChunks scratch;
+    return scratch;
+}
+
+// Runs an out-place layer into a scratch chunk, then swaps the two and gives back the storage of
+// the input as the next scratch chunk. The layer is called as a T, so that the call can be inlined
+// for the layers of a StaticPipeline, plugin layers are called through OutPlaceLayer
+template <typename T>
+static auto run_out_place(const T &layer, Chunk &chunk, Registry &registry) -> void
+{
+    auto scratch = scratch_chunks().acquire();
+    try
+    {
+        if constexpr (std::is_same<T, OutPlaceLayer>::value)
+            layer.execute(chunk, scratch, registry);
+        else
+            layer.T::execute(chunk, scratch, registry);
+    }
+    catch (...)
+    {
+        scratch_chunks().release(std::move(scratch));
+        throw;
+    }
+    std::swap(chunk, scratch);
+    scratch_chunks().release(std::move(scratch));
+}
+
+// Level of every layer in the dependency graph of a pipeline, -1 for null layers. A layer depends
+// on the layers before it that write a channel it reads or read a channel it writes, and gets the
+// level after the highest of theirs. Layers on the same level can then run at the same time.
+// Out-place layers and layers that declare no channels work on the storage of the whole chunk
+// (InitializationLayer, CropLayer), they get a level of their own. Throws std::runtime_error if two
+// layers write the same channel
+static auto layer_levels(const std::vector<const Layer *> &layers) -> std::vector<int>
+{
+    std::vector<int> levels(layers.size(), -1);
+    // Highest level so far, and level of the last layer that works on the whole chunk
+    int last = -1, barrier = -1;
+    for (size_t i = 0; i < layers.size(); ++i)
+    {
+        if (!layers[i])
+            continue;
+        auto reads = layers[i]->reads(), writes = layers[i]->writes();
+        if (layers[i]->type() == LayerType::OUTPLACE || !(reads | writes))
+        {
+            levels[i] = barrier = ++last;
+            continue;
+        }
+        int level = barrier + 1;
+        for (size_t j = 0; j < i; ++j)
+        {
+            if (!layers[j])
+                continue;
+            auto conflicts = writes & layers[j]->writes();
+            for (int c = 0; conflicts && c < MAX_CHANNELS; ++c)
+            {
+                if (conflicts & channel_bit(c))
+                    throw std::runtime_error("Two layers of the pipeline write channel " +
+                                             channel_registry().info(c).name);
+            }
+            if ((reads & layers[j]->writes()) || (writes & layers[j]->reads()))
+                level = std::max(level, levels[j] + 1);
+        }
+        levels[i] = level;
+        last = std::max(last, level);
+    }
+    return levels;
+}
+
+// Layers of fixed types run in a fixed order. Each layer is called directly instead of through
+// Layer, so the compiler can inline the whole pipeline, and there is no type() check per layer.
+// Layers that are not part of the pipeline are null and skipped. Consecutive pixel layers are run
+// a band of rows at a time (see PixelLayer), layers of other types between them split the bands.
+// With levels, the layers run level by level instead, the layers of a level at the same time on
+// task_pool()
+template <typename... Layers> class StaticPipeline
+{
+    std::tuple<std::unique_ptr<Layers>...> layers;
+    // See layer_levels(), empty to run the layers in order
+    std::vector<int> levels;
+
+    template <typename T> static auto run(const T *layer, Chunk &chunk, Registry &registry) -> void
+    {
+        if (!layer)
+            return;
+        if constexpr (std::is_base_of<OutPlaceLayer, T>::value)
+            run_out_place(*layer, chunk, registry);
+        else
+            layer->T::execute(chunk, registry);
+    }
+
+    // Runs the pixel layers among layers first to last - 1 on a band of rows
+    template <size_t... I>
+    auto run_rows(std::index_sequence<I...>, size_t first, size_t last, Chunk &chunk,
+                  Registry &registry, int row_begin, int row_end) const -> void
+    {
+        auto run_layer = [&](const auto *layer, size_t i) {
+            using T = std::remove_cv_t<std::remove_pointer_t<decltype(layer)>>;
+            if constexpr (std::is_base_of<PixelLayer, T>::value)
+            {
+                if (layer && i >= first && i < last)
+                    layer->T::execute_rows(chunk, registry, row_begin, row_end);
+            }
+        };
+        (run_layer(std::get<I>(layers).get(), I), ...);
+    }
+
+    auto run_bands(size_t first, size_t last, Chunk &chunk, Registry &registry,
+                   size_t tile_pixels) const -> void
+    {
+        if (first >= last)
+            return;
+        int rows = chunk.area_height(), band = band_rows(chunk, tile_pixels);
+        for (int row = 0; row < rows; row += band)
+            run_rows(std::index_sequence_for<Layers...>(), first, last, chunk, registry, row,
+                     std::min(rows, row + band));
+    }
+
+    // Runs the layers of slots begin to end - 1 in order
+    template <size_t... I>
+    auto execute(std::index_sequence<I...>, Chunk &chunk, Registry &registry, size_t tile_pixels,
+                 size_t begin, size_t end) const -> void
+    {
+        // Start of the current run of pixel layers
+        size_t first = begin;
+        auto run_layer = [&](const auto *layer, size_t i) {
+            using T = std::remove_cv_t<std::remove_pointer_t<decltype(layer)>>;
+            if constexpr (!std::is_base_of<PixelLayer, T>::value)
+            {
+                if (!layer || i < begin || i >= end)
+                    return;
+                run_bands(first, i, chunk, registry, tile_pixels);
+                run(layer, chunk, registry);
+                first = i + 1;
+            }
+        };
+        (run_layer(std::get<I>(layers).get(), I), ...);
+        run_bands(first, end, chunk, registry, tile_pixels);
+    }
+
+    // Runs layer slot, which is not known at compile time
+    template <size_t... I>
+    auto run_slot(std::index_sequence<I...>, size_t slot, Chunk &chunk, Registry &registry) const
+        -> void
+    {
+        ((I == slot ? run(std::get<I>(layers).get(), chunk, registry) : void()), ...);
+    }
+
+    // Only runs the layers of the given slots when slots is not null
+    auto execute_levels(Chunk &chunk, Registry &registry,
+                        const std::vector<bool> *slots = nullptr) const -> void
+    {
+        int max_level = *std::max_element(levels.begin(), levels.end());
+        std::vector<std::function<void()>> tasks;
+        for (int level = 0; level <= max_level; ++level)
+        {
+            tasks.clear();
+            for (size_t i = 0; i < levels.size(); ++i)
+            {
+                if (levels[i] == level && (!slots || (*slots)[i]))
+                    tasks.push_back([this, i, &chunk, &registry]() {
+                        run_slot(std::index_sequence_for<Layers...>(), i, chunk, registry);
+                    });
+            }
+            if (tasks.size() == 1)
+                tasks.front()();
+            else if (!tasks.empty())
+                task_pool().run(tasks);
+        }
+    }
+
+  public:
+    template <typename T> auto get() -> std::unique_ptr<T> &
+    {
+        return std::get<std::unique_ptr<T>>(layers);
+    }
+
+    // Number of slots, see all()
+    static constexpr auto size() -> size_t { return sizeof...(Layers); }
+
+    // Slot of the layer of type T, see all()
+    template <typename T> static constexpr auto slot() -> size_t
+    {
+        constexpr bool matches[] = {std::is_same<T, Layers>::value...};
+        for (size_t i = 0; i < sizeof...(Layers); ++i)
+        {
+            if (matches[i])
+                return i;
+        }
+        return sizeof...(Layers);
+    }
+
+    // Every layer in order, null for the ones that are not part of the pipeline
+    auto all() const -> std::vector<const Layer *>
+    {
+        return std::apply(
+            [](const auto &...layer) { return std::vector<const Layer *>{layer.get()...}; },
+            layers);
+    }
+
+    auto set_levels(std::vector<int> levels) -> void { this->levels = std::move(levels); }
+
+    auto execute(Chunk &chunk, Registry &registry, size_t tile_pixels) const -> void
+    {
+        execute_range(chunk, registry, 0, sizeof...(Layers), tile_pixels);
+    }
+
+    // Runs the layers of slots first to last - 1 (see all()) the same way as execute()
+    auto execute_range(Chunk &chunk, Registry &registry, size_t first, size_t last,
+                       size_t tile_pixels) const -> void
+    {
+        if (levels.empty())
+            return execute(std::index_sequence_for<Layers...>(), chunk, registry, tile_pixels,
+                           first, last);
+        std::vector<bool> slots(sizeof...(Layers), false);
+        std::fill(slots.begin() + first, slots.begin() + last, true);
+        execute_levels(chunk, registry, &slots);
+    }
+
+    // Runs the layers of the given slots (see all()) only, each over the whole chunk
+    auto execute_slots(Chunk &chunk, Registry &registry, const std::vector<bool> &slots) const
+        -> void
+    {
+        if (!levels.empty())
+            return execute_levels(chunk, registry, &slots);
+        for (size_t i = 0; i < slots.size(); ++i)
         {
-            for (int x = 0; x < chunk.width; ++x)
+            if (slots[i])
+                run_slot(std::index_sequence_for<Layers...>(), i, chunk, registry);
+        }
+    }
+
+    // execute_slots() (every slot when slots is null) through the cache. The outputs of a layer
+    // with a fingerprint chain are copied from the cache when it has them, the other layers run
+    // and their outputs are stored. Layers that declare no channels always run, and split the
+    // pipeline into parts that run one after the other
+    auto execute_cached(Chunk &chunk, Registry &registry, LayerCache &cache,
+                        const std::vector<bool> *slots = nullptr) const -> void
+    {
+        auto pipeline = all();
+        std::vector<bool> pending(pipeline.size(), false);
+        std::vector<LayerKey> keys(pipeline.size());
+        auto run_pending = [&]() {
+            if (std::find(pending.begin(), pending.end(), true) == pending.end())
+                return;
+            execute_slots(chunk, registry, pending);
+            for (size_t i = 0; i < pending.size(); ++i)
             {
-                chunk.biome[idx] = registry.biome_registry.get_biome_within_range(
-                    chunk.moisture[idx], chunk.elevation[idx]);
-                idx++;
+                if (pending[i])
+                    cache.put(keys[i], save_channels(chunk, pipeline[i]->writes()));
+                pending[i] = false;
             }
+        };
+
+        // 0 once a layer without a fingerprint was met
+        uint64_t chain = Fingerprint().value();
+        for (size_t i = 0; i < pipeline.size(); ++i)
+        {
+            const auto *layer = pipeline[i];
+            if (!layer)
+                continue;
+            auto fingerprint = layer->fingerprint(registry);
+            chain = chain && fingerprint ? Fingerprint().add(chain).add(fingerprint).value() : 0;
+            if (slots && !(*slots)[i])
+                continue;
+            if (!chain || !layer->writes() || layer->type() == LayerType::OUTPLACE)
+            {
+                run_pending();
+                run_slot(std::index_sequence_for<Layers...>(), i, chunk, registry);
+                continue;
+            }
+            keys[i] = {chain, chunk.x, chunk.y, chunk.lod};
+            if (!restore_channels(cache.get(keys[i]), chunk, layer->writes()))
+                pending[i] = true;
         }
+        run_pending();
     }
 };
 
+using FusedFieldsLayer = FusedNoiseLayer<TerrainGenerationLayer, MoistureGenerationLayer>;
+
+// Every layer that ChunkFactory::from_config() can build, in the order they run
+class BuiltinPipeline
+    : public StaticPipeline<InitializationLayer, DomainWarpLayer, TerrainGenerationLayer,
+                            MoistureGenerationLayer, FusedFieldsLayer, SlopeLayer,
+                            BiomeCreationLayer, CropLayer, QuantizationLayer>
+{
+};
+
+// Moves the layer of type T out of the pipeline, null if the pipeline does not have one
+template <typename T>
+static auto take_layer(std::vector<std::unique_ptr<Layer>> &pipeline) -> std::unique_ptr<T>
+{
+    for (auto &layer : pipeline)
+    {
+        if (auto found = dynamic_cast<T *>(layer.get()))
+        {
+            layer.release();
+            return std::unique_ptr<T>(found);
+        }
+    }
+    return nullptr;
+}
+
+// Drops the layers whose writes are read neither by a later layer nor by the outputs, from the last
+// layer to the first. Layers that write nothing are kept. Returns the channels that the remaining
+// layers read or write
+static auto prune_layers(std::vector<std::unique_ptr<Layer>> &layers, ChannelSet outputs)
+    -> ChannelSet
+{
+    ChannelSet needed = outputs, used = 0;
+    std::vector<std::unique_ptr<Layer>> kept;
+    for (auto it = layers.rbegin(); it != layers.rend(); ++it)
+    {
+        auto writes = (*it)->writes();
+        if (writes && !(writes & needed))
+            continue;
+        needed |= (*it)->reads();
+        used |= (*it)->reads() | writes;
+        kept.push_back(std::move(*it));
+    }
+    layers.assign(std::make_move_iterator(kept.rbegin()), std::make_move_iterator(kept.rend()));
+    return used;
+}
+
+ChunkNeighbors::ChunkNeighbors(int radius, std::vector<const Chunk *> chunks)
+    : radius_(radius), chunks(std::move(chunks))
+{
+}
+
+auto ChunkNeighbors::radius() const -> int { return radius_; }
+
+auto ChunkNeighbors::chunk(int dx, int dy) const -> const Chunk &
+{
+    int side = 2 * radius_ + 1;
+    return *chunks[static_cast<size_t>((dy + radius_) * side + dx + radius_)];
+}
+
+auto ChunkNeighbors::value_at(int id, int x, int y) const -> float
+{
+    const auto &center = chunk(0, 0);
+    // Rounds towards negative infinity, so that pixel -1 is the last pixel of the chunk before
+    auto floor_div = [](int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); };
+    int dx = floor_div(x, center.width), dy = floor_div(y, center.height);
+    const auto &neighbor = chunk(dx, dy);
+    return neighbor.value_at(
+        id, static_cast<int>(neighbor.index(x - dx * center.width, y - dy * center.height)));
+}
+
 auto ChunkFactory::add_layer(std::unique_ptr<Layer> layer) -> void
 {
+    chunk_channels |= layer->reads() | layer->writes();
+    if (builtin)
+        builtin->get<InitializationLayer>()->add_channels(layer->reads() | layer->writes());
     layers.push_back(std::move(layer));
 }
 
-auto ChunkFactory::from_config(const confparse::Config &cfg) -> void
+auto ChunkFactory::add_feature_layer(std::unique_ptr<NeighborLayer> layer) -> void
+{
+    if (layer->reads() & layer->writes())
+        throw std::runtime_error("A feature layer cannot read a channel that it writes");
+    for (const auto &earlier : feature_layers)
+    {
+        if (earlier->reads() & layer->writes())
+            throw std::runtime_error(
+                "A feature layer cannot write a channel read by an earlier feature layer");
+    }
+    chunk_channels |= layer->reads() | layer->writes();
+    if (builtin)
+        builtin->get<InitializationLayer>()->add_channels(layer->reads() | layer->writes());
+    feature_layers.push_back(std::move(layer));
+}
+
+auto ChunkFactory::last_status() const -> int
+{
+    return STATUS_BIOME + static_cast<int>(feature_layers.size());
+}
+
+auto ChunkFactory::stage_radius(int status) const -> int
+{
+    if (status <= STATUS_BIOME || status > last_status())
+        return 0;
+    return feature_layers[static_cast<size_t>(status - STATUS_BIOME - 1)]->radius();
+}
+
+auto ChunkFactory::run_stage(Chunk &chunk, Registry &registry, int status,
+                             const ChunkNeighbors *neighbors) const -> void
+{
+    constexpr auto biome = BuiltinPipeline::slot<BiomeCreationLayer>();
+    if (status == STATUS_NOISE)
+        run_builtin(chunk, registry, 0, biome);
+    else if (status == STATUS_BIOME)
+        run_builtin(chunk, registry, biome, biome + 1);
+    else if (status > STATUS_BIOME && status <= last_status())
+    {
+        if (!neighbors || neighbors->radius() < stage_radius(status))
+            throw std::runtime_error("The stage needs the neighbours of the chunk");
+        feature_layers[static_cast<size_t>(status - STATUS_BIOME - 1)]->execute(chunk, *neighbors,
+                                                                              registry);
+    }
+    else
+        throw std::runtime_error("Unknown chunk status " + std::to_string(status));
+}
+
+auto ChunkFactory::finish(Chunk &chunk, Registry &registry) const -> void
+{
+    constexpr auto biome = BuiltinPipeline::slot<BiomeCreationLayer>();
+    run_builtin(chunk, registry, biome + 1, BuiltinPipeline::size());
+    run_added(chunk, registry);
+}
+
+auto ChunkFactory::invalidated_channels(const confparse::Config &cfg,
+                                        const std::vector<std::string> &keys,
+                                        bool biome_ranges_changed) -> ChannelSet
+{
+    ChannelSet invalidated = 0;
+    for (const auto &key : keys)
+    {
+        // Only change how the chunks are generated, not their values
+        if (key == "noise_cache_megabytes" || key == "layer_cache_megabytes" ||
+            key == "chunk_pool_megabytes" || key == "parallel_layers" ||
+            key == "fuse_noise_layers" || key == "layer_tile_pixels")
+            continue;
+        if (key.rfind("terrain.", 0) == 0)
+            invalidated |= CHANNEL_ELEVATION | CHANNEL_ELEVATION_DX | CHANNEL_ELEVATION_DY;
+        else if (key.rfind("moisture.", 0) == 0)
+            invalidated |= CHANNEL_MOISTURE;
+        else if (key == "lod_skip_octaves")
+            invalidated |= CHANNEL_ELEVATION | CHANNEL_ELEVATION_DX | CHANNEL_ELEVATION_DY |
+                           CHANNEL_MOISTURE;
+        // Turning the warp off leaves the warp channels as they were, the fields then no longer
+        // read them
+        else if (key.rfind("warp.", 0) == 0)
+            invalidated |= CHANNEL_WARP_X | CHANNEL_WARP_Y | CHANNEL_ELEVATION |
+                           CHANNEL_ELEVATION_DX | CHANNEL_ELEVATION_DY | CHANNEL_MOISTURE;
+        else
+            return ALL_CHANNELS;
+    }
+    if (biome_ranges_changed)
+    {
+        invalidated |= CHANNEL_BIOME;
+        // The noise fields are only precise enough for the old ranges
+        if (cfg.get("classification_only").try_parse<bool>(false))
+            invalidated |= CHANNEL_ELEVATION | CHANNEL_MOISTURE;
+    }
+    return invalidated;
+}
+
+auto ChunkFactory::from_config(const confparse::Config &cfg, ChannelSet outputs) -> void
 {
     layers.clear();
+    feature_layers.clear();
+    builtin.reset();
+    chunk_channels = 0;
+    partial_updates = false;
+    // Pixels per band of consecutive pixel layers, see PixelLayer
+    tile_pixels =
+        static_cast<size_t>(std::max(0, cfg.get("layer_tile_pixels").try_parse<int>(0)));
 
     int width = cfg.get("chunk_side_length").parse<int>();
     int height = cfg.get("chunk_side_length").parse<int>();
     int master_seed = cfg.get("seed").parse<int>();
 
-    layers.push_back(std::make_unique<InitializationLayer>(width, height, master_seed));
-    layers.push_back(std::make_unique<TerrainGenerationLayer>(cfg));
-    layers.push_back(std::make_unique<MoistureGenerationLayer>(cfg));
-    layers.push_back(std::make_unique<BiomeCreationLayer>(cfg));
+    // The cache outlives the layers, a reload that only changes how octaves are weighted finds
+    // every octave of the current chunks in it
+    int cache_megabytes = std::max(0, cfg.get("noise_cache_megabytes").try_parse<int>(0));
+    if (!octave_cache)
+        octave_cache = std::make_shared<OctaveCache>(0);
+    octave_cache->set_capacity(static_cast<size_t>(cache_megabytes) * 1024 * 1024);
+    OctaveCache *cache = cache_megabytes > 0 ? octave_cache.get() : nullptr;
+
+    // Layer outputs are keyed by the fingerprints of the layers, so the outputs of earlier configs
+    // stay valid
+    int layer_megabytes = std::max(0, cfg.get("layer_cache_megabytes").try_parse<int>(0));
+    if (!layer_cache)
+        layer_cache = std::make_shared<LayerCache>(0);
+    layer_cache->set_capacity(static_cast<size_t>(layer_megabytes) * 1024 * 1024);
+
+    // Released chunk storage kept for the next chunks, 0 frees every block right away
+    int pool_megabytes = std::max(0, cfg.get("chunk_pool_megabytes").try_parse<int>(64));
+    slab_pool().set_capacity(static_cast<size_t>(pool_megabytes) * 1024 * 1024);
+
+    std::vector<std::unique_ptr<Layer>> pipeline;
+    if (cfg.get("warp.enabled").try_parse<bool>(false))
+        pipeline.push_back(std::make_unique<DomainWarpLayer>(cfg));
+    pipeline.push_back(std::make_unique<TerrainGenerationLayer>(cfg, cache));
+    pipeline.push_back(std::make_unique<MoistureGenerationLayer>(cfg, cache));
+    if (cfg.get("terrain.slope").try_parse<bool>(false))
+    {
+        if (cfg.get("terrain.gradient").try_parse<bool>(false))
+            throw std::runtime_error("Only one of terrain.slope and terrain.gradient can be set");
+        pipeline.push_back(std::make_unique<SlopeLayer>());
+    }
+    pipeline.push_back(std::make_unique<BiomeCreationLayer>(cfg));
+    auto channels = prune_layers(pipeline, outputs);
+
+    // Every layer gets the pixels around the chunk that it reads, the halos add up since a layer
+    // may read the halo written by the layers before it
+    int halo = std::max(0, cfg.get("chunk_halo").try_parse<int>(0));
+    for (const auto &layer : pipeline)
+        halo += layer->halo();
+
+    builtin = std::make_shared<BuiltinPipeline>();
+    builtin->get<InitializationLayer>() =
+        std::make_unique<InitializationLayer>(width, height, master_seed, halo, channels);
+    builtin->get<DomainWarpLayer>() = take_layer<DomainWarpLayer>(pipeline);
+    auto terrain = take_layer<TerrainGenerationLayer>(pipeline);
+    auto moisture = take_layer<MoistureGenerationLayer>(pipeline);
+    // Both noise fields share one pass over the chunk, unless they run at the same time
+    bool parallel = cfg.get("parallel_layers").try_parse<bool>(false);
+    if (terrain && moisture && !parallel && cfg.get("fuse_noise_layers").try_parse<bool>(true))
+        builtin->get<FusedFieldsLayer>() =
+            std::make_unique<FusedFieldsLayer>(std::move(terrain), std::move(moisture));
+    else
+    {
+        builtin->get<TerrainGenerationLayer>() = std::move(terrain);
+        builtin->get<MoistureGenerationLayer>() = std::move(moisture);
+    }
+    builtin->get<SlopeLayer>() = take_layer<SlopeLayer>(pipeline);
+    builtin->get<BiomeCreationLayer>() = take_layer<BiomeCreationLayer>(pipeline);
+    if (halo > 0)
+        builtin->get<CropLayer>() = std::make_unique<CropLayer>();
+
+    auto storage = cfg.get("chunk_storage");
+    if (!storage.is_empty() && storage.as_string() == "quantized")
+        builtin->get<QuantizationLayer>() = std::make_unique<QuantizationLayer>();
+    else if (!storage.is_empty() && storage.as_string() != "float")
+        throw std::runtime_error("Unknown chunk storage: " + storage.as_string());
+
+    // Also checks the channels of the pipeline when the layers run in order
+    auto levels = layer_levels(builtin->all());
+    if (parallel)
+        builtin->set_levels(std::move(levels));
+
+    // A cropped or quantized chunk no longer holds what the layers read
+    chunk_width = width;
+    chunk_height = height;
+    chunk_channels = channels;
+    partial_updates = halo == 0 && !builtin->get<QuantizationLayer>();
 }
 
-auto ChunkFactory::execute(Registry &registry, int chunk_x, int chunk_y) const -> Chunk
+auto ChunkFactory::run_added(Chunk &chunk, Registry &registry) const -> void
 {
-    Chunk chunk;
-    chunk.x = chunk_x;
-    chunk.y = chunk_y;
-    logger::info("Creating chunk [{}, {}]", chunk_x, chunk_y);
-    for (const auto &layer : layers)
+    for (size_t i = 0; i < layers.size();)
     {
-        if (layer->type() == LayerType::INPLACE)
-            static_cast<InPlaceLayer *>(layer.get())->execute(chunk, registry);
+        // Consecutive pixel layers run a band of rows at a time
+        size_t end = i;
+        while (end < layers.size() && dynamic_cast<const PixelLayer *>(layers[end].get()))
+            ++end;
+        if (end > i)
+        {
+            int rows = chunk.area_height(), band = band_rows(chunk, tile_pixels);
+            for (int row = 0; row < rows; row += band)
+            {
+                for (size_t j = i; j < end; ++j)
+                    static_cast<const PixelLayer *>(layers[j].get())
+                        ->execute_rows(chunk, registry, row, std::min(rows, row + band));
+            }
+            i = end;
+        }
+        else if (layers[i]->type() == LayerType::INPLACE)
+            static_cast<InPlaceLayer *>(layers[i++].get())->execute(chunk, registry);
         else
-            chunk = static_cast<OutPlaceLayer *>(layer.get())->execute(chunk, registry);
+            run_out_place(*static_cast<const OutPlaceLayer *>(layers[i++].get()), chunk, registry);
     }
-    return chunk;
 }
 
-auto ChunkFactory::execute_update(Registry &registry, int chunk_x, int chunk_y, Chunk &chunk) const
+auto ChunkFactory::run_builtin(Chunk &chunk, Registry &registry, size_t first, size_t last) const
     -> void
 {
+    if (!builtin)
+        return;
+    if (!layer_cache || layer_cache->capacity() == 0)
+        return builtin->execute_range(chunk, registry, first, last, tile_pixels);
+    std::vector<bool> slots(BuiltinPipeline::size(), false);
+    std::fill(slots.begin() + first, slots.begin() + last, true);
+    builtin->execute_cached(chunk, registry, *layer_cache, &slots);
+}
+
+auto ChunkFactory::check_without_features() const -> void
+{
+    if (!feature_layers.empty())
+        throw std::runtime_error("Chunks with feature layers need their neighbours, generate them "
+                                 "with a ChunkScheduler");
+}
+
+auto ChunkFactory::run_layers(Chunk &chunk, Registry &registry) const -> void
+{
+    check_without_features();
+    if (builtin && layer_cache && layer_cache->capacity() > 0)
+        builtin->execute_cached(chunk, registry, *layer_cache);
+    else if (builtin)
+        builtin->execute(chunk, registry, tile_pixels);
+    run_added(chunk, registry);
+}
+
+auto ChunkFactory::execute(Registry &registry, int chunk_x, int chunk_y, int lod) const -> Chunk
+{
+    if (lod < 0 || lod > MAX_LOD)
+        throw std::runtime_error("Level of detail " + std::to_string(lod) +
+                                 " is not between 0 and " + std::to_string(MAX_LOD));
+    Chunk chunk;
     chunk.x = chunk_x;
     chunk.y = chunk_y;
-    logger::info("Updating chunk [{}, {}]", chunk_x, chunk_y);
+    chunk.lod = lod;
+    if (lod == 0)
+        logger::info("Creating chunk [{}, {}]", chunk_x, chunk_y);
+    else
+        logger::info("Creating chunk [{}, {}] at 1/{} resolution", chunk_x, chunk_y, 1 << lod);
+    run_layers(chunk, registry);
+    return chunk;
+}
+
+auto ChunkFactory::execute_update(Registry &registry, int chunk_x, int chunk_y, Chunk &chunk,
+                                  ChannelSet invalidated) const -> void
+{
+    bool partial = partial_updates && invalidated != ALL_CHANNELS && chunk.x == chunk_x &&
+                   chunk.y == chunk_y && chunk.width == std::max(1, chunk_width >> chunk.lod) &&
+                   chunk.height == std::max(1, chunk_height >> chunk.lod) && chunk.halo == 0 &&
+                   !chunk.is_quantized() &&
+                   (chunk.channels & chunk_channels) == chunk_channels;
+    if (!partial)
+    {
+        chunk.x = chunk_x;
+        chunk.y = chunk_y;
+        logger::info("Updating chunk [{}, {}]", chunk_x, chunk_y);
+        run_layers(chunk, registry);
+        return;
+    }
+
+    check_without_features();
+    // The layers that write an invalidated channel, and the layers that read what they write
+    auto builtin_layers = builtin ? builtin->all() : std::vector<const Layer *>();
+    std::vector<bool> slots(builtin_layers.size(), false);
+    size_t count = 0;
+    for (size_t i = 0; i < builtin_layers.size(); ++i)
+    {
+        const auto *layer = builtin_layers[i];
+        if (layer && ((layer->reads() | layer->writes()) & invalidated))
+        {
+            slots[i] = true;
+            invalidated |= layer->writes();
+            ++count;
+        }
+    }
+    std::vector<const Layer *> added;
     for (const auto &layer : layers)
+    {
+        auto channels = layer->reads() | layer->writes();
+        if (!channels || (channels & invalidated))
+        {
+            added.push_back(layer.get());
+            invalidated |= layer->writes();
+        }
+    }
+    if (count == 0 && added.empty())
+        return;
+
+    logger::info("Updating chunk [{}, {}], {} layers", chunk_x, chunk_y, count + added.size());
+    if (builtin && layer_cache && layer_cache->capacity() > 0)
+        builtin->execute_cached(chunk, registry, *layer_cache, &slots);
+    else if (builtin)
+        builtin->execute_slots(chunk, registry, slots);
+    for (const auto *layer : added)
     {
         if (layer->type() == LayerType::INPLACE)
-            static_cast<InPlaceLayer *>(layer.get())->execute(chunk, registry);
+            static_cast<const InPlaceLayer *>(layer)->execute(chunk, registry);
         else
-            chunk = static_cast<OutPlaceLayer *>(layer.get())->execute(chunk, registry);
+            run_out_place(*static_cast<const OutPlaceLayer *>(layer), chunk, registry);
     }
 }
\ No newline at end of file
@@ -1,10 +1,61 @@
 #ifndef A_CHUNK_H
 #define A_CHUNK_H
+#include "channels.hpp"
 #include "confparse.hpp"
 #include "registries.hpp"
+#include "slab_pool.hpp"
+#include <list>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <stdint.h>
+#include <unordered_map>
 #include <vector>
 
+// One channel of a chunk, one value per pixel of the area of the chunk (see Chunk::halo) in its
+// storage. Empty when the chunk does not have the channel. Moving a view leaves the source empty
+template <typename T> class Channel
+{
+    T *data_;
+    size_t size_;
+
+  public:
+    Channel() : data_(nullptr), size_(0) {}
+
+    Channel(T *data, size_t size) : data_(data), size_(size) {}
+
+    Channel(const Channel &) = delete;
+
+    Channel(Channel &&other) noexcept : data_(other.data_), size_(other.size_)
+    {
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+
+    auto operator=(const Channel &) -> Channel & = delete;
+
+    auto operator=(Channel &&other) noexcept -> Channel &
+    {
+        data_ = other.data_;
+        size_ = other.size_;
+        other.data_ = nullptr;
+        other.size_ = 0;
+        return *this;
+    }
+
+    auto data() const -> T * { return data_; }
+
+    auto size() const -> size_t { return size_; }
+
+    auto empty() const -> bool { return size_ == 0; }
+
+    auto begin() const -> T * { return data_; }
+
+    auto end() const -> T * { return data_ + size_; }
+
+    auto operator[](size_t i) const -> T & { return data_[i]; }
+};
+
 struct Chunk
 {
     int width;
@@ -14,11 +65,119 @@ struct Chunk
     // The top left chunk is (0,0) then (0,1) and so on
     int x;
     int y;
-    std::vector<float> elevation;
-    std::vector<float> moisture;
-    std::vector<int> biome;
+    // Pixels around the chunk stored in every channel while the layers run, so that layers which
+    // read the neighbours of a pixel (see Layer::halo()) also work on the border of the chunk. The
+    // channels then hold the area_width() * area_height() pixels of the chunk and its halo, pixel
+    // (x, y) of the chunk is at index(x, y). The halo is cropped once the layers are done
+    int halo = 0;
+    // Level of detail, the chunk covers the same area as at level 0 with width and height divided
+    // by 2^lod, so every pixel is sampled 2^lod pixels of level 0 apart (see ChunkFactory::execute)
+    int lod = 0;
+    Channel<float> elevation;
+    // Derivatives of the elevation per pixel of the chunk along x and y, empty unless
+    // terrain.gradient is set. At a level of detail they are 2^lod times the derivatives per pixel
+    // of level 0
+    Channel<float> elevation_dx;
+    Channel<float> elevation_dy;
+    Channel<float> moisture;
+    Channel<int> biome;
+    // Position of every pixel after the domain warp, in chunk units (the coordinates of
+    // ChunkCoordinates), shared by the terrain and the moisture. Empty unless warp.enabled is set
+    Channel<float> warp_x;
+    Channel<float> warp_y;
+    // Quantized storage, see quantize(). Elevation and moisture as unsigned normalized 16 bit
+    // values (see UNORM16_MAX), the biome as an index into biome_palette, which holds every
+    // biome id of the chunk. Empty unless chunk_storage is quantized
+    Channel<uint16_t> elevation16;
+    Channel<uint16_t> moisture16;
+    Channel<uint8_t> biome8;
+    std::vector<int> biome_palette;
+    // Channels that the chunk has
+    ChannelSet channels = 0;
+    // Every channel, one after the other, each aligned to SLAB_ALIGNMENT
+    SlabBlock storage;
+
+    Chunk() = default;
+
+    Chunk(const Chunk &other);
+
+    Chunk(Chunk &&other) = default;
+
+    auto operator=(const Chunk &other) -> Chunk &;
+
+    auto operator=(Chunk &&other) -> Chunk & = default;
+
+    // Lays out the given channels in a single block from slab_pool(), for area_width() *
+    // area_height() pixels, every other channel becomes empty. The current block is kept when it
+    // is large enough, the contents of every channel are undefined
+    auto allocate(ChannelSet channels) -> void;
+
+    // Gives the storage back to slab_pool(), every channel becomes empty
+    auto release() -> void;
+
+    // Takes the position, size, halo, seed and palette of other and allocates its channels, as
+    // allocate() does. The values of the channels are undefined
+    auto allocate_like(const Chunk &other) -> void;
+
+    auto area_width() const -> int;
+
+    auto area_height() const -> int;
+
+    // Number of values of every channel, area_width() * area_height()
+    auto pixels() const -> size_t;
+
+    // Index in the channels of pixel (x, y) of the chunk, x and y start at -halo
+    auto index(int x, int y) const -> size_t;
+
+    // Drops the halo of every channel, the channels then hold width * height pixels
+    auto crop() -> void;
+
+    // True after quantize(), elevation, moisture and biome are then empty
+    auto is_quantized() const -> bool;
+
+    // Moves elevation, moisture and biome into the quantized storage and frees them, 5 bytes per
+    // pixel instead of 12. Values are clamped to [0, 1]. Throws std::runtime_error if the chunk
+    // holds more than 256 different biomes
+    auto quantize() -> void;
+
+    // Restores elevation, moisture and biome from the quantized storage and frees it
+    auto dequantize() -> void;
+
+    // Values of a pixel in either storage
+    auto elevation_at(int idx) const -> float;
+
+    auto moisture_at(int idx) const -> float;
+
+    auto biome_at(int idx) const -> int;
+
+    auto has(int id) const -> bool;
+
+    // Id of the channel that holds the values of channel id, id itself or its quantized channel
+    // after quantize() (see ChannelInfo::quantized), -1 if the chunk has neither
+    auto stored(int id) const -> int;
+
+    // Values of any channel (see ChannelRegistry), nullptr if the chunk does not have it
+    auto data(int id) const -> void *;
+
+    // Typed view of any channel, empty if the chunk does not have it. Throws std::runtime_error if
+    // T does not have the size of the type of the channel
+    template <typename T> auto channel(int id) const -> Channel<T>
+    {
+        if (sizeof(T) != channel_type_size(channel_registry().info(id).type))
+            throw std::runtime_error("Wrong type for channel " + channel_registry().info(id).name);
+        if (!has(id))
+            return {};
+        return {static_cast<T *>(data(id)), pixels()};
+    }
+
+    // Value of a pixel of any channel as a float, read from the stored channel (see stored()).
+    // UNORM16 values are mapped to [0, 1], the values of biome8 are palette indices
+    auto value_at(int id, int idx) const -> float;
 };
 
+// Coarsest level of detail of a chunk, 1/256 of the resolution along x and y
+#define MAX_LOD 8
+
 enum class LayerType
 {
     INPLACE,
@@ -30,6 +189,22 @@ class Layer
   public:
     virtual auto type() const -> LayerType = 0;
 
+    // Channels that the layer reads and writes, ChunkFactory::from_config() allocates them and
+    // leaves out the layers whose writes are never read
+    virtual auto reads() const -> ChannelSet { return 0; }
+
+    virtual auto writes() const -> ChannelSet { return 0; }
+
+    // Pixels on every side of a pixel that the layer reads, the chunks then keep at least that many
+    // pixels around them while the layers run (see Chunk::halo)
+    virtual auto halo() const -> int { return 0; }
+
+    // Hash of the parameters of the layer (see Fingerprint), such that two layers with the same
+    // fingerprint write the same values given the same reads and chunk position. 0 when the output
+    // of the layer also depends on something else, the layer then always runs, and so do the
+    // layers after it (see LayerCache)
+    virtual auto fingerprint(const Registry &registry) const -> uint64_t { return 0; }
+
     virtual ~Layer() {}
 };
 
@@ -43,27 +218,240 @@ class InPlaceLayer : public Layer
     virtual ~InPlaceLayer() {}
 };
 
+// A layer that computes every row of the chunk (and its halo) from the same row of the channels it
+// reads. ChunkFactory runs consecutive pixel layers a band of rows at a time, so that the channels
+// of a band stay in cache from one layer to the next (see layer_tile_pixels in the config)
+class PixelLayer : public InPlaceLayer
+{
+  public:
+    // Runs the layer on rows row_begin to row_end - 1 of the chunk, counted from the top row of the
+    // halo. The bands of a chunk are run in order, starting at row 0
+    virtual auto execute_rows(Chunk &chunk, Registry &registry, int row_begin, int row_end) const
+        -> void = 0;
+
+    auto execute(Chunk &chunk, Registry &registry) const -> void
+    {
+        execute_rows(chunk, registry, 0, chunk.area_height());
+    }
+
+    virtual ~PixelLayer() {}
+};
+
+// A layer that reads one chunk and writes another, such as a blur or a zoom. ChunkFactory takes a
+// pooled scratch chunk for the output of every call and swaps it with the input afterwards, so the
+// storage of the input becomes the output of the next out-place layer and a pipeline in steady
+// state does not allocate. execute() may split its work across task_pool()
 class OutPlaceLayer : public Layer
 {
   public:
-    virtual auto execute(const Chunk &chunk, Registry &registry) const -> Chunk = 0;
+    // Writes the result into output, which holds the storage of an earlier chunk with undefined
+    // contents. The layer sets every field of output, with Chunk::allocate_like() or
+    // Chunk::allocate(), which reuse that storage when it is large enough
+    virtual auto execute(const Chunk &chunk, Chunk &output, Registry &registry) const -> void = 0;
 
     auto type() const -> LayerType { return LayerType::OUTPLACE; }
 
     virtual ~OutPlaceLayer() {}
 };
 
+// Generation stages of a chunk, a chunk at a status has run the layers of every stage up to it.
+// STATUS_BIOME + i means the first i feature layers ran as well (see NeighborLayer), the last
+// status of a pipeline is ChunkFactory::last_status(). ChunkFactory::finish() then crops,
+// quantizes and runs the layers added with add_layer()
+enum ChunkStatus : int
+{
+    STATUS_EMPTY = 0,
+    // Warp, elevation, moisture and slope of the built-in layers
+    STATUS_NOISE = 1,
+    STATUS_BIOME = 2
+};
+
+// The chunks around a chunk, up to radius() chunks away along x and y, as a NeighborLayer sees
+// them
+class ChunkNeighbors
+{
+    int radius_;
+    // (2 radius + 1)^2 chunks, row by row
+    std::vector<const Chunk *> chunks;
+
+  public:
+    ChunkNeighbors(int radius, std::vector<const Chunk *> chunks);
+
+    auto radius() const -> int;
+
+    // Chunk dx, dy chunks away from the center chunk, |dx| and |dy| at most radius()
+    auto chunk(int dx, int dy) const -> const Chunk &;
+
+    // Value of any channel (see Chunk::value_at()) at pixel (x, y) counted from the top left pixel
+    // of the center chunk, in any of the chunks
+    auto value_at(int id, int x, int y) const -> float;
+};
+
+// A layer that also reads the chunks around its chunk, such as rivers, erosion or structures. Each
+// feature layer runs in a stage of its own, once every chunk within radius() chunks has run the
+// stages before it (see ChunkScheduler). Other chunks may run the same stage at the same time, so
+// a feature layer only reads the channels of earlier stages from its neighbours, and never a
+// channel that it or a later feature layer writes. The result then does not depend on the order
+// the chunks are generated in
+class NeighborLayer : public Layer
+{
+  public:
+    // Neighbours needed along x and y, in chunks
+    virtual auto radius() const -> int = 0;
+
+    virtual auto execute(Chunk &chunk, const ChunkNeighbors &neighbors, Registry &registry) const
+        -> void = 0;
+
+    auto type() const -> LayerType { return LayerType::INPLACE; }
+
+    virtual ~NeighborLayer() {}
+};
+
+// Identifies the output of one layer of a pipeline over one chunk. The chain combines the
+// fingerprints of the layer and of every layer before it, so it also stands for the inputs of the
+// layer
+struct LayerKey
+{
+    uint64_t chain;
+    int x, y;
+    // See Chunk::lod
+    int lod;
+
+    auto operator==(const LayerKey &other) const -> bool;
+};
+
+struct LayerKeyHash
+{
+    auto operator()(const LayerKey &key) const -> size_t;
+};
+
+// Keeps the channels written by the layers of recently generated chunks, so that switching back to
+// an earlier config (or biome table) copies the outputs of every layer whose fingerprint chain is
+// unchanged instead of running it again. The least recently used outputs are dropped once the
+// cache holds more than its capacity. Safe to use from several threads
+class LayerCache
+{
+  public:
+    struct Output
+    {
+        ChannelSet channels;
+        // The values of every channel in id order, each pixels * the size of its type
+        std::vector<unsigned char> bytes;
+    };
+    using Tile = std::shared_ptr<const Output>;
+
+  private:
+    using Entry = std::pair<LayerKey, Tile>;
+
+    std::list<Entry> entries;
+    std::unordered_map<LayerKey, std::list<Entry>::iterator, LayerKeyHash> index;
+    size_t capacity_bytes;
+    size_t size_bytes;
+    mutable std::mutex mutex;
+
+    auto evict() -> void;
+
+  public:
+    LayerCache(size_t capacity_bytes);
+
+    // Output stored for key, nullptr if there is none
+    auto get(const LayerKey &key) -> Tile;
+
+    auto put(const LayerKey &key, Tile tile) -> void;
+
+    auto set_capacity(size_t capacity_bytes) -> void;
+
+    auto capacity() const -> size_t;
+
+    auto clear() -> void;
+
+    auto size() const -> size_t;
+};
+
+class OctaveCache;
+class BuiltinPipeline;
+
 class ChunkFactory
 {
+    // The layers of the config, with their types known at compile time (see StaticPipeline)
+    std::shared_ptr<BuiltinPipeline> builtin;
+    // Layers added with add_layer(), run after the built-in ones
     std::vector<std::unique_ptr<Layer>> layers;
+    // Layers added with add_feature_layer(), stage STATUS_BIOME + 1 + i runs layer i
+    std::vector<std::unique_ptr<NeighborLayer>> feature_layers;
+    // Pixels per band of rows when running consecutive pixel layers, 0 runs every layer over the
+    // whole chunk
+    size_t tile_pixels = 0;
+    // Size and channels of the chunks of the pipeline, see execute_update()
+    int chunk_width = 0, chunk_height = 0;
+    ChannelSet chunk_channels = 0;
+    // Whether a chunk holds what its layers read once generated, so that a part of the layers can
+    // run again on it
+    bool partial_updates = false;
+    // Raw noise octaves of recently generated chunks, kept across config reloads
+    std::shared_ptr<OctaveCache> octave_cache;
+    // Outputs of the built-in layers of recently generated chunks, kept across config reloads.
+    // Not used when its capacity is 0
+    std::shared_ptr<LayerCache> layer_cache;
+
+    // Runs the layers added with add_layer()
+    auto run_added(Chunk &chunk, Registry &registry) const -> void;
+
+    // Runs the built-in layers of slots first to last - 1 of the pipeline, in order
+    auto run_builtin(Chunk &chunk, Registry &registry, size_t first, size_t last) const -> void;
+
+    // Throws std::runtime_error if the pipeline has feature layers, which need a ChunkScheduler
+    auto check_without_features() const -> void;
 
   public:
-    auto from_config(const confparse::Config &cfg) -> void;
+    // Builds the pipeline of the config. Only the layers needed for the outputs are kept, and
+    // chunks only store the channels that those layers read or write
+    auto from_config(const confparse::Config &cfg, ChannelSet outputs = ALL_CHANNELS) -> void;
 
+    // Appends a layer to the pipeline, the chunks then also store the channels of the layer
     auto add_layer(std::unique_ptr<Layer> layer) -> void;
 
-    auto execute(Registry &registry, int chunk_x, int chunk_y) const -> Chunk;
+    // Appends a feature layer, run in a stage of its own after the biomes. Throws
+    // std::runtime_error if the layer reads a channel that it writes, or writes a channel read by
+    // an earlier feature layer. Chunks of a pipeline with feature layers can only be generated by
+    // a ChunkScheduler
+    auto add_feature_layer(std::unique_ptr<NeighborLayer> layer) -> void;
+
+    // Status of a chunk that ran every stage, STATUS_BIOME plus the number of feature layers
+    auto last_status() const -> int;
+
+    // Neighbours along x and y, in chunks, that must have reached status - 1 before a chunk can
+    // run the stage of the status
+    auto stage_radius(int status) const -> int;
+
+    // Runs the stage of the status on a chunk at status - 1, with chunk.x and chunk.y set.
+    // neighbors are the chunks around it within stage_radius(status), at status - 1 or later
+    auto run_stage(Chunk &chunk, Registry &registry, int status,
+                   const ChunkNeighbors *neighbors = nullptr) const -> void;
+
+    // Brings a chunk at last_status() to the end of the pipeline, see ChunkStatus
+    auto finish(Chunk &chunk, Registry &registry) const -> void;
+
+    // Generates the chunk at a level of detail (see Chunk::lod), from 0 to MAX_LOD. With
+    // lod_skip_octaves in the config, the noise fields also leave out the octaves that are too
+    // fine for the level (see NoiseMap::lod())
+    auto execute(Registry &registry, int chunk_x, int chunk_y, int lod = 0) const -> Chunk;
+
+    // Runs every layer on the chunk at chunk.x, chunk.y, as execute_update() does without logging
+    auto run_layers(Chunk &chunk, Registry &registry) const -> void;
+
+    // Generates the chunk again in place, reusing its storage. Only the layers that write one of
+    // the invalidated channels run again, with the layers that read their output, when the chunk
+    // already holds everything else (same position, size and channels, without a halo or
+    // quantization). Does nothing when no layer is affected
+    auto execute_update(Registry &registry, int chunk_x, int chunk_y, Chunk &chunk,
+                        ChannelSet invalidated = ALL_CHANNELS) const -> void;
 
-    auto execute_update(Registry &registry, int chunk_x, int chunk_y, Chunk &chunk) const -> void;
+    // Channels of the chunks whose values change when the given config keys change, or when the
+    // ranges of the biomes change. ALL_CHANNELS for keys that affect the whole pipeline. Keys that
+    // the pipeline does not read (the window, the renderer) must not be passed
+    static auto invalidated_channels(const confparse::Config &cfg,
+                                     const std::vector<std::string> &keys,
+                                     bool biome_ranges_changed) -> ChannelSet;
 };
 #endif // A_CHUNK_H
\ No newline at end of file
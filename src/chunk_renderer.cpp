@@ -1,5 +1,8 @@
 #include "chunk_renderer.hpp"
+#include "kernels.hpp"
 #include "logger.h"
+#include <algorithm>
+#include <cmath>
 using namespace logger;
 
 ChunkTexture2D::ChunkTexture2D() : width(0), height(0), pixels(nullptr), texture{} {}
@@ -22,17 +25,7 @@ auto ChunkRenderer2D::generate_texture(const Chunk &chunk) const -> ChunkTexture
     texture.height = chunk.height;
     texture.pixels = static_cast<Color *>(malloc(texture.width * texture.height * sizeof(Color)));
 
-    int idx = 0;
-
-    // Look at the elevation details and fill the color accordingly
-    for (int y = 0; y < texture.height; ++y)
-    {
-        for (int x = 0; x < texture.width; ++x)
-        {
-            texture.pixels[y * texture.width + x] = get_color(chunk, idx);
-            idx++;
-        }
-    }
+    colorize(chunk, texture.pixels);
 
     // Create an image, load a texture from that image and return the texture
     Image img = {};
@@ -55,32 +48,114 @@ auto ChunkRenderer2D::update_texture(ChunkTexture2D &texture, const Chunk &chunk
         return;
     }
 
-    // TODO: DRY, refactor code
-    int idx = 0;
+    colorize(chunk, texture.pixels);
+    UpdateTexture(texture.texture, texture.pixels);
+}
+
+// Type of the channel that holds the values of a channel in the chunk, see Chunk::stored()
+static auto stored_type(const Chunk &chunk, int id) -> ChannelType
+{
+    auto stored = chunk.stored(id);
+    // Never drawn with a kernel
+    if (stored == -1)
+        return ChannelType::INT32;
+    return channel_registry().info(stored).type;
+}
 
-    // Look at the elevation details and fill the color accordingly
-    for (int y = 0; y < texture.height; ++y)
+auto ChunkRenderer2D::colorize(const Chunk &chunk, Color *pixels) const -> void
+{
+    auto rgba = reinterpret_cast<unsigned char *>(pixels);
+    auto n = static_cast<size_t>(chunk.width * chunk.height);
+
+    if (current_render_mode == RenderMode::BIOME_MAP)
     {
-        for (int x = 0; x < texture.width; ++x)
+        // Same colors as get_color(), palette[0] is used for pixels without a biome
+        const auto &biomes = registry->biome_registry;
+        std::vector<uint32_t> palette(biomes.size() + 1);
+        palette[0] = 0xFF000000u;
+        for (size_t i = 0; i < biomes.size(); ++i)
+        {
+            auto color = biomes.get(static_cast<int>(i)).render_color;
+            auto alpha = static_cast<unsigned char>(color.a * 255);
+            palette[i + 1] = static_cast<uint32_t>(color.r) |
+                             (static_cast<uint32_t>(color.g) << 8) |
+                             (static_cast<uint32_t>(color.b) << 16) |
+                             (static_cast<uint32_t>(alpha) << 24);
+        }
+        if (!chunk.biome8.empty())
         {
-            texture.pixels[y * texture.width + x] = get_color(chunk, idx);
-            idx++;
+            // Colors of the biome palette of the chunk
+            std::vector<uint32_t> chunk_palette(chunk.biome_palette.size());
+            for (size_t i = 0; i < chunk_palette.size(); ++i)
+                chunk_palette[i] = palette[chunk.biome_palette[i] + 1];
+            kernels().palette8_to_rgba(chunk.biome8.data(), chunk_palette.data(), rgba, n);
         }
+        else
+            kernels().palette_to_rgba(chunk.biome.data(), palette.data(), rgba, n);
     }
-    UpdateTexture(texture.texture, texture.pixels);
+    else if (current_render_mode == RenderMode::HEIGHTMAP &&
+             stored_type(chunk, heightmap_channel) == ChannelType::FLOAT32)
+    {
+        auto values = chunk.channel<float>(chunk.stored(heightmap_channel));
+        kernels().heightmap_to_rgba(values.data(), rgba, n);
+    }
+    else if (current_render_mode == RenderMode::HEIGHTMAP &&
+             stored_type(chunk, heightmap_channel) == ChannelType::UNORM16)
+    {
+        auto values = chunk.channel<uint16_t>(chunk.stored(heightmap_channel));
+        kernels().heightmap16_to_rgba(values.data(), rgba, n);
+    }
+    else
+    {
+        // Hillshade, and heightmaps of integer channels or of channels that the chunk lacks
+        for (size_t i = 0; i < n; ++i)
+        {
+            auto color = get_color(chunk, static_cast<int>(i));
+            rgba[4 * i] = color.r;
+            rgba[4 * i + 1] = color.g;
+            rgba[4 * i + 2] = color.b;
+            rgba[4 * i + 3] = color.a;
+        }
+    }
+}
+
+auto ChunkRenderer2D::hillshade(const Chunk &chunk, int idx) const -> float
+{
+    // Chunks generated without terrain.gradient are drawn as flat ground
+    if (chunk.elevation_dx.empty())
+        return 2.0f / 3.0f;
+
+    // The normal is (-dx, -dy, 1) scaled by the exaggeration, the light comes from (-1, -1, 1). The
+    // derivatives are brought back to pixels of level 0, so a level of detail keeps the relief
+    float exaggeration = hillshade_exaggeration / static_cast<float>(1 << chunk.lod);
+    float dx = chunk.elevation_dx[idx] * exaggeration;
+    float dy = chunk.elevation_dy[idx] * exaggeration;
+    float lit = (dx + dy + 1.0f) / std::sqrt(dx * dx + dy * dy + 1.0f);
+    return std::clamp(lit, 0.0f, 1.5f) / 1.5f;
 }
 
 auto ChunkRenderer2D::from_config(const confparse::Config &cfg, Registry *registry) -> void
 {
     auto render_type = cfg.get("render_type").as_string();
     this->registry = registry;
-    if (render_type == "elevation_heightmap")
+    // <channel>_heightmap draws any channel, such as elevation_heightmap or moisture_heightmap
+    const std::string suffix = "_heightmap";
+    auto name_size = render_type.size() - std::min(render_type.size(), suffix.size());
+    auto channel = -1;
+    if (name_size > 0 && render_type.compare(name_size, suffix.size(), suffix) == 0)
+        channel = channel_registry().find(render_type.substr(0, name_size));
+    if (channel != -1)
     {
-        current_render_mode = RenderMode::ELEVATION_HEIGHTMAP;
+        current_render_mode = RenderMode::HEIGHTMAP;
+        heightmap_channel = channel;
     }
-    else if (render_type == "moisture_heightmap")
+    else if (render_type == "elevation_hillshade")
     {
-        current_render_mode = RenderMode::MOISTURE_HEIGHTMAP;
+        current_render_mode = RenderMode::ELEVATION_HILLSHADE;
+        if (!cfg.get("terrain.gradient").try_parse<bool>(false) &&
+            !cfg.get("terrain.slope").try_parse<bool>(false))
+            warn("elevation_hillshade needs terrain.gradient or terrain.slope, the terrain is "
+                 "drawn flat");
     }
     else if (render_type == "biome_map")
     {
@@ -90,27 +165,48 @@ auto ChunkRenderer2D::from_config(const confparse::Config &cfg, Registry *regist
     {
         throw std::runtime_error("Unknown render type: " + render_type);
     }
+    hillshade_exaggeration = cfg.get("hillshade_exaggeration").try_parse<float>(64.0f);
+}
+
+auto ChunkRenderer2D::is_render_key(const std::string &key) -> bool
+{
+    return key == "render_type" || key == "hillshade_exaggeration";
+}
+
+auto ChunkRenderer2D::channels() const -> ChannelSet
+{
+    if (current_render_mode == RenderMode::BIOME_MAP)
+        return CHANNEL_BIOME;
+    else if (current_render_mode == RenderMode::HEIGHTMAP)
+        return channel_bit(heightmap_channel);
+    return CHANNEL_ELEVATION | CHANNEL_ELEVATION_DX | CHANNEL_ELEVATION_DY;
 }
 
 auto ChunkRenderer2D::get_color(const Chunk &chunk, int idx) const -> Color
 {
     if (current_render_mode == RenderMode::BIOME_MAP)
     {
-        int biome = chunk.biome[idx];
+        int biome = chunk.biome_at(idx);
         // TODO: Return a default color
         if (biome == -1)
             return {0, 0, 0, 255};
         auto color = registry->biome_registry.get(biome).render_color;
         return {color.r, color.g, color.b, static_cast<unsigned char>(color.a * 255)};
     }
-    else if (current_render_mode == RenderMode::ELEVATION_HEIGHTMAP)
+    else if (current_render_mode == RenderMode::HEIGHTMAP)
     {
-        unsigned char value = static_cast<unsigned char>(chunk.elevation[idx] * 255);
+        if (chunk.stored(heightmap_channel) == -1)
+            return {0, 0, 0, 255};
+        // Integer channels such as the biome ids are not normalized, a float outside of the range
+        // of unsigned char cannot be converted to it
+        float height = std::clamp(chunk.value_at(heightmap_channel, idx), 0.0f, 1.0f);
+        unsigned char value = static_cast<unsigned char>(height * 255);
         return {value, value, value, 255};
     }
-    else if (current_render_mode == RenderMode::MOISTURE_HEIGHTMAP)
+    else if (current_render_mode == RenderMode::ELEVATION_HILLSHADE)
     {
-        unsigned char value = static_cast<unsigned char>(chunk.moisture[idx] * 255);
+        float shade = std::clamp(chunk.elevation_at(idx), 0.0f, 1.0f) * hillshade(chunk, idx);
+        unsigned char value = static_cast<unsigned char>(shade * 255);
         return {value, value, value, 255};
     }
     return {0, 0, 0, 255};
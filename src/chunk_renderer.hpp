@@ -21,12 +21,23 @@ class ChunkRenderer2D
 {
     enum class RenderMode
     {
-        ELEVATION_HEIGHTMAP,
-        MOISTURE_HEIGHTMAP,
+        // Grayscale image of heightmap_channel
+        HEIGHTMAP,
+        ELEVATION_HILLSHADE,
         BIOME_MAP
     };
     RenderMode current_render_mode;
+    // Channel drawn by HEIGHTMAP, see ChannelRegistry
+    int heightmap_channel;
     Registry *registry;
+    // Vertical exaggeration of the terrain for ELEVATION_HILLSHADE
+    float hillshade_exaggeration;
+
+    // Brightness in [0, 1] of a pixel lit from the top left, 2/3 on flat ground
+    auto hillshade(const Chunk &chunk, int idx) const -> float;
+
+    // Fills width * height pixels of the chunk, using the batch kernels
+    auto colorize(const Chunk &chunk, Color *pixels) const -> void;
 
   public:
     auto generate_texture(const Chunk &chunk) const -> ChunkTexture2D;
@@ -35,6 +46,12 @@ class ChunkRenderer2D
 
     auto from_config(const confparse::Config &cfg, Registry *registry) -> void;
 
+    // Whether the key is read by from_config(), a change to it only needs new textures
+    static auto is_render_key(const std::string &key) -> bool;
+
+    // Channels that the renderer reads, the outputs of the chunk pipeline
+    auto channels() const -> ChannelSet;
+
     auto get_color(const Chunk &chunk, int idx) const -> Color;
 };
 
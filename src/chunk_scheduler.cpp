@@ -0,0 +1,165 @@
+#include "chunk_scheduler.hpp"
+#include "logger.h"
+#include "task_pool.hpp"
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+ChunkScheduler::ChunkScheduler(const ChunkFactory &factory, Registry &registry, int lod)
+    : factory(factory), registry(registry), lod(0)
+{
+    set_lod(lod);
+}
+
+auto ChunkScheduler::set_lod(int level) -> void
+{
+    if (level < 0 || level > MAX_LOD)
+        throw std::runtime_error("Level of detail " + std::to_string(level) +
+                                 " is not between 0 and " + std::to_string(MAX_LOD));
+    std::lock_guard<std::mutex> lock(mutex);
+    // Chunks of different levels have different sizes, and the stages read their neighbours pixel
+    // by pixel
+    if (level != lod)
+        entries.clear();
+    lod = level;
+}
+
+auto ChunkScheduler::get_lod() const -> int
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return lod;
+}
+
+auto ChunkScheduler::required_statuses(const std::vector<std::pair<int, int>> &positions,
+                                       int status) const -> std::map<std::pair<int, int>, int>
+{
+    std::map<std::pair<int, int>, int> required;
+    for (const auto &position : positions)
+        required[position] = status;
+    // A chunk that needs status s needs its neighbours at s - 1, which may in turn need their own
+    // neighbours at s - 2, so the statuses are spread from the last stage to the first
+    for (int s = status; s > STATUS_EMPTY; --s)
+    {
+        int radius = factory.stage_radius(s);
+        if (radius == 0)
+            continue;
+        std::vector<std::pair<int, int>> centers;
+        for (const auto &[position, needed] : required)
+        {
+            if (needed >= s)
+                centers.push_back(position);
+        }
+        for (const auto &[x, y] : centers)
+        {
+            for (int dy = -radius; dy <= radius; ++dy)
+            {
+                for (int dx = -radius; dx <= radius; ++dx)
+                {
+                    auto &needed = required[{x + dx, y + dy}];
+                    needed = std::max(needed, s - 1);
+                }
+            }
+        }
+    }
+    return required;
+}
+
+auto ChunkScheduler::neighbors(int x, int y, int radius) const -> ChunkNeighbors
+{
+    std::vector<const Chunk *> chunks;
+    for (int dy = -radius; dy <= radius; ++dy)
+    {
+        for (int dx = -radius; dx <= radius; ++dx)
+            chunks.push_back(&entries.at({x + dx, y + dy}).chunk);
+    }
+    return ChunkNeighbors(radius, std::move(chunks));
+}
+
+auto ChunkScheduler::generate(const std::vector<std::pair<int, int>> &positions, int status)
+    -> void
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    status = std::min(status, factory.last_status());
+    auto required = required_statuses(positions, status);
+    std::vector<std::pair<Entry *, int>> pending;
+    for (const auto &[position, needed] : required)
+    {
+        auto &entry = entries[position];
+        if (entry.status >= needed)
+            continue;
+        if (entry.status == STATUS_EMPTY)
+        {
+            entry.chunk.x = position.first;
+            entry.chunk.y = position.second;
+            entry.chunk.lod = lod;
+        }
+        pending.push_back({&entry, needed});
+    }
+    if (pending.empty())
+        return;
+    logger::info("Generating {} chunks", pending.size());
+
+    // Every chunk reaches a stage before any chunk starts the next one, the neighbours that a stage
+    // reads are then done with the stages before
+    std::vector<std::function<void()>> tasks;
+    for (int s = STATUS_NOISE; s <= status; ++s)
+    {
+        int radius = factory.stage_radius(s);
+        tasks.clear();
+        for (auto &[entry, needed] : pending)
+        {
+            if (needed < s || entry->status >= s)
+                continue;
+            tasks.push_back([this, entry = entry, s, radius]() {
+                if (radius == 0)
+                    factory.run_stage(entry->chunk, registry, s);
+                else
+                {
+                    auto around = neighbors(entry->chunk.x, entry->chunk.y, radius);
+                    factory.run_stage(entry->chunk, registry, s, &around);
+                }
+            });
+        }
+        task_pool().run(tasks);
+        for (auto &[entry, needed] : pending)
+        {
+            if (needed >= s && entry->status < s)
+                entry->status = s;
+        }
+    }
+}
+
+auto ChunkScheduler::status(int x, int y) const -> int
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find({x, y});
+    return it == entries.end() ? STATUS_EMPTY : it->second.status;
+}
+
+auto ChunkScheduler::finish(int x, int y) -> Chunk
+{
+    Chunk chunk;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find({x, y});
+        if (it == entries.end() || it->second.status < factory.last_status())
+            throw std::runtime_error("Chunk [" + std::to_string(x) + ", " + std::to_string(y) +
+                                     "] was not generated");
+        chunk = std::move(it->second.chunk);
+        entries.erase(it);
+    }
+    factory.finish(chunk, registry);
+    return chunk;
+}
+
+auto ChunkScheduler::clear() -> void
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+}
+
+auto ChunkScheduler::size() const -> size_t
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
@@ -0,0 +1,69 @@
+#ifndef A_CHUNK_SCHEDULER_H
+#define A_CHUNK_SCHEDULER_H
+
+#include "chunk.hpp"
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Brings chunks of a ChunkFactory to a status (see ChunkStatus), together with the chunks around
+// them that their stages read. A chunk only runs the stage of status s once every chunk within
+// ChunkFactory::stage_radius(s) has reached s - 1. The chunks advance one stage at a time, the
+// chunks of a stage in parallel on task_pool(). Chunks that already reached a status are kept until
+// finish() or clear() and never run a stage again, and since every stage only reads earlier stages
+// of the neighbours, a chunk is the same whatever the order and grouping of the requests. Safe to
+// use from several threads, calls to generate() run one at a time
+class ChunkScheduler
+{
+    struct Entry
+    {
+        Chunk chunk;
+        int status = STATUS_EMPTY;
+    };
+
+    const ChunkFactory &factory;
+    Registry &registry;
+    // Ordered, so that the chunks are always visited in the same order, and entries stay in place
+    // while others are added
+    std::map<std::pair<int, int>, Entry> entries;
+    // Level of detail of every chunk, see Chunk::lod
+    int lod;
+    mutable std::mutex mutex;
+
+    // Status that every chunk of entries needs for the requested ones, see generate()
+    auto required_statuses(const std::vector<std::pair<int, int>> &positions, int status) const
+        -> std::map<std::pair<int, int>, int>;
+
+    auto neighbors(int x, int y, int radius) const -> ChunkNeighbors;
+
+  public:
+    // The factory and the registry must outlive the scheduler, clear() must be called when the
+    // factory changes
+    ChunkScheduler(const ChunkFactory &factory, Registry &registry, int lod = 0);
+
+    // Level of detail of the chunks generated from now on, drops every chunk if it changes.
+    // Throws std::runtime_error if it is not between 0 and MAX_LOD
+    auto set_lod(int level) -> void;
+
+    auto get_lod() const -> int;
+
+    // Brings the chunks at the given positions to the status, at most the last status of the
+    // factory, returns once they have reached it
+    auto generate(const std::vector<std::pair<int, int>> &positions, int status) -> void;
+
+    // Status of the chunk, STATUS_EMPTY if it was never generated
+    auto status(int x, int y) const -> int;
+
+    // Takes a chunk at the last status of the factory out of the scheduler and brings it to the end
+    // of the pipeline (see ChunkFactory::finish()). A later request that needs the chunk generates
+    // it again. Throws std::runtime_error if the chunk did not reach that status
+    auto finish(int x, int y) -> Chunk;
+
+    // Drops every chunk
+    auto clear() -> void;
+
+    auto size() const -> size_t;
+};
+
+#endif // A_CHUNK_SCHEDULER_H
@@ -0,0 +1,69 @@
+#include "cpu_features.hpp"
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CPU_FEATURES_X86 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#ifdef CPU_FEATURES_X86
+static auto cpuid(unsigned leaf, unsigned subleaf, unsigned regs[4]) -> void
+{
+#ifdef _MSC_VER
+    __cpuidex(reinterpret_cast<int *>(regs), static_cast<int>(leaf), static_cast<int>(subleaf));
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Register state the OS saves on a context switch, the AVX registers are unusable without it
+static auto xgetbv() -> uint64_t
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+static auto detect() -> CpuFeatures
+{
+    CpuFeatures features{};
+    unsigned regs[4];
+
+    cpuid(0, 0, regs);
+    unsigned max_leaf = regs[0];
+
+    cpuid(1, 0, regs);
+    features.sse2 = (regs[3] >> 26) & 1;
+    bool osxsave = (regs[2] >> 27) & 1;
+    bool avx = (regs[2] >> 28) & 1;
+    if (!osxsave || !avx || max_leaf < 7)
+        return features;
+
+    uint64_t xcr0 = xgetbv();
+    // XMM and YMM state
+    bool os_avx = (xcr0 & 0x6) == 0x6;
+    // XMM, YMM, opmask and ZMM state
+    bool os_avx512 = (xcr0 & 0xE6) == 0xE6;
+
+    cpuid(7, 0, regs);
+    features.avx2 = os_avx && ((regs[1] >> 5) & 1);
+    features.avx512 = os_avx512 && ((regs[1] >> 16) & 1) && ((regs[1] >> 17) & 1);
+    return features;
+}
+#else
+static auto detect() -> CpuFeatures { return CpuFeatures{}; }
+#endif
+
+auto cpu_features() -> const CpuFeatures &
+{
+    static const CpuFeatures features = detect();
+    return features;
+}
@@ -0,0 +1,16 @@
+#ifndef A_CPU_FEATURES_H
+#define A_CPU_FEATURES_H
+
+// Instruction set extensions that are both supported by the CPU and enabled by the OS
+struct CpuFeatures
+{
+    bool sse2;
+    bool avx2;
+    // AVX-512 foundation and doubleword/quadword instructions
+    bool avx512;
+};
+
+// Queries cpuid the first time it is called, later calls return the cached result
+auto cpu_features() -> const CpuFeatures &;
+
+#endif // A_CPU_FEATURES_H
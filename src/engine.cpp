@@ -2,15 +2,46 @@
 
 using namespace logger;
 
+auto Engine::diff_keys(confparse::Config old_cfg, confparse::Config new_cfg)
+    -> std::vector<std::string>
+{
+    std::vector<std::string> keys;
+    for (const auto &[key, value] : new_cfg)
+    {
+        if (!(old_cfg.get(key) == value))
+            keys.push_back(key);
+    }
+    for (const auto &entry : old_cfg)
+    {
+        if (new_cfg.get(entry.first).is_empty())
+            keys.push_back(entry.first);
+    }
+    return keys;
+}
+
+auto Engine::is_window_key(const std::string &key) -> bool
+{
+    return key == "title" || key == "fps" || key == "width" || key == "height" ||
+           key == "fullscreen" || key == "reload_interval";
+}
+
 auto Engine::load_config() -> void
 {
+    // biomes.txt is reloaded when it was written since the last load
+    std::error_code error;
+    auto write_time = std::filesystem::last_write_time(data_folder_path / "biomes.txt", error);
+    if (!error && write_time != biomes_write_time)
+    {
+        biomes_write_time = write_time;
+        biomes_changed = true;
+    }
+
     std::string config_path = (data_folder_path / "config.txt").generic_string();
     auto new_cfg = parser.from_file(config_path);
     if (cfg == new_cfg)
-    {
-        config_changed = false;
         return;
-    }
+    auto keys = diff_keys(cfg, new_cfg);
+    changed_keys.insert(changed_keys.end(), keys.begin(), keys.end());
     cfg = new_cfg;
     width = cfg.get("width").parse<int>();
     height = cfg.get("height").parse<int>();
@@ -19,6 +50,7 @@ auto Engine::load_config() -> void
     fullscreen = cfg.get("fullscreen").try_parse<bool>(false);
     reload_interval = cfg.get("reload_interval").try_parse<int>(1);
     chunk_side_length = cfg.get("chunk_side_length").parse<int>();
+    lod = cfg.get("chunk_lod").try_parse<int>(0);
 
     number_of_chunks_horizontal =
         static_cast<int>(std::ceil(static_cast<float>(width) / chunk_side_length));
@@ -30,35 +62,86 @@ auto Engine::load_config() -> void
 
 auto Engine::apply_config(bool is_update) -> void
 {
-    if (!config_changed)
+    if (!config_changed && !biomes_changed)
         return;
     info("Applying new config since configuration changed...");
-    factory.from_config(cfg);
-    renderer.from_config(cfg, &registry);
-    registry.load(data_folder_path);
-    SetTargetFPS(FPS);
-    SetWindowSize(width, height);
-    SetWindowTitle(title.c_str());
-    if (!is_currently_in_fullscreen && fullscreen)
+
+    // Only the parts that read a changed key are updated, on the first call every part is
+    bool window_changed = !is_update, render_changed = !is_update;
+    std::vector<std::string> factory_keys;
+    for (const auto &key : changed_keys)
+    {
+        if (is_window_key(key))
+            window_changed = true;
+        else if (ChunkRenderer2D::is_render_key(key))
+            render_changed = true;
+        else
+            factory_keys.push_back(key);
+    }
+    changed_keys.clear();
+    config_changed = false;
+
+    // Biome colors only change the textures, biome ranges also change the biome of the chunks
+    bool ranges_changed = false;
+    if (biomes_changed || !is_update)
     {
-        ToggleFullscreen();
-        is_currently_in_fullscreen = true;
+        auto old_ranges = registry.biome_registry.ranges();
+        registry.load(data_folder_path);
+        ranges_changed = !(old_ranges == registry.biome_registry.ranges());
+        render_changed = true;
+        biomes_changed = false;
     }
-    else if (is_currently_in_fullscreen && !fullscreen)
+
+    // The factory only generates the channels that the renderer draws
+    if (render_changed)
+        renderer.from_config(cfg, &registry);
+    bool rebuild = !is_update || !factory_keys.empty() || renderer.channels() != outputs;
+    ChannelSet invalidated = 0;
+    if (rebuild)
     {
-        ToggleFullscreen();
-        is_currently_in_fullscreen = false;
+        invalidated = renderer.channels() != outputs
+                          ? ALL_CHANNELS
+                          : ChunkFactory::invalidated_channels(cfg, factory_keys, false);
+        outputs = renderer.channels();
+        factory.from_config(cfg, outputs);
     }
-    if (is_update && chunks.size() == static_cast<size_t>(number_of_chunks_horizontal *
-                                                          number_of_chunks_vertical))
+    if (ranges_changed)
+        invalidated |= ChunkFactory::invalidated_channels(cfg, {}, true);
+
+    if (window_changed)
+    {
+        SetTargetFPS(FPS);
+        SetWindowSize(width, height);
+        SetWindowTitle(title.c_str());
+        if (!is_currently_in_fullscreen && fullscreen)
+        {
+            ToggleFullscreen();
+            is_currently_in_fullscreen = true;
+        }
+        else if (is_currently_in_fullscreen && !fullscreen)
+        {
+            ToggleFullscreen();
+            is_currently_in_fullscreen = false;
+        }
+    }
+    bool same_layout = chunks.size() == static_cast<size_t>(number_of_chunks_horizontal *
+                                                            number_of_chunks_vertical);
+    if (is_update && same_layout && !invalidated && !render_changed)
+        return;
+    // Feature layers need the neighbours of a chunk, which only the scheduler generates
+    if (is_update && same_layout && factory.last_status() == STATUS_BIOME)
     {
         int idx = 0;
         for (int i = 0; i < number_of_chunks_vertical; ++i)
         {
             for (int j = 0; j < number_of_chunks_horizontal; ++j)
             {
-                // Update the chunk
-                factory.execute_update(registry, j, i, chunks[idx]);
+                // Update the chunk, only the layers that read an invalidated channel run again
+                if (invalidated)
+                {
+                    chunks[idx].lod = lod;
+                    factory.execute_update(registry, j, i, chunks[idx], invalidated);
+                }
 
                 // Update the texture
                 renderer.update_texture(chunk_textures[idx], chunks[idx]);
@@ -74,14 +157,19 @@ auto Engine::apply_config(bool is_update) -> void
             texture.unload();
         chunk_textures.clear();
 
-        // Create the initial chunks
+        // Create the initial chunks, with the chunks around them that their stages read
+        std::vector<std::pair<int, int>> positions;
         for (int i = 0; i < number_of_chunks_vertical; ++i)
         {
             for (int j = 0; j < number_of_chunks_horizontal; ++j)
-            {
-                chunks.push_back(factory.execute(registry, j, i));
-            }
+                positions.push_back({j, i});
         }
+        scheduler.clear();
+        scheduler.set_lod(lod);
+        scheduler.generate(positions, factory.last_status());
+        for (const auto &[x, y] : positions)
+            chunks.push_back(scheduler.finish(x, y));
+        scheduler.clear();
 
         // Create textures for the chunks
         for (auto &chunk : chunks)
@@ -90,7 +178,8 @@ auto Engine::apply_config(bool is_update) -> void
 }
 
 Engine::Engine(const std::filesystem::path &data_folder_path)
-    : is_currently_in_fullscreen(false), data_folder_path(data_folder_path), config_changed(true)
+    : is_currently_in_fullscreen(false), data_folder_path(data_folder_path), config_changed(true),
+      biomes_changed(true), outputs(0), scheduler(factory, registry)
 {
     info("Creating engine...");
     load_config();
@@ -140,8 +229,13 @@ auto Engine::draw() -> void
     {
         for (int j = 0; j < number_of_chunks_horizontal; ++j)
         {
-            DrawTexture(chunk_textures[idx].texture, j * chunk_side_length, i * chunk_side_length,
-                        RAYWHITE);
+            // Chunks at a level of detail are smaller than chunk_side_length
+            const auto &texture = chunk_textures[idx].texture;
+            float scale = static_cast<float>(chunk_side_length) / static_cast<float>(texture.width);
+            DrawTextureEx(texture,
+                          Vector2{static_cast<float>(j * chunk_side_length),
+                                  static_cast<float>(i * chunk_side_length)},
+                          0.0f, scale, RAYWHITE);
             ++idx;
         }
     }
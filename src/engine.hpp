@@ -2,6 +2,7 @@
 #define A_ENGINE_H
 #include "chunk.hpp"
 #include "chunk_renderer.hpp"
+#include "chunk_scheduler.hpp"
 #include "confparse.hpp"
 #include "engine.hpp"
 #include "logger.h"
@@ -19,6 +20,8 @@ class Engine
     std::vector<Chunk> chunks;
     std::vector<ChunkTexture2D> chunk_textures;
     int chunk_side_length, number_of_chunks_horizontal, number_of_chunks_vertical;
+    // Level of detail of the chunks, they are drawn stretched to chunk_side_length
+    int lod;
 
     int width, height, FPS, reload_interval;
     bool fullscreen;
@@ -27,8 +30,23 @@ class Engine
     bool is_currently_in_fullscreen;
     std::filesystem::path data_folder_path;
     bool config_changed;
+    // Keys that were added, removed or changed since the last apply_config()
+    std::vector<std::string> changed_keys;
+    bool biomes_changed;
+    std::filesystem::file_time_type biomes_write_time;
+    // Channels that the factory generates for the renderer
+    ChannelSet outputs;
 
     Registry registry;
+    // Generates the chunks of the screen in parallel
+    ChunkScheduler scheduler;
+
+    // Keys whose values differ between the two configs
+    static auto diff_keys(confparse::Config old_cfg, confparse::Config new_cfg)
+        -> std::vector<std::string>;
+
+    // Keys read by the window instead of the chunks or the renderer
+    static auto is_window_key(const std::string &key) -> bool;
 
     auto load_config() -> void;
 
@@ -0,0 +1,53 @@
+#ifndef A_FINGERPRINT_H
+#define A_FINGERPRINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// 64 bit FNV-1a hash of a sequence of values, identifies the parameters of a layer (see
+// Layer::fingerprint()). Floats are hashed by their bits
+class Fingerprint
+{
+    uint64_t hash = 14695981039346656037ull;
+
+    auto add_bytes(const void *data, size_t size) -> Fingerprint &
+    {
+        const auto *bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return *this;
+    }
+
+  public:
+    auto add(uint64_t value) -> Fingerprint & { return add_bytes(&value, sizeof(value)); }
+
+    auto add(int value) -> Fingerprint & { return add_bytes(&value, sizeof(value)); }
+
+    auto add(float value) -> Fingerprint & { return add_bytes(&value, sizeof(value)); }
+
+    auto add(bool value) -> Fingerprint & { return add(static_cast<int>(value)); }
+
+    auto add(const std::string &value) -> Fingerprint &
+    {
+        add(static_cast<uint64_t>(value.size()));
+        return add_bytes(value.data(), value.size());
+    }
+
+    auto add(const char *value) -> Fingerprint & { return add(std::string(value)); }
+
+    auto add(const std::vector<float> &values) -> Fingerprint &
+    {
+        add(static_cast<uint64_t>(values.size()));
+        return add_bytes(values.data(), values.size() * sizeof(float));
+    }
+
+    // Never 0, which stands for no fingerprint
+    auto value() const -> uint64_t { return hash ? hash : 1; }
+};
+
+#endif // A_FINGERPRINT_H
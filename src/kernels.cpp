@@ -0,0 +1,49 @@
+#include "kernels.hpp"
+#include "cpu_features.hpp"
+#include "kernels_impl.hpp"
+#include "logger.h"
+#include <stdlib.h>
+#include <string>
+
+auto scalar_kernels() -> const KernelTable *
+{
+    static const KernelTable table = make_kernel_table<simd::Scalar>("scalar");
+    return &table;
+}
+
+static auto select_kernels() -> const KernelTable *
+{
+    const auto &features = cpu_features();
+
+    // Allows testing the slower paths on a machine that supports everything, an empty value is the
+    // same as no value
+    std::string cap = "avx512";
+    const char *env = getenv("MAPGEN_KERNELS");
+    if (env && *env)
+    {
+        std::string value = env;
+        if (value == "avx512" || value == "avx2" || value == "sse2" || value == "scalar")
+            cap = value;
+        else
+            logger::warn("Ignoring unknown MAPGEN_KERNELS value \"{}\", expected avx512, avx2, "
+                         "sse2 or scalar",
+                         value);
+    }
+
+    const KernelTable *table = nullptr;
+    if (cap == "avx512" && features.avx512)
+        table = avx512_kernels();
+    if (!table && (cap == "avx512" || cap == "avx2") && features.avx2)
+        table = avx2_kernels();
+    if (!table && cap != "scalar" && features.sse2)
+        table = sse2_kernels();
+    if (!table)
+        table = scalar_kernels();
+    return table;
+}
+
+auto kernels() -> const KernelTable &
+{
+    static const KernelTable *table = select_kernels();
+    return *table;
+}
@@ -0,0 +1,119 @@
+#ifndef A_KERNELS_H
+#define A_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Batch kernels for the hot loops of the generator and the renderer
+// Every kernel is compiled once per instruction set (kernels_sse2.cpp, kernels_avx2.cpp, ...), the
+// best table supported by the CPU is picked the first time kernels() is called. The environment
+// variable MAPGEN_KERNELS (scalar, sse2, avx2 or avx512) caps the selected instruction set.
+//
+// The noise kernels mirror the order of floating point operations in FastNoiseLite and are compiled
+// without FMA contraction, so their output is bit identical to NoiseGenerator::at(). If the build
+// allows the compiler to contract multiply/add pairs into FMA instructions (e.g. -march=native),
+// the two paths round differently, the difference then stays below NOISE_KERNEL_TOLERANCE
+// (measured maximum is about 1.4e-5)
+#define NOISE_KERNEL_TOLERANCE 1e-4f
+
+// Maximum relative error of the pow kernel for bases in [1e-4, 2] and exponents in [0.1, 8], the
+// measured maximum is about 5.7e-6. Bases <= 0 give 0
+#define FAST_POW_TOLERANCE 1e-5f
+
+// Values of the type argument of the domain warp kernel, the same as FastNoiseLite::DomainWarpType
+#define DOMAIN_WARP_OPENSIMPLEX2 0
+#define DOMAIN_WARP_OPENSIMPLEX2_REDUCED 1
+#define DOMAIN_WARP_BASIC_GRID 2
+
+// Largest unsigned normalized 16 bit value, stands for 1
+#define UNORM16_MAX 65535.0f
+
+// Biome ranges in registration order, one entry per biome, see BiomeRegistry::ranges()
+struct BiomeRangeView
+{
+    const float *elevation_start;
+    const float *elevation_end;
+    const float *moisture_start;
+    const float *moisture_end;
+    const int *ids;
+    size_t count;
+};
+
+struct KernelTable
+{
+    const char *name;
+
+    // OpenSimplex2S noise mapped to [0, 1] at (xs[i], ys[i]), frequency is the FastNoiseLite
+    // frequency. Same result as NoiseGenerator::at()
+    void (*opensimplex2s)(int seed, float frequency, const float *xs, const float *ys, float *out,
+                          size_t n);
+
+    // Same as opensimplex2s, with every sample on the row at y
+    void (*opensimplex2s_row)(int seed, float frequency, const float *xs, float y, float *out,
+                              size_t n);
+
+    // Same as opensimplex2s_row, with the analytic partial derivatives of out[i] with respect to
+    // xs[i] and y in out_dx[i] and out_dy[i]
+    void (*opensimplex2s_row_gradient)(int seed, float frequency, const float *xs, float y,
+                                       float *out, float *out_dx, float *out_dy, size_t n);
+
+    // Approximation of out[i] = powf(in[i], exponent), see FAST_POW_TOLERANCE. in and out may be
+    // the same array
+    void (*pow)(const float *in, float exponent, float *out, size_t n);
+
+    // Id of the first biome whose range contains (moisture[i], elevation[i]), -1 if there is none.
+    // Same result as BiomeRegistry::get_biome_within_range()
+    void (*classify_biomes)(const BiomeRangeView &ranges, const float *moisture,
+                            const float *elevation, int *out, size_t n);
+
+    // Grayscale RGBA pixels (4 bytes per pixel) from values in [0, 1]
+    void (*heightmap_to_rgba)(const float *values, unsigned char *rgba, size_t n);
+
+    // RGBA pixels from biome ids, palette[id + 1] is the packed color of a biome, palette[0] is
+    // used for id -1. A packed color holds r in the lowest byte and a in the highest byte
+    void (*palette_to_rgba)(const int *ids, const uint32_t *palette, unsigned char *rgba,
+                            size_t n);
+
+    // out[i] = in[i] clamped to [0, 1] as an unsigned normalized 16 bit value, rounded to nearest
+    void (*quantize_unorm16)(const float *in, uint16_t *out, size_t n);
+
+    // out[i] = in[i] / UNORM16_MAX, the inverse of quantize_unorm16 within 0.5 / UNORM16_MAX
+    void (*dequantize_unorm16)(const uint16_t *in, float *out, size_t n);
+
+    // heightmap_to_rgba of unsigned normalized 16 bit values, same pixels as heightmap_to_rgba of
+    // the dequantized values
+    void (*heightmap16_to_rgba)(const uint16_t *values, unsigned char *rgba, size_t n);
+
+    // RGBA pixels from 8 bit palette indices, palette[index] is a packed color as in
+    // palette_to_rgba
+    void (*palette8_to_rgba)(const uint8_t *indices, const uint32_t *palette, unsigned char *rgba,
+                             size_t n);
+
+    // One radix 2 FFT butterfly for each of n pairs of complex values a[i], b[i], stored as real
+    // and imaginary parts: t = b[i] * w, b[i] = a[i] - t, a[i] = a[i] + t
+    void (*fft_butterfly)(float *a_real, float *a_imag, float *b_real, float *b_imag,
+                          float w_real, float w_imag, size_t n);
+
+    // White noise with a variance of 1, out[i] is a hash of the seed and (x + i, y) mapped to
+    // [-sqrt(3), sqrt(3)). Positions wrap around at 32 bits
+    void (*white_noise)(int seed, int x, int y, float *out, size_t n);
+
+    // FastNoiseLite::DomainWarp() of the 2D positions (xs[i], ys[i]) in place, without fractal
+    // warping. type is one of the DOMAIN_WARP_* values, frequency is the FastNoiseLite frequency
+    // and amplitude the warp amplitude times the fractal bounding of FastNoiseLite. Same result
+    // as FastNoiseLite within NOISE_KERNEL_TOLERANCE times the amplitude
+    void (*domain_warp)(int type, int seed, float frequency, float amplitude, float *xs,
+                        float *ys, size_t n);
+};
+
+// Kernel table for the best instruction set supported by this CPU
+auto kernels() -> const KernelTable &;
+
+// Kernel tables for each instruction set, nullptr if the build does not include them. Only call the
+// ones that cpu_features() reports as supported, the AVX tables are built by AVX code
+auto scalar_kernels() -> const KernelTable *;
+auto sse2_kernels() -> const KernelTable *;
+auto avx2_kernels() -> const KernelTable *;
+auto avx512_kernels() -> const KernelTable *;
+
+#endif // A_KERNELS_H
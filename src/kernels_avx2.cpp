@@ -0,0 +1,12 @@
+#include "kernels_impl.hpp"
+
+// This file is compiled with AVX2 enabled, nothing in here may run before checking the CPU
+auto avx2_kernels() -> const KernelTable *
+{
+#ifdef SIMD_HAS_AVX2
+    static const KernelTable table = make_kernel_table<simd::Avx2>("AVX2");
+    return &table;
+#else
+    return nullptr;
+#endif
+}
@@ -0,0 +1,12 @@
+#include "kernels_impl.hpp"
+
+// This file is compiled with AVX-512 enabled, nothing in here may run before checking the CPU
+auto avx512_kernels() -> const KernelTable *
+{
+#ifdef SIMD_HAS_AVX512
+    static const KernelTable table = make_kernel_table<simd::Avx512>("AVX-512");
+    return &table;
+#else
+    return nullptr;
+#endif
+}
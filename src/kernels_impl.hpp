@@ -0,0 +1,832 @@
+#ifndef A_KERNELS_IMPL_H
+#define A_KERNELS_IMPL_H
+
+// Kernel templates shared by kernels_*.cpp, each of those files instantiates them for one vector
+// type from simd.hpp. Only include this from the kernel translation units, everything in here has
+// internal linkage so that code compiled for different instruction sets never gets mixed up
+
+#include "kernels.hpp"
+#include "simd.hpp"
+
+namespace
+{
+
+// Same table as FastNoiseLite::Lookup<float>::Gradients2D, which is private to FastNoiseLite
+// clang-format off
+alignas(64) const float gradients_2d[] =
+{
+    0.130526192220052f, 0.99144486137381f, 0.38268343236509f, 0.923879532511287f, 0.608761429008721f, 0.793353340291235f, 0.793353340291235f, 0.608761429008721f,
+    0.923879532511287f, 0.38268343236509f, 0.99144486137381f, 0.130526192220051f, 0.99144486137381f, -0.130526192220051f, 0.923879532511287f, -0.38268343236509f,
+    0.793353340291235f, -0.60876142900872f, 0.608761429008721f, -0.793353340291235f, 0.38268343236509f, -0.923879532511287f, 0.130526192220052f, -0.99144486137381f,
+    -0.130526192220052f, -0.99144486137381f, -0.38268343236509f, -0.923879532511287f, -0.608761429008721f, -0.793353340291235f, -0.793353340291235f, -0.608761429008721f,
+    -0.923879532511287f, -0.38268343236509f, -0.99144486137381f, -0.130526192220052f, -0.99144486137381f, 0.130526192220051f, -0.923879532511287f, 0.38268343236509f,
+    -0.793353340291235f, 0.608761429008721f, -0.608761429008721f, 0.793353340291235f, -0.38268343236509f, 0.923879532511287f, -0.130526192220052f, 0.99144486137381f,
+    0.130526192220052f, 0.99144486137381f, 0.38268343236509f, 0.923879532511287f, 0.608761429008721f, 0.793353340291235f, 0.793353340291235f, 0.608761429008721f,
+    0.923879532511287f, 0.38268343236509f, 0.99144486137381f, 0.130526192220051f, 0.99144486137381f, -0.130526192220051f, 0.923879532511287f, -0.38268343236509f,
+    0.793353340291235f, -0.60876142900872f, 0.608761429008721f, -0.793353340291235f, 0.38268343236509f, -0.923879532511287f, 0.130526192220052f, -0.99144486137381f,
+    -0.130526192220052f, -0.99144486137381f, -0.38268343236509f, -0.923879532511287f, -0.608761429008721f, -0.793353340291235f, -0.793353340291235f, -0.608761429008721f,
+    -0.923879532511287f, -0.38268343236509f, -0.99144486137381f, -0.130526192220052f, -0.99144486137381f, 0.130526192220051f, -0.923879532511287f, 0.38268343236509f,
+    -0.793353340291235f, 0.608761429008721f, -0.608761429008721f, 0.793353340291235f, -0.38268343236509f, 0.923879532511287f, -0.130526192220052f, 0.99144486137381f,
+    0.130526192220052f, 0.99144486137381f, 0.38268343236509f, 0.923879532511287f, 0.608761429008721f, 0.793353340291235f, 0.793353340291235f, 0.608761429008721f,
+    0.923879532511287f, 0.38268343236509f, 0.99144486137381f, 0.130526192220051f, 0.99144486137381f, -0.130526192220051f, 0.923879532511287f, -0.38268343236509f,
+    0.793353340291235f, -0.60876142900872f, 0.608761429008721f, -0.793353340291235f, 0.38268343236509f, -0.923879532511287f, 0.130526192220052f, -0.99144486137381f,
+    -0.130526192220052f, -0.99144486137381f, -0.38268343236509f, -0.923879532511287f, -0.608761429008721f, -0.793353340291235f, -0.793353340291235f, -0.608761429008721f,
+    -0.923879532511287f, -0.38268343236509f, -0.99144486137381f, -0.130526192220052f, -0.99144486137381f, 0.130526192220051f, -0.923879532511287f, 0.38268343236509f,
+    -0.793353340291235f, 0.608761429008721f, -0.608761429008721f, 0.793353340291235f, -0.38268343236509f, 0.923879532511287f, -0.130526192220052f, 0.99144486137381f,
+    0.130526192220052f, 0.99144486137381f, 0.38268343236509f, 0.923879532511287f, 0.608761429008721f, 0.793353340291235f, 0.793353340291235f, 0.608761429008721f,
+    0.923879532511287f, 0.38268343236509f, 0.99144486137381f, 0.130526192220051f, 0.99144486137381f, -0.130526192220051f, 0.923879532511287f, -0.38268343236509f,
+    0.793353340291235f, -0.60876142900872f, 0.608761429008721f, -0.793353340291235f, 0.38268343236509f, -0.923879532511287f, 0.130526192220052f, -0.99144486137381f,
+    -0.130526192220052f, -0.99144486137381f, -0.38268343236509f, -0.923879532511287f, -0.608761429008721f, -0.793353340291235f, -0.793353340291235f, -0.608761429008721f,
+    -0.923879532511287f, -0.38268343236509f, -0.99144486137381f, -0.130526192220052f, -0.99144486137381f, 0.130526192220051f, -0.923879532511287f, 0.38268343236509f,
+    -0.793353340291235f, 0.608761429008721f, -0.608761429008721f, 0.793353340291235f, -0.38268343236509f, 0.923879532511287f, -0.130526192220052f, 0.99144486137381f,
+    0.130526192220052f, 0.99144486137381f, 0.38268343236509f, 0.923879532511287f, 0.608761429008721f, 0.793353340291235f, 0.793353340291235f, 0.608761429008721f,
+    0.923879532511287f, 0.38268343236509f, 0.99144486137381f, 0.130526192220051f, 0.99144486137381f, -0.130526192220051f, 0.923879532511287f, -0.38268343236509f,
+    0.793353340291235f, -0.60876142900872f, 0.608761429008721f, -0.793353340291235f, 0.38268343236509f, -0.923879532511287f, 0.130526192220052f, -0.99144486137381f,
+    -0.130526192220052f, -0.99144486137381f, -0.38268343236509f, -0.923879532511287f, -0.608761429008721f, -0.793353340291235f, -0.793353340291235f, -0.608761429008721f,
+    -0.923879532511287f, -0.38268343236509f, -0.99144486137381f, -0.130526192220052f, -0.99144486137381f, 0.130526192220051f, -0.923879532511287f, 0.38268343236509f,
+    -0.793353340291235f, 0.608761429008721f, -0.608761429008721f, 0.793353340291235f, -0.38268343236509f, 0.923879532511287f, -0.130526192220052f, 0.99144486137381f,
+    0.38268343236509f, 0.923879532511287f, 0.923879532511287f, 0.38268343236509f, 0.923879532511287f, -0.38268343236509f, 0.38268343236509f, -0.923879532511287f,
+    -0.38268343236509f, -0.923879532511287f, -0.923879532511287f, -0.38268343236509f, -0.923879532511287f, 0.38268343236509f, -0.38268343236509f, 0.923879532511287f,
+};
+// clang-format on
+
+// Same table as FastNoiseLite::Lookup<float>::RandVecs2D, used by the domain warp
+// clang-format off
+alignas(64) const float rand_vecs_2d[] =
+{
+    -0.2700222198f, -0.9628540911f, 0.3863092627f, -0.9223693152f, 0.04444859006f, -0.999011673f, -0.5992523158f, -0.8005602176f, -0.7819280288f, 0.6233687174f, 0.9464672271f, 0.3227999196f, -0.6514146797f, -0.7587218957f, 0.9378472289f, 0.347048376f,
+    -0.8497875957f, -0.5271252623f, -0.879042592f, 0.4767432447f, -0.892300288f, -0.4514423508f, -0.379844434f, -0.9250503802f, -0.9951650832f, 0.0982163789f, 0.7724397808f, -0.6350880136f, 0.7573283322f, -0.6530343002f, -0.9928004525f, -0.119780055f,
+    -0.0532665713f, 0.9985803285f, 0.9754253726f, -0.2203300762f, -0.7665018163f, 0.6422421394f, 0.991636706f, 0.1290606184f, -0.994696838f, 0.1028503788f, -0.5379205513f, -0.84299554f, 0.5022815471f, -0.8647041387f, 0.4559821461f, -0.8899889226f,
+    -0.8659131224f, -0.5001944266f, 0.0879458407f, -0.9961252577f, -0.5051684983f, 0.8630207346f, 0.7753185226f, -0.6315704146f, -0.6921944612f, 0.7217110418f, -0.5191659449f, -0.8546734591f, 0.8978622882f, -0.4402764035f, -0.1706774107f, 0.9853269617f,
+    -0.9353430106f, -0.3537420705f, -0.9992404798f, 0.03896746794f, -0.2882064021f, -0.9575683108f, -0.9663811329f, 0.2571137995f, -0.8759714238f, -0.4823630009f, -0.8303123018f, -0.5572983775f, 0.05110133755f, -0.9986934731f, -0.8558373281f, -0.5172450752f,
+    0.09887025282f, 0.9951003332f, 0.9189016087f, 0.3944867976f, -0.2439375892f, -0.9697909324f, -0.8121409387f, -0.5834613061f, -0.9910431363f, 0.1335421355f, 0.8492423985f, -0.5280031709f, -0.9717838994f, -0.2358729591f, 0.9949457207f, 0.1004142068f,
+    0.6241065508f, -0.7813392434f, 0.662910307f, 0.7486988212f, -0.7197418176f, 0.6942418282f, -0.8143370775f, -0.5803922158f, 0.104521054f, -0.9945226741f, -0.1065926113f, -0.9943027784f, 0.445799684f, -0.8951327509f, 0.105547406f, 0.9944142724f,
+    -0.992790267f, 0.1198644477f, -0.8334366408f, 0.552615025f, 0.9115561563f, -0.4111755999f, 0.8285544909f, -0.5599084351f, 0.7217097654f, -0.6921957921f, 0.4940492677f, -0.8694339084f, -0.3652321272f, -0.9309164803f, -0.9696606758f, 0.2444548501f,
+    0.08925509731f, -0.996008799f, 0.5354071276f, -0.8445941083f, -0.1053576186f, 0.9944343981f, -0.9890284586f, 0.1477251101f, 0.004856104961f, 0.9999882091f, 0.9885598478f, 0.1508291331f, 0.9286129562f, -0.3710498316f, -0.5832393863f, -0.8123003252f,
+    0.3015207509f, 0.9534596146f, -0.9575110528f, 0.2883965738f, 0.9715802154f, -0.2367105511f, 0.229981792f, 0.9731949318f, 0.955763816f, -0.2941352207f, 0.740956116f, 0.6715534485f, -0.9971513787f, -0.07542630764f, 0.6905710663f, -0.7232645452f,
+    -0.290713703f, -0.9568100872f, 0.5912777791f, -0.8064679708f, -0.9454592212f, -0.325740481f, 0.6664455681f, 0.74555369f, 0.6236134912f, 0.7817328275f, 0.9126993851f, -0.4086316587f, -0.8191762011f, 0.5735419353f, -0.8812745759f, -0.4726046147f,
+    0.9953313627f, 0.09651672651f, 0.9855650846f, -0.1692969699f, -0.8495980887f, 0.5274306472f, 0.6174853946f, -0.7865823463f, 0.8508156371f, 0.52546432f, 0.9985032451f, -0.05469249926f, 0.1971371563f, -0.9803759185f, 0.6607855748f, -0.7505747292f,
+    -0.03097494063f, 0.9995201614f, -0.6731660801f, 0.739491331f, -0.7195018362f, -0.6944905383f, 0.9727511689f, 0.2318515979f, 0.9997059088f, -0.0242506907f, 0.4421787429f, -0.8969269532f, 0.9981350961f, -0.061043673f, -0.9173660799f, -0.3980445648f,
+    -0.8150056635f, -0.5794529907f, -0.8789331304f, 0.4769450202f, 0.0158605829f, 0.999874213f, -0.8095464474f, 0.5870558317f, -0.9165898907f, -0.3998286786f, -0.8023542565f, 0.5968480938f, -0.5176737917f, 0.8555780767f, -0.8154407307f, -0.5788405779f,
+    0.4022010347f, -0.9155513791f, -0.9052556868f, -0.4248672045f, 0.7317445619f, 0.6815789728f, -0.5647632201f, -0.8252529947f, -0.8403276335f, -0.5420788397f, -0.9314281527f, 0.363925262f, 0.5238198472f, 0.8518290719f, 0.7432803869f, -0.6689800195f,
+    -0.985371561f, -0.1704197369f, 0.4601468731f, 0.88784281f, 0.825855404f, 0.5638819483f, 0.6182366099f, 0.7859920446f, 0.8331502863f, -0.553046653f, 0.1500307506f, 0.9886813308f, -0.662330369f, -0.7492119075f, -0.668598664f, 0.743623444f,
+    0.7025606278f, 0.7116238924f, -0.5419389763f, -0.8404178401f, -0.3388616456f, 0.9408362159f, 0.8331530315f, 0.5530425174f, -0.2989720662f, -0.9542618632f, 0.2638522993f, 0.9645630949f, 0.124108739f, -0.9922686234f, -0.7282649308f, -0.6852956957f,
+    0.6962500149f, 0.7177993569f, -0.9183535368f, 0.3957610156f, -0.6326102274f, -0.7744703352f, -0.9331891859f, -0.359385508f, -0.1153779357f, -0.9933216659f, 0.9514974788f, -0.3076565421f, -0.08987977445f, -0.9959526224f, 0.6678496916f, 0.7442961705f,
+    0.7952400393f, -0.6062947138f, -0.6462007402f, -0.7631674805f, -0.2733598753f, 0.9619118351f, 0.9669590226f, -0.254931851f, -0.9792894595f, 0.2024651934f, -0.5369502995f, -0.8436138784f, -0.270036471f, -0.9628500944f, -0.6400277131f, 0.7683518247f,
+    -0.7854537493f, -0.6189203566f, 0.06005905383f, -0.9981948257f, -0.02455770378f, 0.9996984141f, -0.65983623f, 0.751409442f, -0.6253894466f, -0.7803127835f, -0.6210408851f, -0.7837781695f, 0.8348888491f, 0.5504185768f, -0.1592275245f, 0.9872419133f,
+    0.8367622488f, 0.5475663786f, -0.8675753916f, -0.4973056806f, -0.2022662628f, -0.9793305667f, 0.9399189937f, 0.3413975472f, 0.9877404807f, -0.1561049093f, -0.9034455656f, 0.4287028224f, 0.1269804218f, -0.9919052235f, -0.3819600854f, 0.924178821f,
+    0.9754625894f, 0.2201652486f, -0.3204015856f, -0.9472818081f, -0.9874760884f, 0.1577687387f, 0.02535348474f, -0.9996785487f, 0.4835130794f, -0.8753371362f, -0.2850799925f, -0.9585037287f, -0.06805516006f, -0.99768156f, -0.7885244045f, -0.6150034663f,
+    0.3185392127f, -0.9479096845f, 0.8880043089f, 0.4598351306f, 0.6476921488f, -0.7619021462f, 0.9820241299f, 0.1887554194f, 0.9357275128f, -0.3527237187f, -0.8894895414f, 0.4569555293f, 0.7922791302f, 0.6101588153f, 0.7483818261f, 0.6632681526f,
+    -0.7288929755f, -0.6846276581f, 0.8729032783f, -0.4878932944f, 0.8288345784f, 0.5594937369f, 0.08074567077f, 0.9967347374f, 0.9799148216f, -0.1994165048f, -0.580730673f, -0.8140957471f, -0.4700049791f, -0.8826637636f, 0.2409492979f, 0.9705377045f,
+    0.9437816757f, -0.3305694308f, -0.8927998638f, -0.4504535528f, -0.8069622304f, 0.5906030467f, 0.06258973166f, 0.9980393407f, -0.9312597469f, 0.3643559849f, 0.5777449785f, 0.8162173362f, -0.3360095855f, -0.941858566f, 0.697932075f, -0.7161639607f,
+    -0.002008157227f, -0.9999979837f, -0.1827294312f, -0.9831632392f, -0.6523911722f, 0.7578824173f, -0.4302626911f, -0.9027037258f, -0.9985126289f, -0.05452091251f, -0.01028102172f, -0.9999471489f, -0.4946071129f, 0.8691166802f, -0.2999350194f, 0.9539596344f,
+    0.8165471961f, 0.5772786819f, 0.2697460475f, 0.962931498f, -0.7306287391f, -0.6827749597f, -0.7590952064f, -0.6509796216f, -0.907053853f, 0.4210146171f, -0.5104861064f, -0.8598860013f, 0.8613350597f, 0.5080373165f, 0.5007881595f, -0.8655698812f,
+    -0.654158152f, 0.7563577938f, -0.8382755311f, -0.545246856f, 0.6940070834f, 0.7199681717f, 0.06950936031f, 0.9975812994f, 0.1702942185f, -0.9853932612f, 0.2695973274f, 0.9629731466f, 0.5519612192f, -0.8338697815f, 0.225657487f, -0.9742067022f,
+    0.4215262855f, -0.9068161835f, 0.4881873305f, -0.8727388672f, -0.3683854996f, -0.9296731273f, -0.9825390578f, 0.1860564427f, 0.81256471f, 0.5828709909f, 0.3196460933f, -0.9475370046f, 0.9570913859f, 0.2897862643f, -0.6876655497f, -0.7260276109f,
+    -0.9988770922f, -0.047376731f, -0.1250179027f, 0.992154486f, -0.8280133617f, 0.560708367f, 0.9324863769f, -0.3612051451f, 0.6394653183f, 0.7688199442f, -0.01623847064f, -0.9998681473f, -0.9955014666f, -0.09474613458f, -0.81453315f, 0.580117012f,
+    0.4037327978f, -0.9148769469f, 0.9944263371f, 0.1054336766f, -0.1624711654f, 0.9867132919f, -0.9949487814f, -0.100383875f, -0.6995302564f, 0.7146029809f, 0.5263414922f, -0.85027327f, -0.5395221479f, 0.841971408f, 0.6579370318f, 0.7530729462f,
+    0.01426758847f, -0.9998982128f, -0.6734383991f, 0.7392433447f, 0.639412098f, -0.7688642071f, 0.9211571421f, 0.3891908523f, -0.146637214f, -0.9891903394f, -0.782318098f, 0.6228791163f, -0.5039610839f, -0.8637263605f, -0.7743120191f, -0.6328039957f,
+};
+// clang-format on
+
+const int32_t PRIME_X = 501125321;
+const int32_t PRIME_Y = 1136930381;
+// PrimeX << 1 and PrimeY << 1 in FastNoiseLite, the latter wraps around
+const int32_t PRIME_X_TWICE = static_cast<int32_t>(static_cast<uint32_t>(PRIME_X) << 1);
+const int32_t PRIME_Y_TWICE = static_cast<int32_t>(static_cast<uint32_t>(PRIME_Y) << 1);
+
+// The constants are computed in single precision, exactly like FastNoiseLite does
+const float SQRT3 = 1.7320508075688772935274463415059f;
+const float F2 = 0.5f * (SQRT3 - 1);
+const float G2 = (3 - SQRT3) / 6;
+
+// FastNoiseLite::FastFloor, note that it returns x - 1 for negative integers
+template <typename V> inline auto fast_floor(typename V::f32 x) -> typename V::i32
+{
+    auto t = V::truncate(x);
+    return V::select_i(V::lt(x, V::set1(0.0f)), V::add_i(t, V::set1_i(-1)), t);
+}
+
+// Gradient of a lattice vertex, the hash of FastNoiseLite::GradCoord for 2D noise
+template <typename V>
+inline auto vertex_gradient(typename V::i32 seed, typename V::i32 x_primed,
+                            typename V::i32 y_primed, typename V::f32 &xg, typename V::f32 &yg)
+    -> void
+{
+    auto hash = V::xor_i(V::xor_i(seed, x_primed), y_primed);
+    hash = V::mul_i(hash, V::set1_i(0x27d4eb2d));
+    hash = V::xor_i(hash, V::srai(hash, 15));
+    hash = V::and_i(hash, V::set1_i(127 << 1));
+
+    xg = V::gather(gradients_2d, hash);
+    yg = V::gather(gradients_2d, V::or_i(hash, V::set1_i(1)));
+}
+
+// Adds the derivative of the contribution a^4 (g . d) of a lattice vertex with respect to the
+// offset d = (x, y) of the sample, which is -8 a^3 (g . d) d + a^4 g
+template <typename V>
+inline auto add_vertex_derivative(typename V::f32 a, typename V::f32 a4, typename V::f32 x,
+                                  typename V::f32 y, typename V::f32 xg, typename V::f32 yg,
+                                  typename V::f32 dot, typename V::f32 &dx, typename V::f32 &dy)
+    -> void
+{
+    auto common = V::mul(V::mul(V::set1(-8.0f), V::mul(V::mul(a, a), a)), dot);
+    dx = V::add(dx, V::add(V::mul(common, x), V::mul(a4, xg)));
+    dy = V::add(dy, V::add(V::mul(common, y), V::mul(a4, yg)));
+}
+
+// Contribution of a lattice vertex, (x, y) is the position of the sample relative to the vertex.
+// It is zero if the sample is outside the kernel radius of the vertex. With Gradient, its
+// derivative is added to (dx, dy)
+template <typename V, bool Gradient>
+inline auto contribution(typename V::i32 seed, typename V::i32 i, typename V::i32 j,
+                         typename V::f32 x, typename V::f32 y, typename V::f32 &dx,
+                         typename V::f32 &dy) -> typename V::f32
+{
+    typename V::f32 xg, yg;
+    vertex_gradient<V>(seed, i, j, xg, yg);
+    auto dot = V::add(V::mul(x, xg), V::mul(y, yg));
+    auto a = V::sub(V::sub(V::set1(2.0f / 3.0f), V::mul(x, x)), V::mul(y, y));
+    auto a2 = V::mul(a, a);
+    auto a4 = V::mul(a2, a2);
+    auto inside = V::gt(a, V::set1(0.0f));
+    if constexpr (Gradient)
+    {
+        // Outside the radius a is zeroed, so the derivative is zero as well
+        auto inside_a = V::select(inside, a, V::set1(0.0f));
+        auto inside_a2 = V::mul(inside_a, inside_a);
+        add_vertex_derivative<V>(inside_a, V::mul(inside_a2, inside_a2), x, y, xg, yg, dot, dx,
+                                 dy);
+    }
+    return V::select(inside, V::mul(a4, dot), V::set1(0.0f));
+}
+
+// FastNoiseLite::SingleOpenSimplex2S with the branches replaced by selects, the coordinates are
+// transformed (frequency and skew) in the kernel, as TransformNoiseCoordinate does. With Gradient,
+// the derivatives of the result with respect to x and y are stored in dx and dy. The skew and the
+// unskew cancel out, so the offsets to the vertices move exactly like frequency * (x, y)
+template <typename V, bool Gradient>
+inline auto opensimplex2s_core(typename V::i32 seed, typename V::f32 frequency, typename V::f32 x,
+                               typename V::f32 y, typename V::f32 &dx, typename V::f32 &dy) ->
+    typename V::f32
+{
+    using f32 = typename V::f32;
+    using i32 = typename V::i32;
+
+    if constexpr (Gradient)
+    {
+        dx = V::set1(0.0f);
+        dy = V::set1(0.0f);
+    }
+
+    x = V::mul(x, frequency);
+    y = V::mul(y, frequency);
+    f32 s = V::mul(V::add(x, y), V::set1(F2));
+    x = V::add(x, s);
+    y = V::add(y, s);
+
+    i32 i = fast_floor<V>(x);
+    i32 j = fast_floor<V>(y);
+    f32 xi = V::sub(x, V::to_float(i));
+    f32 yi = V::sub(y, V::to_float(j));
+
+    i = V::mul_i(i, V::set1_i(PRIME_X));
+    j = V::mul_i(j, V::set1_i(PRIME_Y));
+    i32 i1 = V::add_i(i, V::set1_i(PRIME_X));
+    i32 j1 = V::add_i(j, V::set1_i(PRIME_Y));
+
+    f32 t = V::mul(V::add(xi, yi), V::set1(G2));
+    f32 x0 = V::sub(xi, t);
+    f32 y0 = V::sub(yi, t);
+
+    // The first two vertices are always within the kernel radius
+    f32 xg, yg;
+    vertex_gradient<V>(seed, i, j, xg, yg);
+    f32 dot = V::add(V::mul(x0, xg), V::mul(y0, yg));
+    f32 a0 = V::sub(V::sub(V::set1(2.0f / 3.0f), V::mul(x0, x0)), V::mul(y0, y0));
+    f32 a0_2 = V::mul(a0, a0);
+    f32 a0_4 = V::mul(a0_2, a0_2);
+    f32 value = V::mul(a0_4, dot);
+    if constexpr (Gradient)
+        add_vertex_derivative<V>(a0, a0_4, x0, y0, xg, yg, dot, dx, dy);
+
+    f32 a1 = V::add(V::mul(V::set1(2 * (1 - 2 * G2) * (1 / G2 - 2)), t),
+                    V::add(V::set1(-2 * (1 - 2 * G2) * (1 - 2 * G2)), a0));
+    f32 x1 = V::sub(x0, V::set1(1 - 2 * G2));
+    f32 y1 = V::sub(y0, V::set1(1 - 2 * G2));
+    vertex_gradient<V>(seed, i1, j1, xg, yg);
+    dot = V::add(V::mul(x1, xg), V::mul(y1, yg));
+    f32 a1_2 = V::mul(a1, a1);
+    f32 a1_4 = V::mul(a1_2, a1_2);
+    value = V::add(value, V::mul(a1_4, dot));
+    if constexpr (Gradient)
+        add_vertex_derivative<V>(a1, a1_4, x1, y1, xg, yg, dot, dx, dy);
+
+    // Each sample picks two more vertices out of the six candidates, the scalar version does this
+    // with nested branches. Both vertices are evaluated in every lane and the offsets are selected
+    f32 one = V::set1(1.0f);
+    f32 zero = V::set1(0.0f);
+    f32 xmyi = V::sub(xi, yi);
+    auto upper = V::gt(t, V::set1(G2));
+
+    // Second vertex, one of (2, 1), (0, 1) when upper, else (-1, 0), (1, 0)
+    auto far_a = V::gt(V::add(xi, xmyi), one);
+    auto near_a = V::lt(V::add(xi, xmyi), zero);
+    f32 xa = V::select(upper, V::select(far_a, V::set1(3 * G2 - 2), V::set1(G2)),
+                       V::select(near_a, V::set1(1 - G2), V::set1(G2 - 1)));
+    f32 ya = V::select(upper, V::select(far_a, V::set1(3 * G2 - 1), V::set1(G2 - 1)),
+                       V::select(near_a, V::set1(-G2), V::set1(G2)));
+    i32 ia = V::select_i(upper, V::select_i(far_a, V::set1_i(PRIME_X_TWICE), V::set1_i(0)),
+                         V::select_i(near_a, V::set1_i(-PRIME_X), V::set1_i(PRIME_X)));
+    i32 ja = V::select_i(upper, V::set1_i(PRIME_Y), V::set1_i(0));
+    value = V::add(value, contribution<V, Gradient>(seed, V::add_i(i, ia), V::add_i(j, ja),
+                                                    V::add(x0, xa), V::add(y0, ya), dx, dy));
+
+    // Third vertex, one of (1, 2), (1, 0) when upper, else (0, -1), (0, 1)
+    auto far_b = V::gt(V::sub(yi, xmyi), one);
+    auto near_b = V::lt(yi, xmyi);
+    f32 xb = V::select(upper, V::select(far_b, V::set1(3 * G2 - 1), V::set1(G2 - 1)),
+                       V::select(near_b, V::set1(-G2), V::set1(G2)));
+    f32 yb = V::select(upper, V::select(far_b, V::set1(3 * G2 - 2), V::set1(G2)),
+                       V::select(near_b, V::set1(-(G2 - 1)), V::set1(G2 - 1)));
+    i32 ib = V::select_i(upper, V::set1_i(PRIME_X), V::set1_i(0));
+    i32 jb = V::select_i(upper, V::select_i(far_b, V::set1_i(PRIME_Y_TWICE), V::set1_i(0)),
+                         V::select_i(near_b, V::set1_i(-PRIME_Y), V::set1_i(PRIME_Y)));
+    value = V::add(value, contribution<V, Gradient>(seed, V::add_i(i, ib), V::add_i(j, jb),
+                                                    V::add(x0, xb), V::add(y0, yb), dx, dy));
+
+    // FastNoiseLite normalizes to [-1, 1], NoiseGenerator then maps that to [0, 1]
+    value = V::mul(value, V::set1(18.24196194486065f));
+    if constexpr (Gradient)
+    {
+        auto scale = V::mul(V::set1(18.24196194486065f * 0.5f), frequency);
+        dx = V::mul(dx, scale);
+        dy = V::mul(dy, scale);
+    }
+    return V::add(V::mul(value, V::set1(0.5f)), V::set1(0.5f));
+}
+
+template <typename V>
+inline auto opensimplex2s_vector(typename V::i32 seed, typename V::f32 frequency,
+                                 typename V::f32 x, typename V::f32 y) -> typename V::f32
+{
+    typename V::f32 unused;
+    return opensimplex2s_core<V, false>(seed, frequency, x, y, unused, unused);
+}
+
+template <typename V>
+auto opensimplex2s_batch(int seed, float frequency, const float *xs, const float *ys, float *out,
+                         size_t n) -> void
+{
+    auto vseed = V::set1_i(seed);
+    auto vfrequency = V::set1(frequency);
+    size_t i = 0;
+    for (; i + V::width <= n; i += V::width)
+        V::store(out + i, opensimplex2s_vector<V>(vseed, vfrequency, V::load(xs + i),
+                                                  V::load(ys + i)));
+
+    if (i == n)
+        return;
+
+    // Pad the remaining samples to a full vector, so the tail goes through the same code
+    float tail_x[V::width] = {}, tail_y[V::width] = {}, tail_out[V::width];
+    for (size_t k = 0; k < n - i; ++k)
+    {
+        tail_x[k] = xs[i + k];
+        tail_y[k] = ys[i + k];
+    }
+    V::store(tail_out, opensimplex2s_vector<V>(vseed, vfrequency, V::load(tail_x),
+                                               V::load(tail_y)));
+    for (size_t k = 0; k < n - i; ++k)
+        out[i + k] = tail_out[k];
+}
+
+template <typename V>
+auto opensimplex2s_row_batch(int seed, float frequency, const float *xs, float y, float *out,
+                             size_t n) -> void
+{
+    auto vseed = V::set1_i(seed);
+    auto vfrequency = V::set1(frequency);
+    auto vy = V::set1(y);
+    size_t i = 0;
+    for (; i + V::width <= n; i += V::width)
+        V::store(out + i, opensimplex2s_vector<V>(vseed, vfrequency, V::load(xs + i), vy));
+
+    if (i == n)
+        return;
+
+    float tail_x[V::width] = {}, tail_out[V::width];
+    for (size_t k = 0; k < n - i; ++k)
+        tail_x[k] = xs[i + k];
+    V::store(tail_out, opensimplex2s_vector<V>(vseed, vfrequency, V::load(tail_x), vy));
+    for (size_t k = 0; k < n - i; ++k)
+        out[i + k] = tail_out[k];
+}
+
+template <typename V>
+auto opensimplex2s_row_gradient_batch(int seed, float frequency, const float *xs, float y,
+                                      float *out, float *out_dx, float *out_dy, size_t n) -> void
+{
+    auto vseed = V::set1_i(seed);
+    auto vfrequency = V::set1(frequency);
+    auto vy = V::set1(y);
+    typename V::f32 dx, dy;
+    size_t i = 0;
+    for (; i + V::width <= n; i += V::width)
+    {
+        V::store(out + i,
+                 opensimplex2s_core<V, true>(vseed, vfrequency, V::load(xs + i), vy, dx, dy));
+        V::store(out_dx + i, dx);
+        V::store(out_dy + i, dy);
+    }
+
+    if (i == n)
+        return;
+
+    float tail_x[V::width] = {}, tail_out[V::width], tail_dx[V::width], tail_dy[V::width];
+    for (size_t k = 0; k < n - i; ++k)
+        tail_x[k] = xs[i + k];
+    V::store(tail_out,
+             opensimplex2s_core<V, true>(vseed, vfrequency, V::load(tail_x), vy, dx, dy));
+    V::store(tail_dx, dx);
+    V::store(tail_dy, dy);
+    for (size_t k = 0; k < n - i; ++k)
+    {
+        out[i + k] = tail_out[k];
+        out_dx[i + k] = tail_dx[k];
+        out_dy[i + k] = tail_dy[k];
+    }
+}
+
+// log2(x) for x > 0. x = m * 2^e with m in [sqrt(0.5), sqrt(2)), then ln(m) = 2 atanh(t) with
+// t = (m - 1) / (m + 1), |t| < 0.172, the series is cut after t^9
+template <typename V> inline auto log2_vector(typename V::f32 x) -> typename V::f32
+{
+    auto bits = V::as_int(x);
+    auto exponent = V::add_i(V::and_i(V::srli(bits, 23), V::set1_i(0xFF)), V::set1_i(-127));
+    auto m = V::as_float(V::or_i(V::and_i(bits, V::set1_i(0x007FFFFF)), V::set1_i(0x3F800000)));
+
+    auto large = V::gt(m, V::set1(1.41421356f));
+    m = V::select(large, V::mul(m, V::set1(0.5f)), m);
+    exponent = V::select_i(large, V::add_i(exponent, V::set1_i(1)), exponent);
+
+    auto t = V::div(V::sub(m, V::set1(1.0f)), V::add(m, V::set1(1.0f)));
+    auto t2 = V::mul(t, t);
+    auto series = V::add(V::set1(1.0f / 7), V::mul(t2, V::set1(1.0f / 9)));
+    series = V::add(V::set1(1.0f / 5), V::mul(t2, series));
+    series = V::add(V::set1(1.0f / 3), V::mul(t2, series));
+    series = V::add(V::set1(1.0f), V::mul(t2, series));
+    auto ln_m = V::mul(V::mul(V::set1(2.0f), t), series);
+    return V::add(V::to_float(exponent), V::mul(ln_m, V::set1(1.44269504f)));
+}
+
+// 2^y, y = k + f with integer k and f in [0, 1), 2^f = sqrt(2) * e^z with z = (f - 0.5) ln(2),
+// |z| < 0.347, the Taylor series of e^z is cut after z^6
+template <typename V> inline auto exp2_vector(typename V::f32 y) -> typename V::f32
+{
+    y = V::min(V::max(y, V::set1(-126.0f)), V::set1(127.0f));
+    auto k = V::truncate(y);
+    k = V::select_i(V::gt(V::to_float(k), y), V::add_i(k, V::set1_i(-1)), k);
+    auto z = V::mul(V::sub(V::sub(y, V::to_float(k)), V::set1(0.5f)), V::set1(0.69314718f));
+
+    auto series = V::add(V::set1(1.0f / 120), V::mul(z, V::set1(1.0f / 720)));
+    series = V::add(V::set1(1.0f / 24), V::mul(z, series));
+    series = V::add(V::set1(1.0f / 6), V::mul(z, series));
+    series = V::add(V::set1(0.5f), V::mul(z, series));
+    series = V::add(V::set1(1.0f), V::mul(z, series));
+    series = V::add(V::set1(1.0f), V::mul(z, series));
+
+    auto scale = V::as_float(V::slli(V::add_i(k, V::set1_i(127)), 23));
+    return V::mul(V::mul(series, V::set1(1.41421356f)), scale);
+}
+
+template <typename V>
+inline auto pow_vector(typename V::f32 x, typename V::f32 exponent) -> typename V::f32
+{
+    auto positive = V::gt(x, V::set1(0.0f));
+    // log2 of the bases <= 0 is garbage, those lanes are zeroed at the end
+    auto safe_x = V::select(positive, x, V::set1(1.0f));
+    auto result = exp2_vector<V>(V::mul(exponent, log2_vector<V>(safe_x)));
+    return V::select(positive, result, V::set1(0.0f));
+}
+
+template <typename V>
+auto pow_batch(const float *in, float exponent, float *out, size_t n) -> void
+{
+    auto vexponent = V::set1(exponent);
+    size_t i = 0;
+    for (; i + V::width <= n; i += V::width)
+        V::store(out + i, pow_vector<V>(V::load(in + i), vexponent));
+
+    for (; i < n; ++i)
+        out[i] = pow_vector<simd::Scalar>(in[i], exponent);
+}
+
+// BiomeRegistry::get_biome_within_range() for a vector of samples, the first biome that matches
+// wins, so a lane is only written once
+template <typename V>
+inline auto classify_vector(const BiomeRangeView &ranges, typename V::f32 moisture,
+                            typename V::f32 elevation) -> typename V::i32
+{
+    auto result = V::set1_i(-1);
+    auto found = V::lt(moisture, moisture); // All lanes false
+    for (size_t b = 0; b < ranges.count; ++b)
+    {
+        auto inside = V::mask_and(V::ge(moisture, V::set1(ranges.moisture_start[b])),
+                                  V::le(moisture, V::set1(ranges.moisture_end[b])));
+        inside = V::mask_and(inside, V::ge(elevation, V::set1(ranges.elevation_start[b])));
+        inside = V::mask_and(inside, V::le(elevation, V::set1(ranges.elevation_end[b])));
+        inside = V::mask_andnot(found, inside);
+        result = V::select_i(inside, V::set1_i(ranges.ids[b]), result);
+        found = V::mask_or(found, inside);
+        if (V::all(found))
+            break;
+    }
+    return result;
+}
+
+template <typename V>
+auto classify_biomes_batch(const BiomeRangeView &ranges, const float *moisture,
+                           const float *elevation, int *out, size_t n) -> void
+{
+    size_t i = 0;
+    for (; i + V::width <= n; i += V::width)
+        V::store_i(reinterpret_cast<int32_t *>(out + i),
+                   classify_vector<V>(ranges, V::load(moisture + i), V::load(elevation + i)));
+
+    for (; i < n; ++i)
+        out[i] = classify_vector<simd::Scalar>(ranges, moisture[i], elevation[i]);
+}
+
+// Same conversion as ChunkRenderer2D::get_color(), the value is truncated to an integer and the
+// lowest byte is used as the gray level
+template <typename V> inline auto gray_vector(typename V::f32 value) -> typename V::i32
+{
+    auto level = V::and_i(V::truncate(V::mul(value, V::set1(255.0f))), V::set1_i(0xFF));
+    return V::or_i(V::mul_i(level, V::set1_i(0x010101)),
+                   V::set1_i(static_cast<int32_t>(0xFF000000u)));
+}
+
+template <typename V>
+auto heightmap_to_rgba_batch(const float *values, unsigned char *rgba, size_t n) -> void
+{
+    size_t i = 0;
+    for (; i + V::width <= n; i += V::width)
+        V::store_i(reinterpret_cast<int32_t *>(rgba + 4 * i), gray_vector<V>(V::load(values + i)));
+
+    for (; i < n; ++i)
+        simd::Scalar::store_i(reinterpret_cast<int32_t *>(rgba + 4 * i),
+                              gray_vector<simd::Scalar>(values[i]));
+}
+
+template <typename V>
+auto palette_to_rgba_batch(const int *ids, const uint32_t *palette, unsigned char *rgba, size_t n)
+    -> void
+{
+    auto table = reinterpret_cast<const int32_t *>(palette);
+    size_t i = 0;
+    for (; i + V::width <= n; i += V::width)
+    {
+        auto index = V::add_i(V::load_i(reinterpret_cast<const int32_t *>(ids + i)), V::set1_i(1));
+        V::store_i(reinterpret_cast<int32_t *>(rgba + 4 * i), V::gather_i(table, index));
+    }
+
+    for (; i < n; ++i)
+        simd::Scalar::store_i(reinterpret_cast<int32_t *>(rgba + 4 * i), table[ids[i] + 1]);
+}
+
+template <typename V> inline auto quantize_vector(typename V::f32 value) -> typename V::i32
+{
+    auto clamped = V::min(V::max(value, V::set1(0.0f)), V::set1(1.0f));
+    return V::truncate(V::add(V::mul(clamped, V::set1(UNORM16_MAX)), V::set1(0.5f)));
+}
+
+template <typename V>
+inline auto dequantize_vector(typename V::i32 value) -> typename V::f32
+{
+    return V::mul(V::to_float(value), V::set1(1.0f / UNORM16_MAX));
+}
+
+template <typename V> auto quantize_unorm16_batch(const float *in, uint16_t *out, size_t n) -> void
+{
+    size_t i = 0;
+    for (; i + V::width <= n; i += V::width)
+        V::store_u16(out + i, quantize_vector<V>(V::load(in + i)));
+
+    for (; i < n; ++i)
+        simd::Scalar::store_u16(out + i, quantize_vector<simd::Scalar>(in[i]));
+}
+
+template <typename V>
+auto dequantize_unorm16_batch(const uint16_t *in, float *out, size_t n) -> void
+{
+    size_t i = 0;
+    for (; i + V::width <= n; i += V::width)
+        V::store(out + i, dequantize_vector<V>(V::load_u16(in + i)));
+
+    for (; i < n; ++i)
+        out[i] = dequantize_vector<simd::Scalar>(in[i]);
+}
+
+template <typename V>
+auto heightmap16_to_rgba_batch(const uint16_t *values, unsigned char *rgba, size_t n) -> void
+{
+    size_t i = 0;
+    for (; i + V::width <= n; i += V::width)
+        V::store_i(reinterpret_cast<int32_t *>(rgba + 4 * i),
+                   gray_vector<V>(dequantize_vector<V>(V::load_u16(values + i))));
+
+    for (; i < n; ++i)
+    {
+        auto value = dequantize_vector<simd::Scalar>(values[i]);
+        simd::Scalar::store_i(reinterpret_cast<int32_t *>(rgba + 4 * i),
+                              gray_vector<simd::Scalar>(value));
+    }
+}
+
+template <typename V>
+auto palette8_to_rgba_batch(const uint8_t *indices, const uint32_t *palette, unsigned char *rgba,
+                            size_t n) -> void
+{
+    auto table = reinterpret_cast<const int32_t *>(palette);
+    size_t i = 0;
+    for (; i + V::width <= n; i += V::width)
+        V::store_i(reinterpret_cast<int32_t *>(rgba + 4 * i),
+                   V::gather_i(table, V::load_u8(indices + i)));
+
+    for (; i < n; ++i)
+        simd::Scalar::store_i(reinterpret_cast<int32_t *>(rgba + 4 * i), table[indices[i]]);
+}
+
+// t = b * w, b = a - t, a = a + t for complex values split in real and imaginary parts
+template <typename V>
+inline auto butterfly(float *a_real, float *a_imag, float *b_real, float *b_imag,
+                      typename V::f32 w_real, typename V::f32 w_imag) -> void
+{
+    auto br = V::load(b_real), bi = V::load(b_imag);
+    auto tr = V::sub(V::mul(br, w_real), V::mul(bi, w_imag));
+    auto ti = V::add(V::mul(br, w_imag), V::mul(bi, w_real));
+    auto ar = V::load(a_real), ai = V::load(a_imag);
+    V::store(b_real, V::sub(ar, tr));
+    V::store(b_imag, V::sub(ai, ti));
+    V::store(a_real, V::add(ar, tr));
+    V::store(a_imag, V::add(ai, ti));
+}
+
+template <typename V>
+auto fft_butterfly_batch(float *a_real, float *a_imag, float *b_real, float *b_imag, float w_real,
+                         float w_imag, size_t n) -> void
+{
+    auto vw_real = V::set1(w_real), vw_imag = V::set1(w_imag);
+    size_t i = 0;
+    for (; i + V::width <= n; i += V::width)
+        butterfly<V>(a_real + i, a_imag + i, b_real + i, b_imag + i, vw_real, vw_imag);
+
+    for (; i < n; ++i)
+        butterfly<simd::Scalar>(a_real + i, a_imag + i, b_real + i, b_imag + i, w_real, w_imag);
+}
+
+// Integer hash of a seed and a position, mapped to a uniform value in [-sqrt(3), sqrt(3))
+template <typename V>
+inline auto white_noise_vector(typename V::i32 seed, typename V::i32 x, typename V::i32 y) ->
+    typename V::f32
+{
+    auto h = V::mul_i(seed, V::set1_i(0x27d4eb2d));
+    h = V::xor_i(h, V::mul_i(x, V::set1_i(501125321)));
+    h = V::mul_i(V::xor_i(h, V::srli(h, 15)), V::set1_i(0x2c1b3c6d));
+    h = V::xor_i(h, V::mul_i(y, V::set1_i(1136930381)));
+    h = V::mul_i(V::xor_i(h, V::srli(h, 16)), V::set1_i(0x7feb352d));
+    h = V::mul_i(V::xor_i(h, V::srli(h, 15)), V::set1_i(static_cast<int32_t>(0x846ca68bu)));
+    h = V::xor_i(h, V::srli(h, 16));
+    auto uniform = V::mul(V::to_float(V::srli(h, 8)), V::set1(1.0f / 16777216.0f));
+    return V::mul(V::sub(uniform, V::set1(0.5f)), V::set1(3.4641016f));
+}
+
+template <typename V>
+auto white_noise_batch(int seed, int x, int y, float *out, size_t n) -> void
+{
+    int32_t lanes[V::width];
+    for (size_t k = 0; k < V::width; ++k)
+        lanes[k] = static_cast<int32_t>(k);
+    auto offsets = V::load_i(lanes);
+    auto vseed = V::set1_i(seed), vy = V::set1_i(y);
+    size_t i = 0;
+    for (; i + V::width <= n; i += V::width)
+    {
+        auto vx = V::add_i(V::set1_i(x), V::add_i(offsets, V::set1_i(static_cast<int32_t>(i))));
+        V::store(out + i, white_noise_vector<V>(vseed, vx, vy));
+    }
+
+    for (; i < n; ++i)
+    {
+        auto xi = simd::Scalar::add_i(x, static_cast<int32_t>(i));
+        out[i] = white_noise_vector<simd::Scalar>(seed, xi, y);
+    }
+}
+
+// FastNoiseLite::Hash for 2D positions
+template <typename V>
+inline auto warp_hash(typename V::i32 seed, typename V::i32 x_primed, typename V::i32 y_primed) ->
+    typename V::i32
+{
+    return V::mul_i(V::xor_i(V::xor_i(seed, x_primed), y_primed), V::set1_i(0x27d4eb2d));
+}
+
+// Contribution of a lattice vertex to the simplex domain warp, FastNoiseLite::GradCoordOut when
+// Reduced, else FastNoiseLite::GradCoordDual. (x, y) is the position relative to the vertex and a
+// its falloff, vertices with a <= 0 add nothing
+template <typename V, bool Reduced>
+inline auto add_warp_vertex(typename V::i32 seed, typename V::i32 i, typename V::i32 j,
+                            typename V::f32 x, typename V::f32 y, typename V::f32 a,
+                            typename V::f32 &vx, typename V::f32 &vy) -> void
+{
+    auto hash = warp_hash<V>(seed, i, j);
+    typename V::f32 xo, yo;
+    if constexpr (Reduced)
+    {
+        auto index = V::and_i(hash, V::set1_i(255 << 1));
+        xo = V::gather(rand_vecs_2d, index);
+        yo = V::gather(rand_vecs_2d, V::or_i(index, V::set1_i(1)));
+    }
+    else
+    {
+        auto index1 = V::and_i(hash, V::set1_i(127 << 1));
+        auto index2 = V::and_i(V::srai(hash, 7), V::set1_i(255 << 1));
+        auto value = V::add(V::mul(x, V::gather(gradients_2d, index1)),
+                            V::mul(y, V::gather(gradients_2d, V::or_i(index1, V::set1_i(1)))));
+        xo = V::mul(value, V::gather(rand_vecs_2d, index2));
+        yo = V::mul(value, V::gather(rand_vecs_2d, V::or_i(index2, V::set1_i(1))));
+    }
+    auto a2 = V::mul(a, a);
+    auto a4 = V::mul(a2, a2);
+    auto inside = V::gt(a, V::set1(0.0f));
+    vx = V::add(vx, V::select(inside, V::mul(a4, xo), V::set1(0.0f)));
+    vy = V::add(vy, V::select(inside, V::mul(a4, yo), V::set1(0.0f)));
+}
+
+// FastNoiseLite::SingleDomainWarpSimplexGradient with the branches replaced by selects, x and y
+// are already skewed (TransformDomainWarpCoordinate). Returns the unscaled warp in vx and vy
+template <typename V, bool Reduced>
+inline auto simplex_warp_vector(typename V::i32 seed, typename V::f32 frequency, typename V::f32 x,
+                                typename V::f32 y, typename V::f32 &vx, typename V::f32 &vy)
+    -> void
+{
+    using f32 = typename V::f32;
+    using i32 = typename V::i32;
+
+    x = V::mul(x, frequency);
+    y = V::mul(y, frequency);
+    i32 i = fast_floor<V>(x);
+    i32 j = fast_floor<V>(y);
+    f32 xi = V::sub(x, V::to_float(i));
+    f32 yi = V::sub(y, V::to_float(j));
+    f32 t = V::mul(V::add(xi, yi), V::set1(G2));
+    f32 x0 = V::sub(xi, t);
+    f32 y0 = V::sub(yi, t);
+    i = V::mul_i(i, V::set1_i(PRIME_X));
+    j = V::mul_i(j, V::set1_i(PRIME_Y));
+
+    vx = V::set1(0.0f);
+    vy = V::set1(0.0f);
+    f32 a = V::sub(V::sub(V::set1(0.5f), V::mul(x0, x0)), V::mul(y0, y0));
+    add_warp_vertex<V, Reduced>(seed, i, j, x0, y0, a, vx, vy);
+
+    f32 c = V::add(V::mul(V::set1(2 * (1 - 2 * G2) * (1 / G2 - 2)), t),
+                   V::add(V::set1(-2 * (1 - 2 * G2) * (1 - 2 * G2)), a));
+    f32 x2 = V::add(x0, V::set1(2 * G2 - 1));
+    f32 y2 = V::add(y0, V::set1(2 * G2 - 1));
+    add_warp_vertex<V, Reduced>(seed, V::add_i(i, V::set1_i(PRIME_X)),
+                                V::add_i(j, V::set1_i(PRIME_Y)), x2, y2, c, vx, vy);
+
+    // The third vertex is (0, 1) above the diagonal and (1, 0) below it
+    auto upper = V::gt(y0, x0);
+    f32 x1 = V::add(x0, V::select(upper, V::set1(G2), V::set1(G2 - 1)));
+    f32 y1 = V::add(y0, V::select(upper, V::set1(G2 - 1), V::set1(G2)));
+    f32 b = V::sub(V::sub(V::set1(0.5f), V::mul(x1, x1)), V::mul(y1, y1));
+    i32 ib = V::select_i(upper, i, V::add_i(i, V::set1_i(PRIME_X)));
+    i32 jb = V::select_i(upper, V::add_i(j, V::set1_i(PRIME_Y)), j);
+    add_warp_vertex<V, Reduced>(seed, ib, jb, x1, y1, b, vx, vy);
+}
+
+template <typename V> inline auto hermite(typename V::f32 t) -> typename V::f32
+{
+    return V::mul(V::mul(t, t), V::sub(V::set1(3.0f), V::mul(V::set1(2.0f), t)));
+}
+
+template <typename V>
+inline auto lerp(typename V::f32 a, typename V::f32 b, typename V::f32 t) -> typename V::f32
+{
+    return V::add(a, V::mul(t, V::sub(b, a)));
+}
+
+// FastNoiseLite::SingleDomainWarpBasicGrid, returns the unscaled warp in vx and vy
+template <typename V>
+inline auto basic_grid_warp_vector(typename V::i32 seed, typename V::f32 frequency,
+                                   typename V::f32 x, typename V::f32 y, typename V::f32 &vx,
+                                   typename V::f32 &vy) -> void
+{
+    using f32 = typename V::f32;
+    using i32 = typename V::i32;
+
+    f32 xf = V::mul(x, frequency);
+    f32 yf = V::mul(y, frequency);
+    i32 x0 = fast_floor<V>(xf);
+    i32 y0 = fast_floor<V>(yf);
+    f32 xs = hermite<V>(V::sub(xf, V::to_float(x0)));
+    f32 ys = hermite<V>(V::sub(yf, V::to_float(y0)));
+    x0 = V::mul_i(x0, V::set1_i(PRIME_X));
+    y0 = V::mul_i(y0, V::set1_i(PRIME_Y));
+    i32 x1 = V::add_i(x0, V::set1_i(PRIME_X));
+    i32 y1 = V::add_i(y0, V::set1_i(PRIME_Y));
+
+    auto corner = [seed](i32 xp, i32 yp, f32 &cx, f32 &cy)
+    {
+        auto index = V::and_i(warp_hash<V>(seed, xp, yp), V::set1_i(255 << 1));
+        cx = V::gather(rand_vecs_2d, index);
+        cy = V::gather(rand_vecs_2d, V::or_i(index, V::set1_i(1)));
+    };
+    f32 x00, y00, x10, y10, x01, y01, x11, y11;
+    corner(x0, y0, x00, y00);
+    corner(x1, y0, x10, y10);
+    corner(x0, y1, x01, y01);
+    corner(x1, y1, x11, y11);
+
+    vx = lerp<V>(lerp<V>(x00, x10, xs), lerp<V>(x01, x11, xs), ys);
+    vy = lerp<V>(lerp<V>(y00, y10, xs), lerp<V>(y01, y11, xs), ys);
+}
+
+// FastNoiseLite::DomainWarpSingle for 2D, warps (x, y) in place
+template <typename V>
+inline auto domain_warp_vector(int type, typename V::i32 seed, typename V::f32 frequency,
+                               typename V::f32 amplitude, typename V::f32 &x, typename V::f32 &y)
+    -> void
+{
+    typename V::f32 vx, vy;
+    if (type == DOMAIN_WARP_BASIC_GRID)
+        basic_grid_warp_vector<V>(seed, frequency, x, y, vx, vy);
+    else
+    {
+        // TransformDomainWarpCoordinate, the skew of OpenSimplex2
+        auto s = V::mul(V::add(x, y), V::set1(F2));
+        auto xs = V::add(x, s);
+        auto ys = V::add(y, s);
+        if (type == DOMAIN_WARP_OPENSIMPLEX2_REDUCED)
+        {
+            simplex_warp_vector<V, true>(seed, frequency, xs, ys, vx, vy);
+            amplitude = V::mul(amplitude, V::set1(16.0f));
+        }
+        else
+        {
+            simplex_warp_vector<V, false>(seed, frequency, xs, ys, vx, vy);
+            amplitude = V::mul(amplitude, V::set1(38.283687591552734375f));
+        }
+    }
+    x = V::add(x, V::mul(vx, amplitude));
+    y = V::add(y, V::mul(vy, amplitude));
+}
+
+template <typename V>
+auto domain_warp_batch(int type, int seed, float frequency, float amplitude, float *xs, float *ys,
+                       size_t n) -> void
+{
+    auto vseed = V::set1_i(seed);
+    auto vfrequency = V::set1(frequency);
+    auto vamplitude = V::set1(amplitude);
+    size_t i = 0;
+    for (; i + V::width <= n; i += V::width)
+    {
+        auto x = V::load(xs + i);
+        auto y = V::load(ys + i);
+        domain_warp_vector<V>(type, vseed, vfrequency, vamplitude, x, y);
+        V::store(xs + i, x);
+        V::store(ys + i, y);
+    }
+
+    for (; i < n; ++i)
+        domain_warp_vector<simd::Scalar>(type, seed, frequency, amplitude, xs[i], ys[i]);
+}
+
+template <typename V> auto make_kernel_table(const char *name) -> KernelTable
+{
+    KernelTable table;
+    table.name = name;
+    table.opensimplex2s = opensimplex2s_batch<V>;
+    table.opensimplex2s_row = opensimplex2s_row_batch<V>;
+    table.opensimplex2s_row_gradient = opensimplex2s_row_gradient_batch<V>;
+    table.pow = pow_batch<V>;
+    table.classify_biomes = classify_biomes_batch<V>;
+    table.heightmap_to_rgba = heightmap_to_rgba_batch<V>;
+    table.palette_to_rgba = palette_to_rgba_batch<V>;
+    table.quantize_unorm16 = quantize_unorm16_batch<V>;
+    table.dequantize_unorm16 = dequantize_unorm16_batch<V>;
+    table.heightmap16_to_rgba = heightmap16_to_rgba_batch<V>;
+    table.palette8_to_rgba = palette8_to_rgba_batch<V>;
+    table.fft_butterfly = fft_butterfly_batch<V>;
+    table.white_noise = white_noise_batch<V>;
+    table.domain_warp = domain_warp_batch<V>;
+    return table;
+}
+
+} // namespace
+
+#endif // A_KERNELS_IMPL_H
@@ -0,0 +1,11 @@
+#include "kernels_impl.hpp"
+
+auto sse2_kernels() -> const KernelTable *
+{
+#ifdef SIMD_HAS_SSE2
+    static const KernelTable table = make_kernel_table<simd::Sse2>("SSE2");
+    return &table;
+#else
+    return nullptr;
+#endif
+}
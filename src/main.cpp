@@ -1,4 +1,5 @@
 #include "engine.hpp"
+#include "kernels.hpp"
 #include <filesystem>
 using namespace logger;
 
@@ -10,6 +11,8 @@ auto main(int argc, char *argv[]) -> int
 {
     try
     {
+        // Picks the kernels for this CPU once, before any chunk is generated
+        info("Using {} kernels", kernels().name);
         Engine engine(std::filesystem::path(DATA_FOLDER));
         engine.run();
     }
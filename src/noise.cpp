@@ -1,12 +1,22 @@
 #include "noise.hpp"
 #include "logger.h"
+#include "kernels.hpp"
+#include "noise_graph.hpp"
+#include "spectral.hpp"
 using namespace logger;
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <time.h>
+#include <utility>
 
 NoiseGenerator::NoiseGenerator()
 {
     seed_ = static_cast<int>(time(NULL));
-    noise.SetNoiseType(FastNoiseLite::NoiseType_OpenSimplex2S);
+    frequency_ = 0.01f;
+    noise_type_ = FastNoiseLite::NoiseType_OpenSimplex2S;
+    noise.SetFrequency(frequency_);
+    noise.SetNoiseType(noise_type_);
     /*
     noise.SetFrequency(0.01f);
     noise.SetFractalLacunarity(2.0f);
@@ -16,10 +26,13 @@ NoiseGenerator::NoiseGenerator()
     noise.SetSeed(seed_);
 }
 
-NoiseGenerator::NoiseGenerator(int seed)
+NoiseGenerator::NoiseGenerator(int seed, FastNoiseLite::NoiseType noise_type)
 {
     seed_ = seed;
-    noise.SetNoiseType(FastNoiseLite::NoiseType_OpenSimplex2S);
+    frequency_ = 0.01f;
+    noise_type_ = noise_type;
+    noise.SetFrequency(frequency_);
+    noise.SetNoiseType(noise_type_);
     noise.SetSeed(seed_);
 }
 
@@ -31,15 +44,283 @@ auto NoiseGenerator::set_seed(int seed) -> void
     noise.SetSeed(seed_);
 }
 
+auto NoiseGenerator::frequency() const -> float { return frequency_; }
+
+auto NoiseGenerator::noise_type() const -> FastNoiseLite::NoiseType { return noise_type_; }
+
 auto NoiseGenerator::at(float x, float y) const -> float
 {
     return noise.GetNoise(x, y) / 2.0f + 0.5f;
 }
 
+auto NoiseGenerator::at_batch(const float *xs, const float *ys, float *out, size_t n) const -> void
+{
+    if (noise_type_ == FastNoiseLite::NoiseType_OpenSimplex2S)
+    {
+        kernels().opensimplex2s(seed_, frequency_, xs, ys, out, n);
+        return;
+    }
+    for (size_t i = 0; i < n; ++i)
+        out[i] = at(xs[i], ys[i]);
+}
+
+auto NoiseGenerator::at_row(const float *xs, float y, float *out, size_t n) const -> void
+{
+    if (noise_type_ == FastNoiseLite::NoiseType_OpenSimplex2S)
+    {
+        kernels().opensimplex2s_row(seed_, frequency_, xs, y, out, n);
+        return;
+    }
+    for (size_t i = 0; i < n; ++i)
+        out[i] = at(xs[i], y);
+}
+
+auto NoiseGenerator::at_row_gradient(const float *xs, float y, float *out, float *out_dx,
+                                     float *out_dy, size_t n) const -> void
+{
+    if (noise_type_ == FastNoiseLite::NoiseType_OpenSimplex2S)
+    {
+        kernels().opensimplex2s_row_gradient(seed_, frequency_, xs, y, out, out_dx, out_dy, n);
+        return;
+    }
+    float h = GRADIENT_DIFFERENCE_STEP / frequency_;
+    float inv_step = 0.5f / h;
+    for (size_t i = 0; i < n; ++i)
+    {
+        out[i] = at(xs[i], y);
+        out_dx[i] = (at(xs[i] + h, y) - at(xs[i] - h, y)) * inv_step;
+        out_dy[i] = (at(xs[i], y + h) - at(xs[i], y - h)) * inv_step;
+    }
+}
+
+static_assert(DOMAIN_WARP_OPENSIMPLEX2 == FastNoiseLite::DomainWarpType_OpenSimplex2 &&
+                  DOMAIN_WARP_OPENSIMPLEX2_REDUCED ==
+                      FastNoiseLite::DomainWarpType_OpenSimplex2Reduced &&
+                  DOMAIN_WARP_BASIC_GRID == FastNoiseLite::DomainWarpType_BasicGrid,
+              "The domain warp kernel types must match FastNoiseLite");
+
+// FastNoiseLite multiplies the warp amplitude by its fractal bounding, which is 1 / 1.75 for the
+// default fractal settings that NoiseGenerator keeps
+#define DOMAIN_WARP_FRACTAL_BOUNDING (1 / 1.75f)
+
+auto NoiseGenerator::set_domain_warp(FastNoiseLite::DomainWarpType type, float amplitude) -> void
+{
+    warp_type_ = type;
+    warp_amplitude_ = amplitude;
+    noise.SetDomainWarpType(type);
+    noise.SetDomainWarpAmp(amplitude);
+}
+
+auto NoiseGenerator::warp(float &x, float &y) const -> void { noise.DomainWarp(x, y); }
+
+auto NoiseGenerator::warp_batch(float *xs, float *ys, size_t n) const -> void
+{
+    kernels().domain_warp(static_cast<int>(warp_type_), seed_, frequency_,
+                          warp_amplitude_ * DOMAIN_WARP_FRACTAL_BOUNDING, xs, ys, n);
+}
+
+auto OctaveKey::operator==(const OctaveKey &other) const -> bool
+{
+    return seed == other.seed && noise_type == other.noise_type &&
+           generator_frequency == other.generator_frequency && frequency == other.frequency &&
+           scale == other.scale && offset_x == other.offset_x && offset_y == other.offset_y &&
+           width == other.width && height == other.height && step == other.step &&
+           halo == other.halo;
+}
+
+auto OctaveKeyHash::operator()(const OctaveKey &key) const -> size_t
+{
+    size_t hash = 0;
+    auto combine = [&hash](size_t value)
+    { hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2); };
+    combine(std::hash<int>()(key.seed));
+    combine(std::hash<int>()(static_cast<int>(key.noise_type)));
+    combine(std::hash<float>()(key.generator_frequency));
+    combine(std::hash<float>()(key.frequency));
+    combine(std::hash<float>()(key.scale));
+    combine(std::hash<float>()(key.offset_x));
+    combine(std::hash<float>()(key.offset_y));
+    combine(std::hash<int>()(key.width));
+    combine(std::hash<int>()(key.height));
+    combine(std::hash<int>()(key.step));
+    combine(std::hash<int>()(key.halo));
+    return hash;
+}
+
+OctaveCache::OctaveCache(size_t capacity_bytes) : capacity_bytes(capacity_bytes), size_bytes(0) {}
+
+auto OctaveCache::get(const OctaveKey &key) -> Tile
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(key);
+    if (it == index.end())
+        return nullptr;
+    // Move the entry to the front, the back is the least recently used
+    entries.splice(entries.begin(), entries, it->second);
+    return it->second->second;
+}
+
+auto OctaveCache::put(const OctaveKey &key, Tile tile) -> void
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (capacity_bytes == 0)
+        return;
+    auto it = index.find(key);
+    if (it != index.end())
+    {
+        size_bytes -= it->second->second->size() * sizeof(float);
+        entries.erase(it->second);
+        index.erase(it);
+    }
+    size_bytes += tile->size() * sizeof(float);
+    entries.emplace_front(key, std::move(tile));
+    index[key] = entries.begin();
+    evict();
+}
+
+auto OctaveCache::evict() -> void
+{
+    while (size_bytes > capacity_bytes && !entries.empty())
+    {
+        size_bytes -= entries.back().second->size() * sizeof(float);
+        index.erase(entries.back().first);
+        entries.pop_back();
+    }
+}
+
+auto OctaveCache::set_capacity(size_t capacity_bytes) -> void
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->capacity_bytes = capacity_bytes;
+    evict();
+}
+
+auto OctaveCache::clear() -> void
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    index.clear();
+    size_bytes = 0;
+}
+
+auto OctaveCache::size() const -> size_t
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return size_bytes;
+}
+
+auto parse_noise_type(const std::string &name) -> FastNoiseLite::NoiseType
+{
+    if (name == "opensimplex2s")
+        return FastNoiseLite::NoiseType_OpenSimplex2S;
+    if (name == "opensimplex2")
+        return FastNoiseLite::NoiseType_OpenSimplex2;
+    if (name == "cellular")
+        return FastNoiseLite::NoiseType_Cellular;
+    if (name == "perlin")
+        return FastNoiseLite::NoiseType_Perlin;
+    if (name == "value_cubic")
+        return FastNoiseLite::NoiseType_ValueCubic;
+    if (name == "value")
+        return FastNoiseLite::NoiseType_Value;
+    throw std::runtime_error("Unknown noise type: " + name);
+}
+
+auto parse_domain_warp_type(const std::string &name) -> FastNoiseLite::DomainWarpType
+{
+    if (name == "opensimplex2")
+        return FastNoiseLite::DomainWarpType_OpenSimplex2;
+    if (name == "opensimplex2_reduced")
+        return FastNoiseLite::DomainWarpType_OpenSimplex2Reduced;
+    if (name == "basic_grid")
+        return FastNoiseLite::DomainWarpType_BasicGrid;
+    throw std::runtime_error("Unknown domain warp type: " + name);
+}
+
+// Row function of a NoiseMap with a fixed number of octaves, the octave loop is unrolled and the
+// noise type is resolved at compile time. Only noise types with batch kernels are specialized
+template <size_t Octaves, FastNoiseLite::NoiseType Type> struct FixedNoiseMap
+{
+};
+
+template <size_t Octaves> struct FixedNoiseMap<Octaves, FastNoiseLite::NoiseType_OpenSimplex2S>
+{
+    template <size_t I>
+    static auto octave(const NoiseMap &map, const KernelTable &table,
+                       const std::vector<float> &columns, const std::vector<float> &rows, int y,
+                       int width, int height, float *values, float *samples) -> void
+    {
+        const auto &generator = map.generators[I];
+        table.opensimplex2s_row(generator.seed(), generator.frequency(), &columns[I * width],
+                                rows[I * height + y], samples, width);
+        float amplitude = map.amplitudes[I];
+        if constexpr (I == 0)
+        {
+            for (int x = 0; x < width; ++x)
+                values[x] = amplitude * samples[x];
+        }
+        else
+        {
+            for (int x = 0; x < width; ++x)
+                values[x] += amplitude * samples[x];
+        }
+    }
+
+    template <size_t... I>
+    static auto octaves(const NoiseMap &map, const std::vector<float> &columns,
+                        const std::vector<float> &rows, int y, int width, int height,
+                        float *values, float *samples, std::index_sequence<I...>) -> void
+    {
+        const auto &table = kernels();
+        (octave<I>(map, table, columns, rows, y, width, height, values, samples), ...);
+    }
+
+    static auto create_row(const NoiseMap &map, const std::vector<float> &columns,
+                           const std::vector<float> &rows, int y, int width, int height,
+                           float *values, float *samples) -> void
+    {
+        octaves(map, columns, rows, y, width, height, values, samples,
+                std::make_index_sequence<Octaves>());
+        map.finish_row(values, width);
+    }
+};
+
+template <FastNoiseLite::NoiseType Type, size_t... N>
+static constexpr auto fixed_row_functions(std::index_sequence<N...>)
+{
+    return std::array{&FixedNoiseMap<N + 1, Type>::create_row...};
+}
+
+static constexpr auto opensimplex2s_row_functions =
+    fixed_row_functions<FastNoiseLite::NoiseType_OpenSimplex2S>(
+        std::make_index_sequence<MAX_FIXED_OCTAVES>());
+
+static auto pick_redistribution(float exponent, bool fast_math) -> Redistribution
+{
+    if (exponent == 1.0f)
+        return Redistribution::IDENTITY;
+    if (exponent == 2.0f)
+        return Redistribution::SQUARE;
+    if (exponent == 3.0f)
+        return Redistribution::CUBE;
+    if (exponent == 4.0f)
+        return Redistribution::FOURTH;
+    if (exponent == 0.5f)
+        return Redistribution::SQRT;
+    if (exponent == 1.5f)
+        return Redistribution::ONE_AND_HALF;
+    if (exponent == 2.5f)
+        return Redistribution::TWO_AND_HALF;
+    return fast_math ? Redistribution::FAST : Redistribution::POW;
+}
+
 NoiseMap::NoiseMap(const std::vector<float> &frequencies, const std::vector<float> &amplitudes,
-                   NoiseGenerator base_generator, float fudge, float redistribution)
+                   NoiseGenerator base_generator, float fudge, float redistribution,
+                   bool fast_math, float adaptive_tolerance)
     : frequencies(frequencies), amplitudes(amplitudes), base_generator(base_generator),
-      fudge(fudge), redistribution(redistribution)
+      fudge(fudge), redistribution(redistribution),
+      redistribution_mode_(pick_redistribution(redistribution, fast_math)),
+      adaptive_tolerance(adaptive_tolerance)
 {
     if (frequencies.size() != amplitudes.size())
         throw std::logic_error("Frequencies vector size does not match amplitude size");
@@ -52,30 +333,923 @@ NoiseMap::NoiseMap(const std::vector<float> &frequencies, const std::vector<floa
         copy_generator.set_seed(base_generator.seed() + i * 7 + i / 2 + 1331);
         generators.push_back(copy_generator);
     }
+    set_octaves();
 }
 
-auto NoiseMap::create_noise_map(float offset_x, float offset_y, int width, int height, float scale,
-                                std::vector<float> &noise_map) const -> void
+auto NoiseMap::set_octaves() -> void
+{
+    float amplitude_sum = 0;
+    for (auto amplitude : amplitudes)
+        amplitude_sum += amplitude;
+    inv_amplitude_sum = 1.0f / amplitude_sum;
+
+    auto octaves = generators.size();
+    if (base_generator.noise_type() == FastNoiseLite::NoiseType_OpenSimplex2S && octaves >= 1 &&
+        octaves <= MAX_FIXED_OCTAVES)
+        row_function = opensimplex2s_row_functions[octaves - 1];
+    else
+        row_function = dynamic_row;
+}
+
+auto NoiseMap::lod(int level) const -> NoiseMap
+{
+    NoiseMap result = *this;
+    // The spectral backend costs the same for any number of octaves
+    if (level <= 0 || frequencies.empty() || spectral)
+        return result;
+    auto finest = *std::max_element(frequencies.begin(), frequencies.end());
+    auto lowest = std::min_element(frequencies.begin(), frequencies.end()) - frequencies.begin();
+    float max_frequency = finest / static_cast<float>(1 << level);
+    result.frequencies.clear();
+    result.amplitudes.clear();
+    result.generators.clear();
+    for (size_t i = 0; i < frequencies.size(); ++i)
+    {
+        // Each octave keeps its generator and its seed
+        if (frequencies[i] <= max_frequency || static_cast<ptrdiff_t>(i) == lowest)
+        {
+            result.frequencies.push_back(frequencies[i]);
+            result.amplitudes.push_back(amplitudes[i]);
+            result.generators.push_back(generators[i]);
+        }
+    }
+    result.set_octaves();
+    return result;
+}
+
+auto NoiseMap::from_config(const confparse::Config &cfg, const std::string &prefix, int seed)
+    -> NoiseMap
+{
+    auto redistribution = cfg.get(prefix + ".redistribution").try_parse<float>(1.0f);
+    auto fudge = cfg.get(prefix + ".fudge").parse<float>();
+    auto octaves = cfg.get(prefix + ".octaves").parse<int>();
+    auto noise_type = cfg.get(prefix + ".noise_type");
+    auto fast_math = cfg.get(prefix + ".fast_math").try_parse<bool>(false);
+    auto adaptive_tolerance = cfg.get(prefix + ".adaptive_tolerance").try_parse<float>(0.0f);
+    auto backend = cfg.get(prefix + ".backend");
+
+    std::vector<float> frequencies;
+    std::vector<float> amplitudes;
+
+    for (int i = 1; i <= octaves; ++i)
+    {
+        auto frequency = cfg.get(prefix + ".frequency" + std::to_string(i)).parse<float>();
+        auto amplitude = cfg.get(prefix + ".amplitude" + std::to_string(i)).parse<float>();
+        frequencies.push_back(frequency);
+        amplitudes.push_back(amplitude);
+    }
+
+    NoiseGenerator base_generator{seed, noise_type.is_empty()
+                                            ? FastNoiseLite::NoiseType_OpenSimplex2S
+                                            : parse_noise_type(noise_type.as_string())};
+    NoiseMap noisemap(frequencies, amplitudes, base_generator, fudge, redistribution, fast_math,
+                      adaptive_tolerance);
+    if (!backend.is_empty() && backend.as_string() == "spectral")
+        noisemap.set_backend(NoiseBackend::SPECTRAL);
+    else if (!backend.is_empty() && backend.as_string() != "octaves")
+        throw std::runtime_error("Unknown noise backend: " + backend.as_string());
+    return noisemap;
+}
+
+auto NoiseMap::octave_count() const -> size_t { return generators.size(); }
+
+auto NoiseMap::redistribution_mode() const -> Redistribution { return redistribution_mode_; }
+
+auto NoiseMap::set_adaptive_tolerance(float tolerance) -> void { adaptive_tolerance = tolerance; }
+
+auto NoiseMap::backend() const -> NoiseBackend
+{
+    return spectral ? NoiseBackend::SPECTRAL : NoiseBackend::OCTAVES;
+}
+
+auto NoiseMap::set_backend(NoiseBackend backend) -> void
+{
+    if (backend == NoiseBackend::OCTAVES)
+        spectral.reset();
+    else if (!spectral)
+        spectral = std::make_shared<SpectralSynthesis>(base_generator.seed(), amplitudes);
+}
+
+auto NoiseMap::fingerprint() const -> uint64_t
+{
+    return Fingerprint()
+        .add(frequencies)
+        .add(amplitudes)
+        .add(base_generator.seed())
+        .add(static_cast<int>(base_generator.noise_type()))
+        .add(base_generator.frequency())
+        .add(fudge)
+        .add(redistribution)
+        .add(static_cast<int>(redistribution_mode_))
+        .add(adaptive_tolerance)
+        .add(static_cast<int>(backend()))
+        .value();
+}
+
+auto NoiseMap::generator(size_t octave) const -> const NoiseGenerator &
+{
+    return generators[octave];
+}
+
+ChunkCoordinates::ChunkCoordinates(float offset_x, float offset_y, int width, int height,
+                                   int halo)
+    : offset_x(offset_x), offset_y(offset_y), inv_width(1.0f / width), inv_height(1.0f / height),
+      halo(halo), columns(width + 2 * halo), rows(height + 2 * halo)
+{
+    for (int x = 0; x < width + 2 * halo; ++x)
+        columns[x] = column(x);
+    for (int y = 0; y < height + 2 * halo; ++y)
+        rows[y] = row(y);
+}
+
+auto ChunkCoordinates::column(int x) const -> float
+{
+    return offset_x + static_cast<float>(x - halo) * inv_width - 0.5f;
+}
+
+auto ChunkCoordinates::row(int y) const -> float
+{
+    return offset_y + static_cast<float>(y - halo) * inv_height - 0.5f;
+}
+
+auto NoiseMap::octave_coordinates(const ChunkCoordinates &chunk, float scale,
+                                  std::vector<float> &columns, std::vector<float> &rows,
+                                  int row_begin, int row_end) const -> void
+{
+    auto octaves = frequencies.size();
+    auto width = chunk.columns.size();
+    auto height = chunk.rows.size();
+    columns.resize(octaves * width);
+    rows.resize(octaves * height);
+    auto last_row = row_end < 0 ? height : static_cast<size_t>(row_end);
+
+    for (size_t x = 0; x < width; ++x)
+    {
+        float nx = scale * chunk.columns[x];
+        for (size_t i = 0; i < octaves; ++i)
+            columns[i * width + x] = frequencies[i] * nx;
+    }
+
+    for (auto y = static_cast<size_t>(row_begin); y < last_row; ++y)
+    {
+        float ny = scale * chunk.rows[y];
+        for (size_t i = 0; i < octaves; ++i)
+            rows[i * height + y] = frequencies[i] * ny;
+    }
+}
+
+auto NoiseMap::octave_steps(int width, int height, float scale) const -> std::vector<int>
+{
+    std::vector<int> steps(frequencies.size(), 1);
+    if (adaptive_tolerance <= 0.0f)
+        return steps;
+
+    // Largest spacing of the samples, in noise units, that keeps the interpolation error below
+    // the tolerance
+    float max_spacing = std::cbrt(adaptive_tolerance / ADAPTIVE_ERROR_CONSTANT);
+    int max_step = std::max(width, height);
+    for (size_t i = 0; i < frequencies.size(); ++i)
+    {
+        // Distance between two neighbouring pixels in noise units
+        float pixel_spacing = generators[i].frequency() * std::fabs(scale * frequencies[i]) /
+                              static_cast<float>(std::min(width, height));
+        if (pixel_spacing <= 0.0f)
+            steps[i] = max_step;
+        else
+            steps[i] = static_cast<int>(
+                std::clamp(max_spacing / pixel_spacing, 1.0f, static_cast<float>(max_step)));
+    }
+    return steps;
+}
+
+// Catmull-Rom weights of the samples before, at, after and two after t, for t in [0, 1)
+static auto cubic_weights(float t, float *weights) -> void
+{
+    float t2 = t * t;
+    float t3 = t2 * t;
+    weights[0] = 0.5f * (-t + 2.0f * t2 - t3);
+    weights[1] = 0.5f * (2.0f - 5.0f * t2 + 3.0f * t3);
+    weights[2] = 0.5f * (t + 4.0f * t2 - 3.0f * t3);
+    weights[3] = 0.5f * (-t2 + t3);
+}
+
+// Node and weights of every pixel for a coarse grid with a node every step pixels, the grid has a
+// node one step before the first pixel, so pixel i is interpolated from nodes[i] to nodes[i] + 3.
+// Pixel i lies first + i * stride pixels after the second node
+static auto cubic_stencil(int size, int step, std::vector<int> &nodes, std::vector<float> &weights,
+                          int first = 0, int stride = 1) -> void
+{
+    nodes.resize(size);
+    weights.resize(static_cast<size_t>(size) * 4);
+    float inv_step = 1.0f / static_cast<float>(step);
+    for (int i = 0; i < size; ++i)
+    {
+        int position = first + i * stride;
+        nodes[i] = position / step;
+        cubic_weights(static_cast<float>(position % step) * inv_step, &weights[i * 4]);
+    }
+}
+
+auto NoiseMap::create_octave(const ChunkCoordinates &chunk, float scale, size_t octave, int step,
+                             std::vector<float> &tile) const -> void
 {
-    int idx = 0;
+    int width = static_cast<int>(chunk.columns.size());
+    int height = static_cast<int>(chunk.rows.size());
+    tile.resize(static_cast<size_t>(width) * height);
+    const auto &generator = generators[octave];
+    float frequency = frequencies[octave];
+
+    if (step <= 1)
+    {
+        std::vector<float> columns(width);
+        for (int x = 0; x < width; ++x)
+            columns[x] = frequency * (scale * chunk.columns[x]);
+        for (int y = 0; y < height; ++y)
+            generator.at_row(columns.data(), frequency * (scale * chunk.rows[y]),
+                             &tile[static_cast<size_t>(y) * width], width);
+        return;
+    }
+
+    // Nodes from one step before the first pixel to two steps after the node that covers the last
+    // pixel, the cubic stencil needs one node before and two after every pixel
+    int count_x = (width - 1) / step + 4;
+    int count_y = (height - 1) / step + 4;
+    std::vector<float> node_columns(count_x), node_rows(count_y);
+    for (int k = 0; k < count_x; ++k)
+        node_columns[k] = frequency * (scale * chunk.column((k - 1) * step));
+    for (int k = 0; k < count_y; ++k)
+        node_rows[k] = frequency * (scale * chunk.row((k - 1) * step));
 
+    std::vector<float> weights_x, weights_y;
+    std::vector<int> nodes_x, nodes_y;
+    cubic_stencil(width, step, nodes_x, weights_x);
+    cubic_stencil(height, step, nodes_y, weights_y);
+
+    // Evaluate every node row and upsample it along x
+    std::vector<float> samples(count_x), upsampled_rows(static_cast<size_t>(count_y) * width);
+    for (int k = 0; k < count_y; ++k)
+    {
+        generator.at_row(node_columns.data(), node_rows[k], samples.data(), count_x);
+        float *upsampled = &upsampled_rows[static_cast<size_t>(k) * width];
+        for (int x = 0; x < width; ++x)
+        {
+            const float *node = &samples[nodes_x[x]];
+            const float *weight = &weights_x[x * 4];
+            upsampled[x] = weight[0] * node[0] + weight[1] * node[1] + weight[2] * node[2] +
+                           weight[3] * node[3];
+        }
+    }
+
+    // Upsample along y
     for (int y = 0; y < height; ++y)
     {
+        const float *weight = &weights_y[y * 4];
+        const float *row0 = &upsampled_rows[static_cast<size_t>(nodes_y[y]) * width];
+        const float *row1 = row0 + width;
+        const float *row2 = row1 + width;
+        const float *row3 = row2 + width;
+        float *out = &tile[static_cast<size_t>(y) * width];
         for (int x = 0; x < width; ++x)
+            out[x] = weight[0] * row0[x] + weight[1] * row1[x] + weight[2] * row2[x] +
+                     weight[3] * row3[x];
+    }
+}
+
+auto NoiseMap::create_coarse_sum(const ChunkCoordinates &chunk, float scale,
+                                 const std::vector<int> &steps, std::vector<float> &sum) const
+    -> void
+{
+    sum.assign(chunk.columns.size() * chunk.rows.size(), 0.0f);
+    std::vector<float> tile;
+    for (size_t i = 0; i < frequencies.size(); ++i)
+    {
+        if (steps[i] <= 1)
+            continue;
+        create_octave(chunk, scale, i, steps[i], tile);
+        float amplitude = amplitudes[i];
+        for (size_t j = 0; j < sum.size(); ++j)
+            sum[j] += amplitude * tile[j];
+    }
+}
+
+auto NoiseMap::create_cached(const ChunkCoordinates &chunk, float scale,
+                             const std::vector<int> &steps, OctaveCache &cache,
+                             float *output) const -> void
+{
+    int width = static_cast<int>(chunk.columns.size());
+    int height = static_cast<int>(chunk.rows.size());
+    std::vector<OctaveCache::Tile> tiles(frequencies.size());
+    for (size_t i = 0; i < frequencies.size(); ++i)
+    {
+        const auto &generator = generators[i];
+        OctaveKey key{generator.seed(),  generator.noise_type(), generator.frequency(),
+                      frequencies[i],    scale,                  chunk.offset_x,
+                      chunk.offset_y,    width,                  height,
+                      steps[i],          chunk.halo};
+        tiles[i] = cache.get(key);
+        if (!tiles[i])
+        {
+            auto tile = std::make_shared<std::vector<float>>();
+            create_octave(chunk, scale, i, steps[i], *tile);
+            tiles[i] = tile;
+            cache.put(key, tiles[i]);
+        }
+    }
+
+    // Octaves are summed in the same order as create_row() and create_adaptive_row(), coarse
+    // octaves first, so the result is identical
+    for (int y = 0; y < height; ++y)
+    {
+        float *values = output + static_cast<size_t>(y) * width;
+        std::fill(values, values + width, 0.0f);
+        for (bool coarse : {true, false})
+        {
+            for (size_t i = 0; i < frequencies.size(); ++i)
+            {
+                if ((steps[i] > 1) != coarse)
+                    continue;
+                const float *samples = tiles[i]->data() + static_cast<size_t>(y) * width;
+                for (int x = 0; x < width; ++x)
+                    values[x] += amplitudes[i] * samples[x];
+            }
+        }
+        finish_row(values, width);
+    }
+}
+
+auto NoiseMap::dynamic_row(const NoiseMap &map, const std::vector<float> &columns,
+                           const std::vector<float> &rows, int y, int width, int height,
+                           float *values, float *samples) -> void
+{
+    std::fill(values, values + width, 0.0f);
+    for (size_t i = 0; i < map.frequencies.size(); ++i)
+    {
+        map.generators[i].at_row(&columns[i * width], rows[i * height + y], samples, width);
+        for (int x = 0; x < width; ++x)
+            values[x] += map.amplitudes[i] * samples[x];
+    }
+    map.finish_row(values, width);
+}
+
+auto NoiseMap::create_batch(const float *xs, const float *ys, float *values, float *samples,
+                            int n) const -> void
+{
+    float *octave_xs = samples;
+    float *octave_ys = samples + n;
+    float *octave_samples = samples + 2 * n;
+    std::fill(values, values + n, 0.0f);
+    for (size_t i = 0; i < frequencies.size(); ++i)
+    {
+        for (int j = 0; j < n; ++j)
+        {
+            octave_xs[j] = frequencies[i] * xs[j];
+            octave_ys[j] = frequencies[i] * ys[j];
+        }
+        generators[i].at_batch(octave_xs, octave_ys, octave_samples, n);
+        for (int j = 0; j < n; ++j)
+            values[j] += amplitudes[i] * octave_samples[j];
+    }
+    finish_row(values, n);
+}
+
+auto NoiseMap::finish_row(float *values, int width) const -> void
+{
+    for (int x = 0; x < width; ++x)
+        values[x] = values[x] * inv_amplitude_sum * fudge;
+
+    // The exponent is checked once per row, each case is a loop the compiler can vectorize
+    switch (redistribution_mode_)
+    {
+    case Redistribution::IDENTITY:
+        break;
+    case Redistribution::SQUARE:
+        for (int x = 0; x < width; ++x)
+            values[x] = values[x] * values[x];
+        break;
+    case Redistribution::CUBE:
+        for (int x = 0; x < width; ++x)
+            values[x] = values[x] * values[x] * values[x];
+        break;
+    case Redistribution::FOURTH:
+        for (int x = 0; x < width; ++x)
+        {
+            float square = values[x] * values[x];
+            values[x] = square * square;
+        }
+        break;
+    case Redistribution::SQRT:
+        for (int x = 0; x < width; ++x)
+            values[x] = std::sqrt(values[x]);
+        break;
+    case Redistribution::ONE_AND_HALF:
+        for (int x = 0; x < width; ++x)
+            values[x] = values[x] * std::sqrt(values[x]);
+        break;
+    case Redistribution::TWO_AND_HALF:
+        for (int x = 0; x < width; ++x)
+            values[x] = values[x] * values[x] * std::sqrt(values[x]);
+        break;
+    case Redistribution::POW:
+        for (int x = 0; x < width; ++x)
+            values[x] = std::powf(values[x], redistribution);
+        break;
+    case Redistribution::FAST:
+        kernels().pow(values, redistribution, values, width);
+        break;
+    }
+}
+
+auto NoiseMap::finish_gradient_row(const float *sums, const float *values, float *dx, float *dy,
+                                   int width) const -> void
+{
+    // value = (sum * k) ^ r, so d value / d sum = r * value / sum wherever the sum is not 0
+    float factor = inv_amplitude_sum * fudge;
+    for (int x = 0; x < width; ++x)
+    {
+        float derivative;
+        if (redistribution_mode_ == Redistribution::IDENTITY)
+            derivative = factor;
+        else if (sums[x] != 0.0f)
+            derivative = redistribution * values[x] / sums[x];
+        else
+            derivative = redistribution > 1.0f ? 0.0f : INFINITY;
+        dx[x] *= derivative;
+        dy[x] *= derivative;
+    }
+}
+
+auto NoiseMap::create_row(const std::vector<float> &columns, const std::vector<float> &rows, int y,
+                          int width, int height, float *values, float *samples) const -> void
+{
+    row_function(*this, columns, rows, y, width, height, values, samples);
+}
+
+auto NoiseMap::create_gradient_row(const ChunkCoordinates &chunk, float scale,
+                                   const std::vector<float> &columns,
+                                   const std::vector<float> &rows, int y, float *values, float *dx,
+                                   float *dy, float *samples) const -> void
+{
+    int width = static_cast<int>(chunk.columns.size());
+    int height = static_cast<int>(chunk.rows.size());
+    float *sample_dx = samples + width;
+    float *sample_dy = samples + 2 * width;
+    std::fill(values, values + width, 0.0f);
+    std::fill(dx, dx + width, 0.0f);
+    std::fill(dy, dy + width, 0.0f);
+    for (size_t i = 0; i < frequencies.size(); ++i)
+    {
+        generators[i].at_row_gradient(&columns[i * width], rows[i * height + y], samples,
+                                      sample_dx, sample_dy, width);
+        // Octave coordinates move by frequency * scale / width per pixel column (height for rows)
+        float weight_x = amplitudes[i] * frequencies[i] * scale * chunk.inv_width;
+        float weight_y = amplitudes[i] * frequencies[i] * scale * chunk.inv_height;
+        for (int x = 0; x < width; ++x)
+        {
+            values[x] += amplitudes[i] * samples[x];
+            dx[x] += weight_x * sample_dx[x];
+            dy[x] += weight_y * sample_dy[x];
+        }
+    }
+
+    // The samples are no longer needed, keep the sums for the chain rule
+    std::copy(values, values + width, samples);
+    finish_row(values, width);
+    finish_gradient_row(samples, values, dx, dy, width);
+}
+
+auto NoiseMap::truncation_plan(const std::vector<float> &thresholds) const -> TruncationPlan
+{
+    // finish_row() computes (sum * inv_amplitude_sum * fudge) ^ redistribution, which increases
+    // with the sum for positive exponents, so the thresholds are mapped back to sums. With any
+    // other exponent than 1, negative sums have no real power, so 0 is a threshold as well
+    float factor = inv_amplitude_sum * fudge;
+    std::vector<float> sums;
+    for (auto threshold : thresholds)
+    {
+        if (redistribution_mode_ == Redistribution::IDENTITY)
+            sums.push_back(threshold / factor);
+        else if (threshold > 0.0f)
+            sums.push_back(std::pow(threshold, 1.0f / redistribution) / factor);
+    }
+    if (redistribution_mode_ != Redistribution::IDENTITY)
+        sums.push_back(0.0f);
+    std::sort(sums.begin(), sums.end());
+
+    auto octaves = frequencies.size();
+    TruncationPlan plan;
+    plan.remaining_min.resize(octaves);
+    plan.remaining_max.resize(octaves);
+    plan.origin.resize(octaves);
+    plan.inv_bucket_width.resize(octaves);
+    plan.settled.resize(octaves);
+    if (octaves == 0)
+        return plan;
+
+    // Bounds of every octave, the last octave is padded by the epsilon
+    std::vector<float> octave_min(octaves), octave_max(octaves);
+    for (size_t i = 0; i < octaves; ++i)
+    {
+        float low = amplitudes[i] * -NOISE_SAMPLE_MARGIN;
+        float high = amplitudes[i] * (1.0f + NOISE_SAMPLE_MARGIN);
+        octave_min[i] = std::min(low, high);
+        octave_max[i] = std::max(low, high);
+    }
+    float epsilon = TRUNCATION_EPSILON / inv_amplitude_sum;
+    plan.remaining_min[octaves - 1] = -epsilon;
+    plan.remaining_max[octaves - 1] = epsilon;
+    for (size_t i = octaves - 1; i > 0; --i)
+    {
+        plan.remaining_min[i - 1] = plan.remaining_min[i] + octave_min[i];
+        plan.remaining_max[i - 1] = plan.remaining_max[i] + octave_max[i];
+    }
+
+    // No pixel can stop while the octaves left span more than the widest gap between thresholds
+    float widest_gap = sums.empty() ? INFINITY : 0.0f;
+    for (size_t k = 1; k < sums.size(); ++k)
+        widest_gap = std::max(widest_gap, sums[k] - sums[k - 1]);
+
+    float partial_min = 0.0f, partial_max = 0.0f;
+    for (size_t i = 0; i + 1 < octaves; ++i)
+    {
+        partial_min += octave_min[i];
+        partial_max += octave_max[i];
+        float remaining_min = plan.remaining_min[i];
+        float remaining_max = plan.remaining_max[i];
+        if (remaining_max - remaining_min >= widest_gap)
+            continue;
+
+        float bucket_width = (partial_max - partial_min) / TRUNCATION_BUCKETS;
+        plan.origin[i] = partial_min - bucket_width;
+        plan.inv_bucket_width[i] = 1.0f / bucket_width;
+        auto &settled = plan.settled[i];
+        settled.assign(TRUNCATION_BUCKETS + 2, 0);
+        for (int b = 1; b <= TRUNCATION_BUCKETS; ++b)
+        {
+            // Every sum in the bucket, padded by one bucket on both sides against rounding in the
+            // bucket index, must stay clear of the thresholds
+            float low = partial_min + static_cast<float>(b - 2) * bucket_width + remaining_min;
+            float high = partial_min + static_cast<float>(b + 1) * bucket_width + remaining_max;
+            auto it = std::lower_bound(sums.begin(), sums.end(), low);
+            settled[b] = it == sums.end() || *it > high;
+        }
+    }
+    return plan;
+}
+
+auto NoiseMap::create_truncated_row(const std::vector<float> &columns,
+                                    const std::vector<float> &rows, const TruncationPlan &plan,
+                                    int y, int width, int height, float *values,
+                                    float *samples, TruncationScratch &scratch) const -> void
+{
+    auto octaves = frequencies.size();
+    if (base_generator.noise_type() == FastNoiseLite::NoiseType_Cellular || octaves == 0 ||
+        redistribution <= 0.0f)
+    {
+        create_row(columns, rows, y, width, height, values, samples);
+        return;
+    }
+
+    // The pixels still summed, their partial sums and their noise coordinates are kept packed, so
+    // that every loop runs over contiguous arrays
+    auto &active = scratch.active;
+    auto &sums = scratch.sums;
+    auto &coordinates = scratch.coordinates;
+    auto &stop = scratch.stop;
+    active.resize(width);
+    sums.assign(width, 0.0f);
+    coordinates.resize(width);
+    stop.resize(width);
+    for (int x = 0; x < width; ++x)
+        active[x] = x;
+
+    size_t count = width;
+    for (size_t i = 0; i < octaves && count > 0; ++i)
+    {
+        // Until the first pixel stops, the coordinates are the ones of the whole row
+        const float *octave_columns = &columns[i * width];
+        if (count < static_cast<size_t>(width))
+        {
+            for (size_t j = 0; j < count; ++j)
+                coordinates[j] = octave_columns[active[j]];
+            octave_columns = coordinates.data();
+        }
+        generators[i].at_row(octave_columns, rows[i * height + y], samples, count);
+        float amplitude = amplitudes[i];
+        const auto &settled = plan.settled[i];
+        if (settled.empty())
+        {
+            for (size_t j = 0; j < count; ++j)
+                sums[j] += amplitude * samples[j];
+            continue;
+        }
+
+        // Look up whether each pixel can stop while summing
+        float origin = plan.origin[i];
+        float inv_bucket_width = plan.inv_bucket_width[i];
+        size_t stopping = 0;
+        for (size_t j = 0; j < count; ++j)
+        {
+            float sum = sums[j] + amplitude * samples[j];
+            sums[j] = sum;
+            float bucket = std::clamp((sum - origin) * inv_bucket_width, 0.0f,
+                                      static_cast<float>(TRUNCATION_BUCKETS + 1));
+            stop[j] = settled[static_cast<int>(bucket)];
+            stopping += stop[j];
+        }
+
+        // Packing the pixels costs about as much per pixel as evaluating one octave, it is skipped
+        // when it would save fewer evaluations than that. A pixel that can stop now can also stop
+        // after any later octave, so it is picked up by a later check
+        if (stopping * (octaves - 1 - i) < count)
+            continue;
+
+        // Pixels that stop get the middle of their bounds, the others are packed to the front
+        float middle = 0.5f * (plan.remaining_min[i] + plan.remaining_max[i]);
+        size_t kept = 0;
+        for (size_t j = 0; j < count; ++j)
+        {
+            if (stop[j])
+                values[active[j]] = sums[j] + middle;
+            else
+            {
+                active[kept] = active[j];
+                sums[kept] = sums[j];
+                ++kept;
+            }
+        }
+        count = kept;
+    }
+
+    for (size_t j = 0; j < count; ++j)
+        values[active[j]] = sums[j];
+    finish_row(values, width);
+}
+
+auto NoiseMap::create_adaptive_row(const std::vector<float> &columns,
+                                   const std::vector<float> &rows, const std::vector<int> &steps,
+                                   const float *coarse_row, int y, int width, int height,
+                                   float *values, float *samples) const -> void
+{
+    std::copy(coarse_row, coarse_row + width, values);
+    for (size_t i = 0; i < frequencies.size(); ++i)
+    {
+        if (steps[i] > 1)
+            continue;
+        generators[i].at_row(&columns[i * width], rows[i * height + y], samples, width);
+        for (int x = 0; x < width; ++x)
+            values[x] += amplitudes[i] * samples[x];
+    }
+    finish_row(values, width);
+}
+
+auto NoiseMap::create_spectral(const ChunkCoordinates &chunk, float scale, float *output,
+                               float *dx, float *dy, int stride) const -> void
+{
+    // Peak of every octave in cycles per pixel of level 0, octave coordinates move by frequency *
+    // scale / width per pixel of level 0. The bands, and so the levels and their tiles, are the
+    // same at every level of detail
+    float inv_level_width = chunk.inv_width / static_cast<float>(stride);
+    float inv_level_height = chunk.inv_height / static_cast<float>(stride);
+    std::vector<float> bands(frequencies.size());
+    for (size_t i = 0; i < frequencies.size(); ++i)
+        bands[i] = SPECTRAL_PEAK_FREQUENCY * generators[i].frequency() * frequencies[i] * scale *
+                   inv_level_width;
+
+    // The derivatives need one more pixel on every side. The first pixel of the area is at pixel
+    // origin of level 0, and the next ones follow every stride pixels
+    int width = static_cast<int>(chunk.columns.size());
+    int height = static_cast<int>(chunk.rows.size());
+    int apron = dx ? 1 : 0;
+    int area_width = width + 2 * apron;
+    int area_height = height + 2 * apron;
+    auto origin_x = static_cast<int64_t>(std::lround(chunk.column(-apron) / inv_level_width));
+    auto origin_y = static_cast<int64_t>(std::lround(chunk.row(-apron) / inv_level_height));
+
+    // Levels whose nodes fall on every pixel of the area are read at those nodes, level 0 always
+    // is. The other ones are upsampled like the octaves of create_octave(), from a grid with a
+    // node one step before the first pixel. The area rarely starts on a node, phase is the number
+    // of pixels of level 0 between that node and the first pixel, minus one step
+    std::vector<float> sums(static_cast<size_t>(area_width) * area_height, 0.0f), level_values;
+    std::vector<float> upsampled_rows, weights_x, weights_y;
+    std::vector<int> nodes_x, nodes_y;
+    for (int level : spectral->levels(bands))
+    {
+        int step = 1 << level;
+        if (stride % step == 0 && origin_x % step == 0 && origin_y % step == 0)
         {
-            float nx = scale * (offset_x + static_cast<float>(x) / width - 0.5f);
-            float ny = scale * (offset_y + static_cast<float>(y) / height - 0.5f);
-            float value = 0;
-            float amplitude_sum = 0;
-            for (int i = 0; i < frequencies.size(); ++i)
+            level_values.resize(sums.size());
+            spectral->fill(bands, level, origin_x / step, origin_y / step, area_width,
+                           area_height, level_values.data(), stride / step);
+            for (size_t k = 0; k < sums.size(); ++k)
+                sums[k] += level_values[k];
+            continue;
+        }
+
+        auto node_x = static_cast<int64_t>(std::floor(static_cast<double>(origin_x) / step)) - 1;
+        auto node_y = static_cast<int64_t>(std::floor(static_cast<double>(origin_y) / step)) - 1;
+        auto phase_x = static_cast<int>(origin_x - node_x * step - step);
+        auto phase_y = static_cast<int>(origin_y - node_y * step - step);
+        int count_x = (phase_x + (area_width - 1) * stride) / step + 4;
+        int count_y = (phase_y + (area_height - 1) * stride) / step + 4;
+        level_values.resize(static_cast<size_t>(count_x) * count_y);
+        spectral->fill(bands, level, node_x, node_y, count_x, count_y, level_values.data());
+
+        cubic_stencil(area_width, step, nodes_x, weights_x, phase_x, stride);
+        cubic_stencil(area_height, step, nodes_y, weights_y, phase_y, stride);
+        upsampled_rows.resize(static_cast<size_t>(count_y) * area_width);
+        for (int k = 0; k < count_y; ++k)
+        {
+            const float *nodes = &level_values[static_cast<size_t>(k) * count_x];
+            float *row = &upsampled_rows[static_cast<size_t>(k) * area_width];
+            for (int x = 0; x < area_width; ++x)
             {
-                value += amplitudes[i] * generators[i].at(frequencies[i] * nx, frequencies[i] * ny);
-                amplitude_sum += amplitudes[i];
+                const float *w = &weights_x[x * 4];
+                const float *node = nodes + nodes_x[x];
+                row[x] = w[0] * node[0] + w[1] * node[1] + w[2] * node[2] + w[3] * node[3];
             }
+        }
+        for (int y = 0; y < area_height; ++y)
+        {
+            const float *w = &weights_y[y * 4];
+            const float *rows = &upsampled_rows[static_cast<size_t>(nodes_y[y]) * area_width];
+            float *sum = &sums[static_cast<size_t>(y) * area_width];
+            for (int x = 0; x < area_width; ++x)
+                sum[x] += w[0] * rows[x] + w[1] * rows[x + area_width] +
+                          w[2] * rows[x + 2 * area_width] + w[3] * rows[x + 3 * area_width];
+        }
+    }
+
+    // Same mean and deviation as the weighted sum of the octaves
+    float mean = 0.5f / inv_amplitude_sum;
+    for (auto &sum : sums)
+        sum = mean + SPECTRAL_NOISE_DEVIATION * sum;
+
+    for (int y = 0; y < height; ++y)
+    {
+        const float *row = &sums[static_cast<size_t>(y + apron) * area_width + apron];
+        float *values = output + static_cast<size_t>(y) * width;
+        std::copy(row, row + width, values);
+        finish_row(values, width);
+        if (!dx)
+            continue;
+
+        float *row_dx = dx + static_cast<size_t>(y) * width;
+        float *row_dy = dy + static_cast<size_t>(y) * width;
+        for (int x = 0; x < width; ++x)
+        {
+            row_dx[x] = 0.5f * (row[x + 1] - row[x - 1]);
+            row_dy[x] = 0.5f * (row[x + area_width] - row[x - area_width]);
+        }
+        finish_gradient_row(row, values, row_dx, row_dy, width);
+    }
+}
+
+auto NoiseMap::create_noise_map(float offset_x, float offset_y, int width, int height, float scale,
+                                std::vector<float> &noise_map) const -> void
+{
+    create_noise_maps(offset_x, offset_y, width, height, {{this, scale, noise_map.data()}});
+}
+
+// True when create_noise_maps() creates the field one row at a time, so that it can also create it
+// a band of rows at a time. Graphs, the spectral backend, the cache and adaptive sampling work on
+// the whole chunk
+static auto is_row_wise(const NoiseField &field, int width, int height) -> bool
+{
+    if (field.graph || field.noisemap->backend() == NoiseBackend::SPECTRAL)
+        return false;
+    if (field.thresholds || field.gradient_x || field.warp_x)
+        return true;
+    if (field.cache)
+        return false;
+    auto steps = field.noisemap->octave_steps(width, height, field.scale);
+    return std::all_of(steps.begin(), steps.end(), [](int step) { return step == 1; });
+}
+
+auto create_noise_maps(float offset_x, float offset_y, int width, int height,
+                       const std::vector<NoiseField> &fields, int halo, int row_begin,
+                       int row_end) -> void
+{
+    if (row_end < 0)
+        row_end = height + 2 * halo;
+    if (row_begin > 0 || row_end < height + 2 * halo)
+    {
+        // Fields that cannot be created by rows are created whole with the first band
+        std::vector<NoiseField> row_wise;
+        for (const auto &field : fields)
+        {
+            if (is_row_wise(field, width, height))
+                row_wise.push_back(field);
+            else if (row_begin == 0)
+                create_noise_maps(offset_x, offset_y, width, height, {field}, halo);
+        }
+        if (row_wise.size() != fields.size())
+            return create_noise_maps(offset_x, offset_y, width, height, row_wise, halo, row_begin,
+                                     row_end);
+    }
+
+    // Noise coordinates of every column and every row for each octave, computed once per chunk.
+    // Per pixel, only the noise evaluation and the weighted sum remain
+    ChunkCoordinates chunk(offset_x, offset_y, width, height, halo);
+    // The pixel spacing is set by the size of the chunk, the outputs also hold the halo
+    int chunk_width = width, chunk_height = height;
+    width += 2 * halo;
+    height += 2 * halo;
+    // Kept from call to call, a chunk run a band of rows at a time calls this once per band
+    static thread_local std::vector<std::vector<float>> columns, rows;
+    columns.resize(std::max(columns.size(), fields.size()));
+    rows.resize(std::max(rows.size(), fields.size()));
+    for (size_t f = 0; f < fields.size(); ++f)
+    {
+        if (!fields[f].graph)
+            fields[f].noisemap->octave_coordinates(chunk, fields[f].scale, columns[f], rows[f],
+                                                   row_begin, row_end);
+    }
 
-            value /= amplitude_sum;
-            value = std::powf(value * fudge, redistribution);
-            noise_map[idx++] = value;
+    // Fields with a graph, a cache or the spectral backend are created in one go. Octaves sampled
+    // on a coarse grid are summed up front, coarse stays empty for the fields that sample every
+    // octave at every pixel
+    std::vector<std::vector<int>> steps(fields.size());
+    std::vector<std::vector<float>> coarse(fields.size());
+    std::vector<bool> done(fields.size(), false);
+    for (size_t f = 0; f < fields.size(); ++f)
+    {
+        const auto &field = fields[f];
+        if (field.graph)
+        {
+            field.graph->create(chunk, field.scale, field.output, field.warp_x, field.warp_y,
+                                field.stride);
+            done[f] = true;
+            continue;
         }
+        if (field.noisemap->backend() == NoiseBackend::SPECTRAL)
+        {
+            if (field.warp_x)
+                throw std::runtime_error("The spectral backend cannot be warped");
+            field.noisemap->create_spectral(chunk, field.scale, field.output, field.gradient_x,
+                                            field.gradient_y, field.stride);
+            done[f] = true;
+            continue;
+        }
+        if (field.thresholds || field.gradient_x || field.warp_x)
+            continue;
+        steps[f] = field.noisemap->octave_steps(chunk_width, chunk_height, field.scale);
+        if (field.cache)
+        {
+            field.noisemap->create_cached(chunk, field.scale, steps[f], *field.cache, field.output);
+            done[f] = true;
+        }
+        else if (std::any_of(steps[f].begin(), steps[f].end(), [](int step) { return step > 1; }))
+            field.noisemap->create_coarse_sum(chunk, field.scale, steps[f], coarse[f]);
     }
-}
\ No newline at end of file
+
+    std::vector<TruncationPlan> plans(fields.size());
+    for (size_t f = 0; f < fields.size(); ++f)
+    {
+        if (fields[f].thresholds && !fields[f].gradient_x && !fields[f].warp_x && !done[f])
+            plans[f] = fields[f].noisemap->truncation_plan(*fields[f].thresholds);
+    }
+
+    // Gradient rows need three scratch rows, one for the samples and one for each derivative,
+    // warped rows three for the coordinates and the samples of one octave, and two more for the
+    // warped positions
+    static thread_local std::vector<float> samples, positions;
+    static thread_local TruncationScratch truncation;
+    samples.resize(static_cast<size_t>(3) * width);
+    positions.resize(static_cast<size_t>(2) * width);
+    for (int y = row_begin; y < row_end; ++y)
+    {
+        for (size_t f = 0; f < fields.size(); ++f)
+        {
+            const auto &field = fields[f];
+            auto row = static_cast<size_t>(y) * width;
+            float *values = field.output + row;
+            if (done[f])
+                continue;
+            else if (field.warp_x)
+            {
+                float *xs = positions.data();
+                float *ys = xs + width;
+                for (int x = 0; x < width; ++x)
+                {
+                    xs[x] = field.scale * field.warp_x[row + x];
+                    ys[x] = field.scale * field.warp_y[row + x];
+                }
+                field.noisemap->create_batch(xs, ys, values, samples.data(), width);
+            }
+            else if (field.gradient_x)
+                field.noisemap->create_gradient_row(chunk, field.scale, columns[f], rows[f], y,
+                                                    values, field.gradient_x + row,
+                                                    field.gradient_y + row, samples.data());
+            else if (field.thresholds)
+                field.noisemap->create_truncated_row(columns[f], rows[f], plans[f], y, width,
+                                                     height, values, samples.data(), truncation);
+            else if (coarse[f].empty())
+                field.noisemap->create_row(columns[f], rows[f], y, width, height, values,
+                                           samples.data());
+            else
+                field.noisemap->create_adaptive_row(columns[f], rows[f], steps[f],
+                                                    &coarse[f][static_cast<size_t>(y) * width], y,
+                                                    width, height, values, samples.data());
+        }
+    }
+}
@@ -2,39 +2,421 @@
 #define A_NOISE_H
 
 #include "FastNoiseLite.h"
+#include "confparse.hpp"
+#include "fingerprint.hpp"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 class NoiseGenerator
 {
     int seed_;
+    float frequency_;
+    FastNoiseLite::NoiseType noise_type_;
+    FastNoiseLite::DomainWarpType warp_type_ = FastNoiseLite::DomainWarpType_OpenSimplex2;
+    float warp_amplitude_ = 1.0f;
     FastNoiseLite noise;
 
   public:
     NoiseGenerator();
-    NoiseGenerator(int seed);
+    NoiseGenerator(int seed,
+                   FastNoiseLite::NoiseType noise_type = FastNoiseLite::NoiseType_OpenSimplex2S);
     auto seed() const -> int;
     auto set_seed(int seed) -> void;
+    auto frequency() const -> float;
+    auto noise_type() const -> FastNoiseLite::NoiseType;
     auto at(float x, float y) const -> float;
+
+    // Evaluates n samples at once, out[i] = at(xs[i], ys[i]) within NOISE_KERNEL_TOLERANCE.
+    // Noise types without batch kernels fall back to calling at() for every sample
+    auto at_batch(const float *xs, const float *ys, float *out, size_t n) const -> void;
+
+    // Same as at_batch(), with every sample on the row at y
+    auto at_row(const float *xs, float y, float *out, size_t n) const -> void;
+
+    // Same as at_row(), with the partial derivatives of out[i] with respect to xs[i] and y in
+    // out_dx[i] and out_dy[i]. OpenSimplex2S computes them analytically in the same pass, the other
+    // noise types fall back to central differences, see GRADIENT_DIFFERENCE_STEP
+    auto at_row_gradient(const float *xs, float y, float *out, float *out_dx, float *out_dy,
+                         size_t n) const -> void;
+
+    // Warp type and warp amplitude (about the largest displacement, in the units of at()) used by
+    // warp() and warp_batch()
+    auto set_domain_warp(FastNoiseLite::DomainWarpType type, float amplitude) -> void;
+
+    // FastNoiseLite::DomainWarp(), moves (x, y) along a smooth random vector field, in the units of
+    // at()
+    auto warp(float &x, float &y) const -> void;
+
+    // warp() of n positions in place with the domain warp kernel
+    auto warp_batch(float *xs, float *ys, size_t n) const -> void;
+};
+
+// Step in noise units (after the frequency is applied) of the central differences used for the
+// gradient of noise types without an analytic one
+#define GRADIENT_DIFFERENCE_STEP 1e-2f
+
+// Position of every pixel column and row of a chunk in chunk units, shared by all noise maps that
+// are evaluated over the same chunk
+struct ChunkCoordinates
+{
+    float offset_x, offset_y;
+    float inv_width, inv_height;
+    // Pixels outside the chunk on every side, columns[0] is pixel column -halo of the chunk
+    int halo;
+    std::vector<float> columns;
+    std::vector<float> rows;
+
+    // Coordinates of the width * height pixels of a chunk and of halo more pixels on every side,
+    // the pixels of the chunk are at the same positions whatever the halo
+    ChunkCoordinates(float offset_x, float offset_y, int width, int height, int halo = 0);
+
+    // Position of any pixel column or row, counted from columns[0] and rows[0], including the ones
+    // outside of the chunk
+    auto column(int x) const -> float;
+    auto row(int y) const -> float;
+};
+
+// Identifies the raw samples of one octave over one chunk
+struct OctaveKey
+{
+    int seed;
+    FastNoiseLite::NoiseType noise_type;
+    float generator_frequency;
+    float frequency;
+    float scale;
+    float offset_x, offset_y;
+    int width, height;
+    // Sampling step in pixels, see NoiseMap::octave_steps()
+    int step;
+    // See ChunkCoordinates::halo, width and height include it
+    int halo;
+
+    auto operator==(const OctaveKey &other) const -> bool;
+};
+
+struct OctaveKeyHash
+{
+    auto operator()(const OctaveKey &key) const -> size_t;
+};
+
+// Keeps the raw (unweighted) samples of every octave of recently generated chunks, so that a config
+// reload which only changes amplitudes, fudge or redistribution re-sums the cached octaves instead
+// of evaluating the noise again. The least recently used tiles are dropped once the cache holds
+// more than its capacity. Safe to use from several threads
+class OctaveCache
+{
+  public:
+    using Tile = std::shared_ptr<const std::vector<float>>;
+
+  private:
+    using Entry = std::pair<OctaveKey, Tile>;
+
+    std::list<Entry> entries;
+    std::unordered_map<OctaveKey, std::list<Entry>::iterator, OctaveKeyHash> index;
+    size_t capacity_bytes;
+    size_t size_bytes;
+    mutable std::mutex mutex;
+
+    auto evict() -> void;
+
+  public:
+    OctaveCache(size_t capacity_bytes);
+
+    // Tile stored for key, nullptr if there is none
+    auto get(const OctaveKey &key) -> Tile;
+
+    auto put(const OctaveKey &key, Tile tile) -> void;
+
+    auto set_capacity(size_t capacity_bytes) -> void;
+
+    auto clear() -> void;
+
+    auto size() const -> size_t;
+};
+
+// Parses a noise type name from the config, such as "opensimplex2s" or "perlin"
+auto parse_noise_type(const std::string &name) -> FastNoiseLite::NoiseType;
+
+// Parses a domain warp type name from the config, one of "opensimplex2", "opensimplex2_reduced"
+// or "basic_grid"
+auto parse_domain_warp_type(const std::string &name) -> FastNoiseLite::DomainWarpType;
+
+// Noise maps with up to this many octaves, of a noise type with batch kernels, use a row function
+// specialized for the octave count (see FixedNoiseMap in noise.cpp)
+#define MAX_FIXED_OCTAVES 16
+
+template <size_t Octaves, FastNoiseLite::NoiseType Type> struct FixedNoiseMap;
+
+class SpectralSynthesis;
+
+// How a noise map creates its values. OCTAVES sums one noise evaluation per octave at every pixel,
+// SPECTRAL filters white noise with FFTs (see SpectralSynthesis) into a different field with about
+// the same power spectrum and distribution, at a cost that does not grow with the octave count
+enum class NoiseBackend
+{
+    OCTAVES,
+    SPECTRAL
+};
+
+// Maximum error of bicubic (Catmull-Rom) interpolation of a noise octave sampled every h noise
+// units is about ADAPTIVE_ERROR_CONSTANT * h^3, measured on OpenSimplex2S mapped to [0, 1]
+#define ADAPTIVE_ERROR_CONSTANT 5.0f
+
+// Samples of every noise type except cellular stay within [-NOISE_SAMPLE_MARGIN,
+// 1 + NOISE_SAMPLE_MARGIN], used to bound the octaves that octave truncation skips
+#define NOISE_SAMPLE_MARGIN 0.05f
+
+// Octave truncation only stops when every threshold is at least this far (relative to the sum of
+// the amplitudes) from the bounds of the value, which covers the rounding differences between the
+// bounds, the full sum and the redistribution
+#define TRUNCATION_EPSILON 1e-4f
+
+// Number of buckets that the partial sums of a noise map are split into by TruncationPlan
+#define TRUNCATION_BUCKETS 256
+
+// For every octave of a noise map, whether a pixel can stop summing octaves after it, looked up
+// from the bucket of its partial sum. A bucket is only marked when no threshold lies within the
+// bounds of any partial sum in it, so the check is conservative and costs the same for any number
+// of thresholds
+struct TruncationPlan
+{
+    // Bounds of the weighted sum of the octaves after octave i, relative to the partial sum
+    std::vector<float> remaining_min, remaining_max;
+    // Partial sum at the start of bucket 0 and inverse of the bucket width, for every octave
+    std::vector<float> origin, inv_bucket_width;
+    // TRUNCATION_BUCKETS + 2 entries for every octave, 1 if the pixels can stop, the first and the
+    // last entry catch partial sums outside of the expected range and are always 0. Empty for the
+    // octaves after which no pixel can stop
+    std::vector<std::vector<unsigned char>> settled;
+};
+
+// Scratch rows of NoiseMap::create_truncated_row(), kept by the caller from row to row so that
+// they are only allocated once
+struct TruncationScratch
+{
+    std::vector<int> active;
+    std::vector<float> sums, coordinates;
+    std::vector<unsigned char> stop;
+};
+
+// How a noise map raises its normalized values to the redistribution exponent, picked when the
+// noise map is built. The multiplication and square root forms may differ from powf() in the last
+// bit, FAST uses the pow kernel and stays within FAST_POW_TOLERANCE
+enum class Redistribution
+{
+    IDENTITY,
+    SQUARE,
+    CUBE,
+    FOURTH,
+    SQRT,
+    ONE_AND_HALF,
+    TWO_AND_HALF,
+    POW,
+    FAST
 };
 
 // Creates a 2D noise map in the given vector, Note: noise_map must have size atleast equal to width
 // * height
 class NoiseMap
 {
+    using RowFunction = void (*)(const NoiseMap &map, const std::vector<float> &columns,
+                                 const std::vector<float> &rows, int y, int width, int height,
+                                 float *values, float *samples);
+
     std::vector<float> frequencies;
     std::vector<float> amplitudes;
     NoiseGenerator base_generator;
     std::vector<NoiseGenerator> generators;
     float fudge, redistribution;
+    float inv_amplitude_sum;
+    Redistribution redistribution_mode_;
+    float adaptive_tolerance;
+    // Picked when the noise map is built, either a FixedNoiseMap or dynamic_row
+    RowFunction row_function;
+    // Shared by the copies of the noise map, null for the octave backend
+    std::shared_ptr<SpectralSynthesis> spectral;
+
+    static auto dynamic_row(const NoiseMap &map, const std::vector<float> &columns,
+                            const std::vector<float> &rows, int y, int width, int height,
+                            float *values, float *samples) -> void;
+
+    // Normalizes and redistributes the weighted sum of the octaves
+    auto finish_row(float *values, int width) const -> void;
+
+    // Sets the normalization and the row function for the octaves
+    auto set_octaves() -> void;
+
+    // Applies the chain rule of finish_row() to the derivatives of the weighted sums, values are
+    // the finished values of the same row
+    auto finish_gradient_row(const float *sums, const float *values, float *dx, float *dy,
+                             int width) const -> void;
+
+    template <size_t Octaves, FastNoiseLite::NoiseType Type> friend struct FixedNoiseMap;
 
   public:
     NoiseMap() {}
 
+    // With fast_math, exponents without an exact fast path use the pow kernel instead of powf().
+    // With an adaptive_tolerance above 0, low frequency octaves are sampled on a coarse grid and
+    // bicubically upsampled, see octave_steps()
     NoiseMap(const std::vector<float> &frequencies, const std::vector<float> &amplitudes,
-             NoiseGenerator base_generator, float fudge, float redistribution);
+             NoiseGenerator base_generator, float fudge, float redistribution,
+             bool fast_math = false, float adaptive_tolerance = 0.0f);
+
+    // Reads <prefix>.octaves, <prefix>.frequencyN, <prefix>.amplitudeN, <prefix>.fudge,
+    // <prefix>.redistribution, <prefix>.noise_type, <prefix>.fast_math,
+    // <prefix>.adaptive_tolerance and <prefix>.backend from the config
+    static auto from_config(const confparse::Config &cfg, const std::string &prefix, int seed)
+        -> NoiseMap;
+
+    auto octave_count() const -> size_t;
+
+    auto redistribution_mode() const -> Redistribution;
+
+    auto set_adaptive_tolerance(float tolerance) -> void;
+
+    auto backend() const -> NoiseBackend;
+
+    auto set_backend(NoiseBackend backend) -> void;
+
+    // Hash of every parameter that changes the values of the noise map, see Fingerprint
+    auto fingerprint() const -> uint64_t;
+
+    // The noise map for chunks at a level of detail (see Chunk::lod), without the octaves whose
+    // frequency is above the highest one divided by 2^level. Their samples would be further apart
+    // than the samples of the finest octave at full resolution. The octave with the lowest
+    // frequency is always kept, and the values are normalized by the amplitudes of the kept
+    // octaves, so they keep their range. The spectral backend keeps every octave
+    auto lod(int level) const -> NoiseMap;
+
+    // Sampling step in pixels of every octave over a chunk, 1 for octaves sampled at every pixel.
+    // The step of an octave is the largest one whose interpolation error stays below the adaptive
+    // tolerance, so the error of the whole map stays below about tolerance * fudge before
+    // redistribution. All steps are 1 when the tolerance is 0
+    auto octave_steps(int width, int height, float scale) const -> std::vector<int>;
+
+    // Weighted sum of the octaves with a step above 1, each sampled on its coarse grid and
+    // bicubically upsampled to every pixel of the chunk
+    auto create_coarse_sum(const ChunkCoordinates &chunk, float scale,
+                           const std::vector<int> &steps, std::vector<float> &sum) const -> void;
+
+    // Raw samples of one octave over the chunk, sampled every step pixels and bicubically
+    // upsampled when step is above 1
+    auto create_octave(const ChunkCoordinates &chunk, float scale, size_t octave, int step,
+                       std::vector<float> &tile) const -> void;
+
+    // Same result as create_row() and create_adaptive_row() for the whole chunk, with every octave
+    // read from the cache, or evaluated and stored in it
+    auto create_cached(const ChunkCoordinates &chunk, float scale, const std::vector<int> &steps,
+                       OctaveCache &cache, float *output) const -> void;
+
+    // Whole chunk with the spectral backend, with the derivatives per pixel along x and y (central
+    // differences) when dx and dy are not null. The noise type is not used, the spectrum is the
+    // one of OpenSimplex2S. The bands are laid out on the pixels of level 0 and the pixels of the
+    // chunk are stride pixels of level 0 apart, so a chunk at a level of detail samples the values
+    // of the chunk at full resolution
+    auto create_spectral(const ChunkCoordinates &chunk, float scale, float *output,
+                         float *dx = nullptr, float *dy = nullptr, int stride = 1) const -> void;
+
+    auto generator(size_t octave) const -> const NoiseGenerator &;
 
     auto create_noise_map(float offset_x, float offset_y, int width, int height, float scale,
                           std::vector<float> &noise_map) const -> void;
+
+    // Noise coordinates of every column and row for each octave, octave i of column x is at
+    // columns[i * width + x]. Only rows row_begin to row_end - 1 are set when given (-1 is the last
+    // row)
+    auto octave_coordinates(const ChunkCoordinates &chunk, float scale, std::vector<float> &columns,
+                            std::vector<float> &rows, int row_begin = 0, int row_end = -1) const
+        -> void;
+
+    // Values of the noise map at n arbitrary positions, in chunk units times the scale (the
+    // coordinates of octave_coordinates() before the frequency of every octave). samples is
+    // scratch space of 3 * n floats. Only for the octave backend
+    auto create_batch(const float *xs, const float *ys, float *values, float *samples,
+                      int n) const -> void;
+
+    // Computes row y of the noise map into values, samples is scratch space of width floats
+    auto create_row(const std::vector<float> &columns, const std::vector<float> &rows, int y,
+                    int width, int height, float *values, float *samples) const -> void;
+
+    // create_row() with the derivatives of every value with respect to the pixel column and row in
+    // dx and dy, the values are the same as create_row(). samples is scratch space of 3 * width
+    // floats
+    auto create_gradient_row(const ChunkCoordinates &chunk, float scale,
+                             const std::vector<float> &columns, const std::vector<float> &rows,
+                             int y, float *values, float *dx, float *dy, float *samples) const
+        -> void;
+
+    // Precomputes which partial sums can stop summing octaves, for the given thresholds (ascending)
+    // on the values of the noise map
+    auto truncation_plan(const std::vector<float> &thresholds) const -> TruncationPlan;
+
+    // create_row() for consumers that only need to know which thresholds each value lies between,
+    // e.g. biome classification. Octaves are summed in order and a pixel stops as soon as the
+    // octaves left cannot move it across a threshold, those pixels get an estimate between the
+    // same thresholds as the exact value. The other pixels get the exact value
+    auto create_truncated_row(const std::vector<float> &columns, const std::vector<float> &rows,
+                              const TruncationPlan &plan, int y, int width, int height,
+                              float *values, float *samples, TruncationScratch &scratch) const
+        -> void;
+
+    // create_row() for adaptive sampling, coarse_row is row y of create_coarse_sum() and only the
+    // octaves with a step of 1 are evaluated
+    auto create_adaptive_row(const std::vector<float> &columns, const std::vector<float> &rows,
+                             const std::vector<int> &steps, const float *coarse_row, int y,
+                             int width, int height, float *values, float *samples) const -> void;
 };
 
+class NoiseGraph;
+
+// One output of create_noise_maps(). Noise maps with the spectral backend only use the noise map,
+// the scale, the output and the gradient
+struct NoiseField
+{
+    const NoiseMap *noisemap;
+    float scale;
+    // width * height values
+    float *output;
+    // Octaves are read from and stored in the cache when it is not null
+    OctaveCache *cache = nullptr;
+    // When not null, the output only has to lie between the same thresholds as the exact noise
+    // map, see NoiseMap::create_truncated_row(). Adaptive sampling and the cache are not used
+    const std::vector<float> *thresholds = nullptr;
+    // When not null, both receive the derivatives of the output per pixel along x and y, see
+    // NoiseMap::create_gradient_row(). Every octave is then evaluated exactly at every pixel, the
+    // thresholds, the cache and adaptive sampling are not used
+    float *gradient_x = nullptr;
+    float *gradient_y = nullptr;
+    // When not null, the graph creates the output (see NoiseGraph::create()), only the scale and
+    // the output are used
+    const NoiseGraph *graph = nullptr;
+    // When not null, the pixels are at these positions in chunk units (see Chunk::warp_x) instead
+    // of the pixel grid, the noise map is evaluated with NoiseMap::create_batch(). The thresholds,
+    // the cache and adaptive sampling are not used, gradients and the spectral backend are not
+    // supported
+    const float *warp_x = nullptr;
+    const float *warp_y = nullptr;
+    // Pixels of level 0 between two pixels of the chunk, 2^lod at a level of detail (see
+    // Chunk::lod). Only the spectral backend needs it, the octaves are sampled at the positions
+    // of the pixels
+    int stride = 1;
+};
+
+// Evaluates several noise maps over the same chunk in a single traversal, the chunk coordinates are
+// computed once and every field is written one row at a time, while the scratch rows are still in
+// cache. Gives the same result as calling create_noise_map() for every field. With a halo, every
+// output holds (width + 2 halo) * (height + 2 halo) values, the chunk and halo more pixels on
+// every side (see ChunkCoordinates). Only rows row_begin to row_end - 1 of the outputs are written
+// when given (-1 is the last row), for running several layers a band of rows at a time. Fields that
+// need the whole chunk at once (a graph, the spectral backend, the cache or adaptive sampling) are
+// then created whole when row_begin is 0 and skipped otherwise, so the bands must start at row 0
+auto create_noise_maps(float offset_x, float offset_y, int width, int height,
+                       const std::vector<NoiseField> &fields, int halo = 0, int row_begin = 0,
+                       int row_end = -1) -> void;
+
 #endif // A_NOISE_H
\ No newline at end of file
@@ -0,0 +1,756 @@
+#include "noise_graph.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+
+// Added to the seed of the field for the sources of a graph, so that opensimplex2s(1) is not the
+// first octave of the noise map
+#define GRAPH_SEED_MAGIC_NUMBER 6151
+
+// Largest frequency of a source. Above it, the noise coordinates of chunks a few million chunk
+// units away leave the range of the integer cell coordinates of FastNoiseLite, which then returns
+// garbage or NaN
+#define GRAPH_MAX_FREQUENCY 1e5f
+
+// A parsed expression, either a number or a function with its arguments. A name without
+// parentheses is a function without arguments
+struct GraphExpression
+{
+    bool is_number = false;
+    float number = 0.0f;
+    std::string name;
+    std::vector<GraphExpression> arguments;
+    // Column of the first character of the expression in the text, from 1
+    size_t column = 0;
+};
+
+class GraphParser
+{
+    const std::string &text;
+    size_t position = 0;
+
+    [[noreturn]] auto fail(const std::string &message) const -> void
+    {
+        throw std::runtime_error("Noise graph: " + message + " at column " +
+                                 std::to_string(position + 1) + " of \"" + text + "\"");
+    }
+
+    auto skip_spaces() -> void
+    {
+        while (position < text.size() && std::isspace(static_cast<unsigned char>(text[position])))
+            ++position;
+    }
+
+    auto accept(char c) -> bool
+    {
+        skip_spaces();
+        if (position < text.size() && text[position] == c)
+        {
+            ++position;
+            return true;
+        }
+        return false;
+    }
+
+    auto expression() -> GraphExpression
+    {
+        skip_spaces();
+        GraphExpression result;
+        if (position == text.size())
+            fail("expected an expression");
+        result.column = position + 1;
+
+        char c = text[position];
+        if (std::isdigit(static_cast<unsigned char>(c)) || c == '-' || c == '+' || c == '.')
+        {
+            const char *start = text.c_str() + position;
+            char *end = nullptr;
+            result.is_number = true;
+            result.number = std::strtof(start, &end);
+            if (end == start)
+                fail("invalid number");
+            if (!std::isfinite(result.number))
+                fail("number out of range");
+            position += static_cast<size_t>(end - start);
+            return result;
+        }
+
+        while (position < text.size() &&
+               (std::isalnum(static_cast<unsigned char>(text[position])) || text[position] == '_'))
+            result.name.push_back(text[position++]);
+        if (result.name.empty())
+            fail(std::string("unexpected '") + c + "'");
+
+        if (!accept('('))
+            return result;
+        if (accept(')'))
+            return result;
+        do
+            result.arguments.push_back(expression());
+        while (accept(','));
+        if (!accept(')'))
+            fail("expected ')'");
+        return result;
+    }
+
+  public:
+    GraphParser(const std::string &text) : text(text) {}
+
+    auto parse() -> GraphExpression
+    {
+        auto result = expression();
+        skip_spaces();
+        if (position != text.size())
+            fail("unexpected text after the expression");
+        return result;
+    }
+};
+
+// Lowers an expression into a graph of nodes, identical nodes are merged, then schedules the nodes
+// into instructions and allocates their registers
+class GraphCompiler
+{
+    // A node has the fields of its instruction, with node indices instead of registers. NOISE and
+    // OCTAVES read their coordinates from the WARP node c, or from the coordinate registers when c
+    // is -1. WARP reads its coordinates from c in the same way
+    struct Node
+    {
+        GraphOp op;
+        int a = -1, b = -1, c = -1;
+        float p0 = 0.0f, p1 = 0.0f;
+        int source = -1;
+
+        auto key() const { return std::tie(op, a, b, c, p0, p1, source); }
+
+        auto operator<(const Node &other) const -> bool { return key() < other.key(); }
+    };
+
+    // Value of a subexpression, the node that computes it or a number when node is -1
+    struct Value
+    {
+        int node;
+        float number;
+    };
+
+    struct SourceKey
+    {
+        FastNoiseLite::NoiseType noise_type;
+        float frequency;
+        int seed;
+
+        auto operator<(const SourceKey &other) const -> bool
+        {
+            return std::tie(noise_type, frequency, seed) <
+                   std::tie(other.noise_type, other.frequency, other.seed);
+        }
+    };
+
+    const NoiseMap &octaves;
+    int seed;
+    // Text of the expression being compiled
+    std::string text;
+
+    std::vector<Node> nodes;
+    std::map<Node, int> node_index;
+    std::map<SourceKey, int> source_index;
+
+    // Registers of every node, -1 until the node is scheduled
+    std::vector<int> node_register, node_register2;
+    // Readers of every node that have not been scheduled yet
+    std::vector<int> remaining_readers;
+    std::vector<int> free_registers;
+
+    static auto constant(float number) -> Value { return {-1, number}; }
+
+    [[noreturn]] auto fail(const std::string &message) const -> void
+    {
+        throw std::runtime_error("Noise graph: " + message);
+    }
+
+    // Same message as GraphParser, at the column of a subexpression
+    [[noreturn]] auto fail_at(const GraphExpression &expression, const std::string &message) const
+        -> void
+    {
+        throw std::runtime_error("Noise graph: " + message + " at column " +
+                                 std::to_string(expression.column) + " of \"" + text + "\"");
+    }
+
+    auto add_node(const Node &node) -> Value
+    {
+        auto it = node_index.find(node);
+        if (it != node_index.end())
+            return {it->second, 0.0f};
+        int index = static_cast<int>(nodes.size());
+        nodes.push_back(node);
+        node_index.emplace(node, index);
+        return {index, 0.0f};
+    }
+
+    // Node for a value, numbers become CONSTANT nodes
+    auto materialize(Value value) -> int
+    {
+        if (value.node >= 0)
+            return value.node;
+        Node node{GraphOp::CONSTANT};
+        node.p0 = value.number;
+        return add_node(node).node;
+    }
+
+    auto affine(Value value, float scale, float offset) -> Value
+    {
+        if (value.node < 0)
+            return constant(value.number * scale + offset);
+        if (scale == 1.0f && offset == 0.0f)
+            return value;
+        Node inner = nodes[value.node];
+        if (inner.op == GraphOp::AFFINE)
+            return affine({inner.a, 0.0f}, inner.p0 * scale, inner.p1 * scale + offset);
+        Node node{GraphOp::AFFINE, value.node};
+        node.p0 = scale;
+        node.p1 = offset;
+        return add_node(node);
+    }
+
+    auto clamp(Value value, float low, float high) -> Value
+    {
+        if (value.node < 0)
+            return constant(std::min(std::max(value.number, low), high));
+        Node inner = nodes[value.node];
+        if (inner.op == GraphOp::CLAMP)
+        {
+            // Nested ranges that overlap clamp to their intersection, otherwise the inner range
+            // lies entirely on one side of the outer one
+            if (inner.p1 < low)
+                return constant(low);
+            if (inner.p0 > high)
+                return constant(high);
+            return clamp({inner.a, 0.0f}, std::max(inner.p0, low), std::min(inner.p1, high));
+        }
+        Node node{GraphOp::CLAMP, value.node};
+        node.p0 = low;
+        node.p1 = high;
+        return add_node(node);
+    }
+
+    auto binary(GraphOp op, Value x, Value y) -> Value
+    {
+        const float infinity = std::numeric_limits<float>::infinity();
+        if (x.node < 0 && y.node < 0)
+        {
+            switch (op)
+            {
+            case GraphOp::ADD:
+                return constant(x.number + y.number);
+            case GraphOp::SUB:
+                return constant(x.number - y.number);
+            case GraphOp::MUL:
+                return constant(x.number * y.number);
+            case GraphOp::MIN:
+                return constant(std::min(x.number, y.number));
+            default:
+                return constant(std::max(x.number, y.number));
+            }
+        }
+
+        if (op == GraphOp::SUB)
+        {
+            if (y.node < 0)
+                return affine(x, 1.0f, -y.number);
+            if (x.node < 0)
+                return affine(y, -1.0f, x.number);
+        }
+        else if (x.node < 0 || y.node < 0)
+        {
+            // Every other operator is commutative, put the number in y
+            if (x.node < 0)
+                std::swap(x, y);
+            switch (op)
+            {
+            case GraphOp::ADD:
+                return affine(x, 1.0f, y.number);
+            case GraphOp::MUL:
+                return affine(x, y.number, 0.0f);
+            case GraphOp::MIN:
+                return clamp(x, -infinity, y.number);
+            default:
+                return clamp(x, y.number, infinity);
+            }
+        }
+        else if (x.node > y.node)
+            std::swap(x, y);
+
+        Node node{op, x.node, y.node};
+        return add_node(node);
+    }
+
+    auto expect_arguments(const GraphExpression &expression, size_t min, size_t max) const -> void
+    {
+        auto count = expression.arguments.size();
+        if (count < min || count > max)
+        {
+            auto expected = min == max ? std::to_string(min)
+                            : max == std::numeric_limits<size_t>::max()
+                                ? "at least " + std::to_string(min)
+                                : std::to_string(min) + " to " + std::to_string(max);
+            fail(expression.name + " takes " + expected + " arguments, got " +
+                 std::to_string(count));
+        }
+    }
+
+    // Argument that must be a number, or an expression of numbers
+    auto number_argument(const GraphExpression &expression, size_t i) -> float
+    {
+        auto value = lower(expression.arguments[i], -1);
+        if (value.node >= 0)
+            fail("argument " + std::to_string(i + 1) + " of " + expression.name +
+                 " must be a number");
+        return value.number;
+    }
+
+    auto source(const GraphExpression &expression, FastNoiseLite::NoiseType noise_type,
+                int coordinates) -> Value
+    {
+        expect_arguments(expression, 0, 2);
+        float frequency = expression.arguments.size() > 0 ? number_argument(expression, 0) : 1.0f;
+        if (std::fabs(frequency) > GRAPH_MAX_FREQUENCY)
+            fail_at(expression.arguments[0],
+                    "frequency of " + expression.name + " is above " +
+                        std::to_string(static_cast<int>(GRAPH_MAX_FREQUENCY)));
+        int source_seed =
+            expression.arguments.size() > 1 ? static_cast<int>(number_argument(expression, 1)) : 0;
+
+        SourceKey key{noise_type, frequency, source_seed};
+        auto it = source_index.find(key);
+        int index;
+        if (it != source_index.end())
+            index = it->second;
+        else
+        {
+            index = static_cast<int>(sources.size());
+            sources.push_back(
+                {NoiseGenerator(seed + GRAPH_SEED_MAGIC_NUMBER + source_seed * 1013, noise_type),
+                 frequency});
+            source_index.emplace(key, index);
+        }
+
+        Node node{GraphOp::NOISE};
+        node.c = coordinates;
+        node.source = index;
+        return add_node(node);
+    }
+
+    auto lower(const GraphExpression &expression, int coordinates) -> Value
+    {
+        auto value = lower_expression(expression, coordinates);
+        // Numbers are folded in float, so expressions of numbers in range can still overflow, in a
+        // constant or in the factors of a merged affine chain
+        bool finite = true;
+        if (value.node < 0)
+            finite = std::isfinite(value.number);
+        else if (nodes[value.node].op == GraphOp::AFFINE)
+            finite = std::isfinite(nodes[value.node].p0) && std::isfinite(nodes[value.node].p1);
+        if (!finite)
+            fail_at(expression, "value out of range");
+        return value;
+    }
+
+    auto lower_expression(const GraphExpression &expression, int coordinates) -> Value
+    {
+        if (expression.is_number)
+            return constant(expression.number);
+
+        const auto &name = expression.name;
+        const auto &arguments = expression.arguments;
+        if (name == "octaves")
+        {
+            expect_arguments(expression, 0, 0);
+            if (coordinates >= 0 && octaves.backend() == NoiseBackend::SPECTRAL)
+                fail("octaves with the spectral backend cannot be warped");
+            Node node{GraphOp::OCTAVES};
+            node.c = coordinates;
+            return add_node(node);
+        }
+        if (name == "add" || name == "mul" || name == "min" || name == "max")
+        {
+            expect_arguments(expression, 2, std::numeric_limits<size_t>::max());
+            GraphOp op = name == "add"   ? GraphOp::ADD
+                         : name == "mul" ? GraphOp::MUL
+                         : name == "min" ? GraphOp::MIN
+                                         : GraphOp::MAX;
+            auto value = lower(arguments[0], coordinates);
+            for (size_t i = 1; i < arguments.size(); ++i)
+                value = binary(op, value, lower(arguments[i], coordinates));
+            return value;
+        }
+        if (name == "sub")
+        {
+            expect_arguments(expression, 2, 2);
+            return binary(GraphOp::SUB, lower(arguments[0], coordinates),
+                          lower(arguments[1], coordinates));
+        }
+        if (name == "abs" || name == "ridged")
+        {
+            expect_arguments(expression, 1, 1);
+            auto value = lower(arguments[0], coordinates);
+            if (value.node < 0)
+                return constant(name == "abs" ? std::fabs(value.number)
+                                              : 1.0f - std::fabs(2.0f * value.number - 1.0f));
+            Node node{name == "abs" ? GraphOp::ABS : GraphOp::RIDGED, value.node};
+            return add_node(node);
+        }
+        if (name == "clamp")
+        {
+            expect_arguments(expression, 3, 3);
+            float low = number_argument(expression, 1);
+            float high = number_argument(expression, 2);
+            if (low > high)
+                fail("the low bound of clamp is above the high bound");
+            return clamp(lower(arguments[0], coordinates), low, high);
+        }
+        if (name == "remap")
+        {
+            expect_arguments(expression, 5, 5);
+            float from_low = number_argument(expression, 1);
+            float from_high = number_argument(expression, 2);
+            float to_low = number_argument(expression, 3);
+            float to_high = number_argument(expression, 4);
+            if (from_low == from_high)
+                fail("remap from an empty range");
+            float scale = (to_high - to_low) / (from_high - from_low);
+            return affine(lower(arguments[0], coordinates), scale, to_low - from_low * scale);
+        }
+        if (name == "warp")
+        {
+            expect_arguments(expression, 4, 4);
+            float strength = number_argument(expression, 3);
+            if (strength == 0.0f)
+                return lower(arguments[0], coordinates);
+            Node node{GraphOp::WARP};
+            node.a = materialize(lower(arguments[1], coordinates));
+            node.b = materialize(lower(arguments[2], coordinates));
+            node.c = coordinates;
+            node.p0 = strength;
+            return lower(arguments[0], add_node(node).node);
+        }
+
+        FastNoiseLite::NoiseType noise_type;
+        try
+        {
+            noise_type = parse_noise_type(name);
+        }
+        catch (const std::runtime_error &)
+        {
+            fail("unknown function " + name);
+        }
+        return source(expression, noise_type, coordinates);
+    }
+
+    // Nodes read by a node, a node read twice appears twice
+    auto inputs(const Node &node) const -> std::vector<int>
+    {
+        std::vector<int> result;
+        for (int input : {node.a, node.b, node.c})
+        {
+            if (input >= 0)
+                result.push_back(input);
+        }
+        return result;
+    }
+
+    auto count_readers(int index, std::vector<bool> &visited) -> void
+    {
+        if (visited[index])
+            return;
+        visited[index] = true;
+        for (int input : inputs(nodes[index]))
+        {
+            ++remaining_readers[input];
+            count_readers(input, visited);
+        }
+    }
+
+    auto allocate() -> int
+    {
+        if (free_registers.empty())
+            return register_count++;
+        int reg = free_registers.back();
+        free_registers.pop_back();
+        return reg;
+    }
+
+    auto release(const Node &node) -> void
+    {
+        for (int input : inputs(node))
+        {
+            if (--remaining_readers[input] > 0)
+                continue;
+            free_registers.push_back(node_register[input]);
+            if (node_register2[input] >= 0)
+                free_registers.push_back(node_register2[input]);
+        }
+    }
+
+    // Schedules a node after its inputs, depth first
+    auto schedule(int index) -> void
+    {
+        if (node_register[index] >= 0)
+            return;
+        const Node node = nodes[index];
+        for (int input : inputs(node))
+            schedule(input);
+
+        GraphInstruction instruction{node.op, -1};
+        instruction.p0 = node.p0;
+        instruction.p1 = node.p1;
+        instruction.source = node.source;
+        instruction.a = node.a >= 0 ? node_register[node.a] : -1;
+        instruction.b = node.b >= 0 ? node_register[node.b] : -1;
+
+        bool warped = node.c >= 0;
+        int x = warped ? node_register[node.c] : GRAPH_COORDINATE_X;
+        int y = warped ? node_register2[node.c] : GRAPH_COORDINATE_Y;
+        if (node.op == GraphOp::NOISE || node.op == GraphOp::OCTAVES)
+        {
+            instruction.a = x;
+            instruction.b = y;
+        }
+        else if (node.op == GraphOp::WARP)
+        {
+            instruction.c = x;
+            instruction.d = y;
+        }
+
+        // Every instruction except OCTAVES reads each pixel of its inputs before writing the
+        // same pixel of its outputs, so the outputs may reuse the registers of the inputs
+        if (node.op != GraphOp::OCTAVES)
+            release(node);
+        instruction.out = allocate();
+        if (node.op == GraphOp::WARP)
+            instruction.out2 = allocate();
+        if (node.op == GraphOp::OCTAVES)
+            release(node);
+
+        node_register[index] = instruction.out;
+        node_register2[index] = instruction.out2;
+        program.push_back(instruction);
+    }
+
+  public:
+    std::vector<NoiseGraph::Source> sources;
+    std::vector<GraphInstruction> program;
+    int register_count = 2;
+    int output = -1;
+
+    GraphCompiler(const NoiseMap &octaves, int seed) : octaves(octaves), seed(seed) {}
+
+    auto compile(const std::string &expression) -> void
+    {
+        text = expression;
+        int root = materialize(lower(GraphParser(expression).parse(), -1));
+
+        node_register.assign(nodes.size(), -1);
+        node_register2.assign(nodes.size(), -1);
+        remaining_readers.assign(nodes.size(), 0);
+        std::vector<bool> visited(nodes.size(), false);
+        count_readers(root, visited);
+        schedule(root);
+        output = node_register[root];
+    }
+};
+
+NoiseGraph::NoiseGraph(const std::string &expression, NoiseMap octaves, int seed)
+    : octaves(std::move(octaves))
+{
+    GraphCompiler compiler(this->octaves, seed);
+    compiler.compile(expression);
+    sources = std::move(compiler.sources);
+    program = std::move(compiler.program);
+    register_count = compiler.register_count;
+    output = compiler.output;
+}
+
+auto NoiseGraph::has_graph(const confparse::Config &cfg, const std::string &prefix) -> bool
+{
+    const auto &graph = cfg.get(prefix + ".graph");
+    return !graph.is_empty() && !graph.as_string().empty();
+}
+
+auto NoiseGraph::from_config(const confparse::Config &cfg, const std::string &prefix, int seed,
+                             NoiseMap octaves) -> NoiseGraph
+{
+    return NoiseGraph(cfg.get(prefix + ".graph").as_string(), std::move(octaves), seed);
+}
+
+auto NoiseGraph::instructions() const -> const std::vector<GraphInstruction> &
+{
+    return program;
+}
+
+auto NoiseGraph::registers() const -> int { return register_count; }
+
+auto NoiseGraph::create(const ChunkCoordinates &chunk, float scale, float *output_values,
+                        const float *warp_x, const float *warp_y, int stride) const -> void
+{
+    int width = static_cast<int>(chunk.columns.size());
+    int height = static_cast<int>(chunk.rows.size());
+    std::vector<float> registers(static_cast<size_t>(register_count) * width);
+    auto reg = [&registers, width](int index)
+    { return &registers[static_cast<size_t>(index) * width]; };
+
+    for (int x = 0; x < width; ++x)
+        reg(GRAPH_COORDINATE_X)[x] = scale * chunk.columns[x];
+
+    // Everything that does not depend on the row is computed once per chunk: the noise coordinates
+    // of the columns of every source on the pixel grid, and the coordinates of the noise map (or
+    // the whole noise map with the spectral backend). With a warped grid, every source reads its
+    // coordinates from the registers
+    bool uses_row = warp_x != nullptr;
+    std::vector<bool> on_grid(program.size());
+    std::vector<std::vector<float>> source_columns(program.size());
+    std::vector<float> octave_columns, octave_rows, spectral;
+    for (size_t i = 0; i < program.size(); ++i)
+    {
+        const auto &instruction = program[i];
+        on_grid[i] = !warp_x && instruction.a == GRAPH_COORDINATE_X;
+        bool warped = !on_grid[i];
+        if (instruction.op == GraphOp::WARP)
+            uses_row = uses_row || instruction.d == GRAPH_COORDINATE_Y;
+        if (instruction.op == GraphOp::OCTAVES && warped &&
+            octaves.backend() == NoiseBackend::SPECTRAL)
+            throw std::runtime_error("Noise graph: octaves with the spectral backend cannot be "
+                                     "warped");
+        if (instruction.op == GraphOp::NOISE && !warped)
+        {
+            float frequency = sources[instruction.source].frequency;
+            source_columns[i].resize(width);
+            for (int x = 0; x < width; ++x)
+                source_columns[i][x] = frequency * reg(GRAPH_COORDINATE_X)[x];
+        }
+        if (instruction.op == GraphOp::OCTAVES && !warped)
+        {
+            if (octaves.backend() == NoiseBackend::SPECTRAL)
+            {
+                spectral.resize(static_cast<size_t>(width) * height);
+                octaves.create_spectral(chunk, scale, spectral.data(), nullptr, nullptr, stride);
+            }
+            else
+                octaves.octave_coordinates(chunk, scale, octave_columns, octave_rows);
+        }
+    }
+
+    std::vector<float> samples(static_cast<size_t>(3) * width);
+    for (int y = 0; y < height; ++y)
+    {
+        float row = scale * chunk.rows[y];
+        auto offset = static_cast<size_t>(y) * width;
+        if (warp_x)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                reg(GRAPH_COORDINATE_X)[x] = scale * warp_x[offset + x];
+                reg(GRAPH_COORDINATE_Y)[x] = scale * warp_y[offset + x];
+            }
+        }
+        else if (uses_row)
+            std::fill_n(reg(GRAPH_COORDINATE_Y), width, row);
+
+        for (size_t i = 0; i < program.size(); ++i)
+        {
+            const auto &instruction = program[i];
+            float *out = reg(instruction.out);
+            const float *a = instruction.a >= 0 ? reg(instruction.a) : nullptr;
+            const float *b = instruction.b >= 0 ? reg(instruction.b) : nullptr;
+            float p0 = instruction.p0, p1 = instruction.p1;
+            switch (instruction.op)
+            {
+            case GraphOp::CONSTANT:
+                std::fill_n(out, width, p0);
+                break;
+            case GraphOp::NOISE:
+            {
+                const auto &source = sources[instruction.source];
+                if (on_grid[i])
+                {
+                    source.generator.at_row(source_columns[i].data(), source.frequency * row, out,
+                                            width);
+                    break;
+                }
+                float *xs = samples.data();
+                float *ys = xs + width;
+                for (int x = 0; x < width; ++x)
+                {
+                    xs[x] = source.frequency * a[x];
+                    ys[x] = source.frequency * b[x];
+                }
+                source.generator.at_batch(xs, ys, out, width);
+                break;
+            }
+            case GraphOp::OCTAVES:
+                if (!on_grid[i])
+                    octaves.create_batch(a, b, out, samples.data(), width);
+                else if (!spectral.empty())
+                    std::copy_n(&spectral[offset], width, out);
+                else
+                    octaves.create_row(octave_columns, octave_rows, y, width, height, out,
+                                       samples.data());
+                break;
+            case GraphOp::ADD:
+                for (int x = 0; x < width; ++x)
+                    out[x] = a[x] + b[x];
+                break;
+            case GraphOp::SUB:
+                for (int x = 0; x < width; ++x)
+                    out[x] = a[x] - b[x];
+                break;
+            case GraphOp::MUL:
+                for (int x = 0; x < width; ++x)
+                    out[x] = a[x] * b[x];
+                break;
+            case GraphOp::MIN:
+                for (int x = 0; x < width; ++x)
+                    out[x] = std::min(a[x], b[x]);
+                break;
+            case GraphOp::MAX:
+                for (int x = 0; x < width; ++x)
+                    out[x] = std::max(a[x], b[x]);
+                break;
+            case GraphOp::AFFINE:
+                for (int x = 0; x < width; ++x)
+                    out[x] = a[x] * p0 + p1;
+                break;
+            case GraphOp::CLAMP:
+                for (int x = 0; x < width; ++x)
+                    out[x] = std::min(std::max(a[x], p0), p1);
+                break;
+            case GraphOp::ABS:
+                for (int x = 0; x < width; ++x)
+                    out[x] = std::fabs(a[x]);
+                break;
+            case GraphOp::RIDGED:
+                for (int x = 0; x < width; ++x)
+                    out[x] = 1.0f - std::fabs(2.0f * a[x] - 1.0f);
+                break;
+            case GraphOp::WARP:
+            {
+                const float *c = reg(instruction.c);
+                const float *d = reg(instruction.d);
+                float *out2 = reg(instruction.out2);
+                for (int x = 0; x < width; ++x)
+                {
+                    float warped_x = c[x] + p0 * (2.0f * a[x] - 1.0f);
+                    float warped_y = d[x] + p0 * (2.0f * b[x] - 1.0f);
+                    out[x] = warped_x;
+                    out2[x] = warped_y;
+                }
+                break;
+            }
+            }
+        }
+        std::copy_n(reg(output), width, output_values + offset);
+    }
+}
@@ -0,0 +1,118 @@
+#ifndef A_NOISE_GRAPH_H
+#define A_NOISE_GRAPH_H
+
+#include "confparse.hpp"
+#include "noise.hpp"
+#include <string>
+#include <vector>
+
+// Operation of one instruction of a compiled noise graph. Every instruction works on whole
+// registers, a register holds one value per pixel of a row
+enum class GraphOp
+{
+    // out = p0
+    CONSTANT,
+    // out = noise source at (a, b) times the frequency of the source
+    NOISE,
+    // out = the noise map of the field at (a, b)
+    OCTAVES,
+    // out = a + b, a - b, a * b, min(a, b), max(a, b)
+    ADD,
+    SUB,
+    MUL,
+    MIN,
+    MAX,
+    // out = a * p0 + p1
+    AFFINE,
+    // out = min(max(a, p0), p1)
+    CLAMP,
+    // out = |a|
+    ABS,
+    // out = 1 - |2 a - 1|
+    RIDGED,
+    // out = c + p0 * (2 a - 1), out2 = d + p0 * (2 b - 1)
+    WARP
+};
+
+struct GraphInstruction
+{
+    GraphOp op;
+    // Registers written by the instruction, out2 is only used by WARP
+    int out;
+    int out2 = -1;
+    // Registers read by the instruction, -1 when unused. NOISE and OCTAVES read the coordinates
+    // from a and b
+    int a = -1, b = -1, c = -1, d = -1;
+    float p0 = 0.0f, p1 = 0.0f;
+    // Index of the noise source of NOISE
+    int source = -1;
+};
+
+// Register 0 holds the column of every pixel and register 1 the row, in chunk units times the
+// scale of the field, the coordinates of every source that is not warped
+#define GRAPH_COORDINATE_X 0
+#define GRAPH_COORDINATE_Y 1
+
+// A noise graph from the config, an expression such as
+//   clamp(add(octaves, mul(ridged(warp(perlin(4), value(2), value(2, 1), 0.1)), 0.3)), 0, 1)
+// Sources:
+//   octaves                     the noise map of the field (<prefix>.octaves, ...)
+//   <noise type>(f, s)          one octave of a noise type (see parse_noise_type) at frequency f
+//                               (default 1, at most 1e5 in magnitude), s (default 0) picks
+//                               another seed
+//   numbers                     finite, like every expression of numbers
+// Operators:
+//   add(a, b, ...), sub(a, b), mul(a, b, ...), min(a, b, ...), max(a, b, ...), abs(a)
+//   ridged(a)                   1 - |2 a - 1|
+//   clamp(a, low, high)         low and high are numbers
+//   remap(a, l0, h0, l1, h1)    maps [l0, h0] linearly onto [l1, h1], all bounds are numbers
+//   warp(a, dx, dy, s)          evaluates a with every source moved by s * (2 dx - 1) along x
+//                               and s * (2 dy - 1) along y, s is a number in noise units
+//
+// The expression is compiled once into a flat list of instructions over registers. Identical
+// subexpressions are evaluated once, constants are folded and chains of affine operations (mul
+// and add of numbers, remap) are merged into a single instruction. Registers are reused as soon
+// as their last reader has run. The instructions are run one row at a time, so every instruction
+// is a tight loop over the pixels of a row and the sources use the batch noise kernels
+class NoiseGraph
+{
+    struct Source
+    {
+        NoiseGenerator generator;
+        float frequency;
+    };
+
+    NoiseMap octaves;
+    std::vector<Source> sources;
+    std::vector<GraphInstruction> program;
+    int register_count;
+    int output;
+
+    friend class GraphCompiler;
+
+  public:
+    // Compiles expression, throws std::runtime_error if it is not a valid graph. octaves is the
+    // noise map used by the octaves source, seed is the seed of the field
+    NoiseGraph(const std::string &expression, NoiseMap octaves, int seed);
+
+    // The graph in <prefix>.graph, false if there is none
+    static auto has_graph(const confparse::Config &cfg, const std::string &prefix) -> bool;
+
+    static auto from_config(const confparse::Config &cfg, const std::string &prefix, int seed,
+                            NoiseMap octaves) -> NoiseGraph;
+
+    auto instructions() const -> const std::vector<GraphInstruction> &;
+
+    // Number of registers, including the two coordinate registers
+    auto registers() const -> int;
+
+    // Evaluates the graph at every pixel of the chunk, output must hold width * height values.
+    // With warp_x and warp_y, the pixels are at those positions in chunk units instead (see
+    // Chunk::warp_x), octaves with the spectral backend cannot be warped. stride is passed to
+    // NoiseMap::create_spectral()
+    auto create(const ChunkCoordinates &chunk, float scale, float *output,
+                const float *warp_x = nullptr, const float *warp_y = nullptr,
+                int stride = 1) const -> void;
+};
+
+#endif // A_NOISE_GRAPH_H
@@ -1,11 +1,29 @@
 #include "registries.hpp"
 #include "confparse.hpp"
+#include "fingerprint.hpp"
+#include <algorithm>
 #include <sstream>
 
+static auto insert_threshold(std::vector<float> &thresholds, float value) -> void
+{
+    auto it = std::lower_bound(thresholds.begin(), thresholds.end(), value);
+    if (it == thresholds.end() || *it != value)
+        thresholds.insert(it, value);
+}
+
 auto BiomeRegistry::register_biome(Biome biome) -> int
 {
     biome.register_id = static_cast<int>(biomes.size());
     biomes.push_back(biome);
+    ranges_.elevation_start.push_back(biome.elevation_start);
+    ranges_.elevation_end.push_back(biome.elevation_end);
+    ranges_.moisture_start.push_back(biome.moisture_start);
+    ranges_.moisture_end.push_back(biome.moisture_end);
+    ranges_.ids.push_back(biome.register_id);
+    insert_threshold(ranges_.elevation_thresholds, biome.elevation_start);
+    insert_threshold(ranges_.elevation_thresholds, biome.elevation_end);
+    insert_threshold(ranges_.moisture_thresholds, biome.moisture_start);
+    insert_threshold(ranges_.moisture_thresholds, biome.moisture_end);
     logger::info("[Biome] Registered \"{}\" with id {}", biome.string_id, biome.register_id);
     return biome.register_id;
 }
@@ -25,6 +43,7 @@ auto BiomeRegistry::get_id(const std::string &string_id) const -> int
 auto BiomeRegistry::load(const std::string &file_path) -> void
 {
     biomes.clear();
+    ranges_ = BiomeRanges();
     logger::info("Loading biome data from {}", file_path);
     auto parser = confparse::ConfigParser();
     parser.options.single_line_comments = ";";
@@ -90,6 +109,19 @@ auto BiomeRegistry::get_biome_within_range(float moisture, float elevation) cons
     return -1;
 }
 
+auto BiomeRanges::fingerprint() const -> uint64_t
+{
+    Fingerprint result;
+    result.add(elevation_start).add(elevation_end).add(moisture_start).add(moisture_end);
+    for (auto id : ids)
+        result.add(id);
+    return result.value();
+}
+
+auto BiomeRegistry::ranges() const -> const BiomeRanges & { return ranges_; }
+
+auto BiomeRegistry::size() const -> size_t { return biomes.size(); }
+
 auto Registry::load(const std::filesystem::path &data_folder_path) -> void
 {
 
@@ -21,9 +21,34 @@ struct Biome
     float moisture_end;
 };
 
+// Biome ranges as separate arrays in registration order, used by the batch classification kernels
+struct BiomeRanges
+{
+    std::vector<float> elevation_start;
+    std::vector<float> elevation_end;
+    std::vector<float> moisture_start;
+    std::vector<float> moisture_end;
+    std::vector<int> ids;
+    // Every distinct start and end value in ascending order, a value that changes without crossing
+    // one of these keeps its biome
+    std::vector<float> elevation_thresholds;
+    std::vector<float> moisture_thresholds;
+
+    // Hash of the ranges and ids, see Fingerprint
+    auto fingerprint() const -> uint64_t;
+
+    auto operator==(const BiomeRanges &other) const -> bool
+    {
+        return ids == other.ids && elevation_start == other.elevation_start &&
+               elevation_end == other.elevation_end && moisture_start == other.moisture_start &&
+               moisture_end == other.moisture_end;
+    }
+};
+
 class BiomeRegistry
 {
     std::vector<Biome> biomes;
+    BiomeRanges ranges_;
 
   public:
     auto register_biome(Biome biome) -> int;
@@ -35,6 +60,10 @@ class BiomeRegistry
     auto load(const std::string &file_path) -> void;
     
     auto get_biome_within_range(float moisture, float elevation) const -> int;
+
+    auto ranges() const -> const BiomeRanges &;
+
+    auto size() const -> size_t;
 };
 
 class Registry
@@ -0,0 +1,504 @@
+#ifndef A_SIMD_H
+#define A_SIMD_H
+
+// Thin wrappers over x86 intrinsics, so that a kernel can be written once as a template over the
+// vector type and instantiated for every instruction set that the compiler is allowed to emit.
+// Every wrapper exposes the same set of static functions, only the lane count differs.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define SIMD_HAS_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+#define SIMD_HAS_AVX512 1
+#include <immintrin.h>
+#endif
+
+namespace simd
+{
+
+// This header is included by translation units compiled with different instruction sets (see
+// kernels_*.cpp). The wrappers have internal linkage, otherwise the linker could pick an AVX-512
+// copy of an inline function for code that runs on a machine without AVX-512
+namespace
+{
+
+// Plain C++ fallback with a single lane, used on targets without SSE2
+struct Scalar
+{
+    static constexpr size_t width = 1;
+    using f32 = float;
+    using i32 = int32_t;
+    using mask = bool;
+
+    static auto load(const float *p) -> f32 { return *p; }
+
+    static auto load_i(const int32_t *p) -> i32 { return *p; }
+
+    static auto store(float *p, f32 v) -> void { *p = v; }
+
+    static auto store_i(int32_t *p, i32 v) -> void { memcpy(p, &v, sizeof(v)); }
+
+    // Zero extended 16 and 8 bit values, store_u16 keeps the low 16 bits of every lane
+    static auto load_u16(const uint16_t *p) -> i32 { return *p; }
+
+    static auto load_u8(const uint8_t *p) -> i32 { return *p; }
+
+    static auto store_u16(uint16_t *p, i32 v) -> void { *p = static_cast<uint16_t>(v); }
+
+    static auto set1(float v) -> f32 { return v; }
+
+    static auto set1_i(int32_t v) -> i32 { return v; }
+
+    static auto add(f32 a, f32 b) -> f32 { return a + b; }
+
+    static auto sub(f32 a, f32 b) -> f32 { return a - b; }
+
+    static auto mul(f32 a, f32 b) -> f32 { return a * b; }
+
+    static auto div(f32 a, f32 b) -> f32 { return a / b; }
+
+    static auto min(f32 a, f32 b) -> f32 { return a < b ? a : b; }
+
+    static auto max(f32 a, f32 b) -> f32 { return a > b ? a : b; }
+
+    static auto gt(f32 a, f32 b) -> mask { return a > b; }
+
+    static auto lt(f32 a, f32 b) -> mask { return a < b; }
+
+    static auto ge(f32 a, f32 b) -> mask { return a >= b; }
+
+    static auto le(f32 a, f32 b) -> mask { return a <= b; }
+
+    static auto mask_and(mask a, mask b) -> mask { return a && b; }
+
+    static auto mask_andnot(mask a, mask b) -> mask { return !a && b; }
+
+    static auto mask_or(mask a, mask b) -> mask { return a || b; }
+
+    static auto all(mask m) -> bool { return m; }
+
+    static auto select(mask m, f32 a, f32 b) -> f32 { return m ? a : b; }
+
+    static auto select_i(mask m, i32 a, i32 b) -> i32 { return m ? a : b; }
+
+    static auto add_i(i32 a, i32 b) -> i32
+    {
+        return static_cast<int32_t>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b));
+    }
+
+    static auto mul_i(i32 a, i32 b) -> i32
+    {
+        return static_cast<int32_t>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b));
+    }
+
+    static auto xor_i(i32 a, i32 b) -> i32 { return a ^ b; }
+
+    static auto and_i(i32 a, i32 b) -> i32 { return a & b; }
+
+    static auto or_i(i32 a, i32 b) -> i32 { return a | b; }
+
+    static auto srai(i32 a, int n) -> i32 { return a >> n; }
+
+    static auto srli(i32 a, int n) -> i32
+    {
+        return static_cast<int32_t>(static_cast<uint32_t>(a) >> n);
+    }
+
+    static auto slli(i32 a, int n) -> i32
+    {
+        return static_cast<int32_t>(static_cast<uint32_t>(a) << n);
+    }
+
+    // Reinterpret the bits of a float as an integer and back
+    static auto as_int(f32 a) -> i32
+    {
+        i32 i;
+        memcpy(&i, &a, sizeof(i));
+        return i;
+    }
+
+    static auto as_float(i32 a) -> f32
+    {
+        f32 f;
+        memcpy(&f, &a, sizeof(f));
+        return f;
+    }
+
+    static auto to_float(i32 a) -> f32 { return static_cast<float>(a); }
+
+    // Truncates towards zero, like a C style cast
+    static auto truncate(f32 a) -> i32 { return static_cast<int32_t>(a); }
+
+    static auto gather(const float *table, i32 idx) -> f32 { return table[idx]; }
+
+    static auto gather_i(const int32_t *table, i32 idx) -> i32 { return table[idx]; }
+};
+
+#ifdef SIMD_HAS_SSE2
+struct Sse2
+{
+    static constexpr size_t width = 4;
+    using f32 = __m128;
+    using i32 = __m128i;
+    using mask = __m128;
+
+    static auto load(const float *p) -> f32 { return _mm_loadu_ps(p); }
+
+    static auto load_i(const int32_t *p) -> i32
+    {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    }
+
+    static auto store(float *p, f32 v) -> void { _mm_storeu_ps(p, v); }
+
+    static auto store_i(int32_t *p, i32 v) -> void
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v);
+    }
+
+    static auto load_u16(const uint16_t *p) -> i32
+    {
+        return _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)),
+                                  _mm_setzero_si128());
+    }
+
+    static auto load_u8(const uint8_t *p) -> i32
+    {
+        int32_t bytes;
+        memcpy(&bytes, p, sizeof(bytes));
+        auto zero = _mm_setzero_si128();
+        return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+    }
+
+    static auto store_u16(uint16_t *p, i32 v) -> void
+    {
+        // Sign extends the low 16 bits, so that the saturating pack keeps them unchanged
+        auto low = _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(p), _mm_packs_epi32(low, low));
+    }
+
+    static auto set1(float v) -> f32 { return _mm_set1_ps(v); }
+
+    static auto set1_i(int32_t v) -> i32 { return _mm_set1_epi32(v); }
+
+    static auto add(f32 a, f32 b) -> f32 { return _mm_add_ps(a, b); }
+
+    static auto sub(f32 a, f32 b) -> f32 { return _mm_sub_ps(a, b); }
+
+    static auto mul(f32 a, f32 b) -> f32 { return _mm_mul_ps(a, b); }
+
+    static auto div(f32 a, f32 b) -> f32 { return _mm_div_ps(a, b); }
+
+    static auto min(f32 a, f32 b) -> f32 { return _mm_min_ps(a, b); }
+
+    static auto max(f32 a, f32 b) -> f32 { return _mm_max_ps(a, b); }
+
+    static auto gt(f32 a, f32 b) -> mask { return _mm_cmpgt_ps(a, b); }
+
+    static auto lt(f32 a, f32 b) -> mask { return _mm_cmplt_ps(a, b); }
+
+    static auto ge(f32 a, f32 b) -> mask { return _mm_cmpge_ps(a, b); }
+
+    static auto le(f32 a, f32 b) -> mask { return _mm_cmple_ps(a, b); }
+
+    static auto mask_and(mask a, mask b) -> mask { return _mm_and_ps(a, b); }
+
+    static auto mask_andnot(mask a, mask b) -> mask { return _mm_andnot_ps(a, b); }
+
+    static auto mask_or(mask a, mask b) -> mask { return _mm_or_ps(a, b); }
+
+    static auto all(mask m) -> bool { return _mm_movemask_ps(m) == 0xF; }
+
+    static auto select(mask m, f32 a, f32 b) -> f32
+    {
+        return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+    }
+
+    static auto select_i(mask m, i32 a, i32 b) -> i32
+    {
+        auto mi = _mm_castps_si128(m);
+        return _mm_or_si128(_mm_and_si128(mi, a), _mm_andnot_si128(mi, b));
+    }
+
+    static auto add_i(i32 a, i32 b) -> i32 { return _mm_add_epi32(a, b); }
+
+    // SSE2 has no 32 bit low multiply, so multiply the even and odd lanes separately
+    static auto mul_i(i32 a, i32 b) -> i32
+    {
+        auto even = _mm_mul_epu32(a, b);
+        auto odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+        return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                                  _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+    }
+
+    static auto xor_i(i32 a, i32 b) -> i32 { return _mm_xor_si128(a, b); }
+
+    static auto and_i(i32 a, i32 b) -> i32 { return _mm_and_si128(a, b); }
+
+    static auto or_i(i32 a, i32 b) -> i32 { return _mm_or_si128(a, b); }
+
+    static auto srai(i32 a, int n) -> i32 { return _mm_sra_epi32(a, _mm_cvtsi32_si128(n)); }
+
+    static auto srli(i32 a, int n) -> i32 { return _mm_srl_epi32(a, _mm_cvtsi32_si128(n)); }
+
+    static auto slli(i32 a, int n) -> i32 { return _mm_sll_epi32(a, _mm_cvtsi32_si128(n)); }
+
+    static auto as_int(f32 a) -> i32 { return _mm_castps_si128(a); }
+
+    static auto as_float(i32 a) -> f32 { return _mm_castsi128_ps(a); }
+
+    static auto to_float(i32 a) -> f32 { return _mm_cvtepi32_ps(a); }
+
+    static auto truncate(f32 a) -> i32 { return _mm_cvttps_epi32(a); }
+
+    static auto gather(const float *table, i32 idx) -> f32
+    {
+        alignas(16) int32_t i[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(i), idx);
+        return _mm_setr_ps(table[i[0]], table[i[1]], table[i[2]], table[i[3]]);
+    }
+
+    static auto gather_i(const int32_t *table, i32 idx) -> i32
+    {
+        alignas(16) int32_t i[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(i), idx);
+        return _mm_setr_epi32(table[i[0]], table[i[1]], table[i[2]], table[i[3]]);
+    }
+};
+#endif
+
+#ifdef SIMD_HAS_AVX2
+struct Avx2
+{
+    static constexpr size_t width = 8;
+    using f32 = __m256;
+    using i32 = __m256i;
+    using mask = __m256;
+
+    static auto load(const float *p) -> f32 { return _mm256_loadu_ps(p); }
+
+    static auto load_i(const int32_t *p) -> i32
+    {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    }
+
+    static auto store(float *p, f32 v) -> void { _mm256_storeu_ps(p, v); }
+
+    static auto store_i(int32_t *p, i32 v) -> void
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v);
+    }
+
+    static auto load_u16(const uint16_t *p) -> i32
+    {
+        return _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+    }
+
+    static auto load_u8(const uint8_t *p) -> i32
+    {
+        return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+    }
+
+    static auto store_u16(uint16_t *p, i32 v) -> void
+    {
+        // The pack works within 128 bit lanes, the permutation joins the low halves of both
+        auto low = _mm256_and_si256(v, _mm256_set1_epi32(0xFFFF));
+        auto packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(low, low), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p), _mm256_castsi256_si128(packed));
+    }
+
+    static auto set1(float v) -> f32 { return _mm256_set1_ps(v); }
+
+    static auto set1_i(int32_t v) -> i32 { return _mm256_set1_epi32(v); }
+
+    static auto add(f32 a, f32 b) -> f32 { return _mm256_add_ps(a, b); }
+
+    static auto sub(f32 a, f32 b) -> f32 { return _mm256_sub_ps(a, b); }
+
+    static auto mul(f32 a, f32 b) -> f32 { return _mm256_mul_ps(a, b); }
+
+    static auto div(f32 a, f32 b) -> f32 { return _mm256_div_ps(a, b); }
+
+    static auto min(f32 a, f32 b) -> f32 { return _mm256_min_ps(a, b); }
+
+    static auto max(f32 a, f32 b) -> f32 { return _mm256_max_ps(a, b); }
+
+    static auto gt(f32 a, f32 b) -> mask { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+
+    static auto lt(f32 a, f32 b) -> mask { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+
+    static auto ge(f32 a, f32 b) -> mask { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+
+    static auto le(f32 a, f32 b) -> mask { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+
+    static auto mask_and(mask a, mask b) -> mask { return _mm256_and_ps(a, b); }
+
+    static auto mask_andnot(mask a, mask b) -> mask { return _mm256_andnot_ps(a, b); }
+
+    static auto mask_or(mask a, mask b) -> mask { return _mm256_or_ps(a, b); }
+
+    static auto all(mask m) -> bool { return _mm256_movemask_ps(m) == 0xFF; }
+
+    static auto select(mask m, f32 a, f32 b) -> f32 { return _mm256_blendv_ps(b, a, m); }
+
+    static auto select_i(mask m, i32 a, i32 b) -> i32
+    {
+        return _mm256_castps_si256(
+            _mm256_blendv_ps(_mm256_castsi256_ps(b), _mm256_castsi256_ps(a), m));
+    }
+
+    static auto add_i(i32 a, i32 b) -> i32 { return _mm256_add_epi32(a, b); }
+
+    static auto mul_i(i32 a, i32 b) -> i32 { return _mm256_mullo_epi32(a, b); }
+
+    static auto xor_i(i32 a, i32 b) -> i32 { return _mm256_xor_si256(a, b); }
+
+    static auto and_i(i32 a, i32 b) -> i32 { return _mm256_and_si256(a, b); }
+
+    static auto or_i(i32 a, i32 b) -> i32 { return _mm256_or_si256(a, b); }
+
+    static auto srai(i32 a, int n) -> i32 { return _mm256_sra_epi32(a, _mm_cvtsi32_si128(n)); }
+
+    static auto srli(i32 a, int n) -> i32 { return _mm256_srl_epi32(a, _mm_cvtsi32_si128(n)); }
+
+    static auto slli(i32 a, int n) -> i32 { return _mm256_sll_epi32(a, _mm_cvtsi32_si128(n)); }
+
+    static auto as_int(f32 a) -> i32 { return _mm256_castps_si256(a); }
+
+    static auto as_float(i32 a) -> f32 { return _mm256_castsi256_ps(a); }
+
+    static auto to_float(i32 a) -> f32 { return _mm256_cvtepi32_ps(a); }
+
+    static auto truncate(f32 a) -> i32 { return _mm256_cvttps_epi32(a); }
+
+    static auto gather(const float *table, i32 idx) -> f32
+    {
+        return _mm256_i32gather_ps(table, idx, 4);
+    }
+
+    static auto gather_i(const int32_t *table, i32 idx) -> i32
+    {
+        return _mm256_i32gather_epi32(table, idx, 4);
+    }
+};
+#endif
+
+#ifdef SIMD_HAS_AVX512
+struct Avx512
+{
+    static constexpr size_t width = 16;
+    using f32 = __m512;
+    using i32 = __m512i;
+    using mask = __mmask16;
+
+    static auto load(const float *p) -> f32 { return _mm512_loadu_ps(p); }
+
+    static auto load_i(const int32_t *p) -> i32 { return _mm512_loadu_si512(p); }
+
+    static auto store(float *p, f32 v) -> void { _mm512_storeu_ps(p, v); }
+
+    static auto store_i(int32_t *p, i32 v) -> void { _mm512_storeu_si512(p, v); }
+
+    static auto load_u16(const uint16_t *p) -> i32
+    {
+        return _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)));
+    }
+
+    static auto load_u8(const uint8_t *p) -> i32
+    {
+        return _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+    }
+
+    static auto store_u16(uint16_t *p, i32 v) -> void
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), _mm512_cvtepi32_epi16(v));
+    }
+
+    static auto set1(float v) -> f32 { return _mm512_set1_ps(v); }
+
+    static auto set1_i(int32_t v) -> i32 { return _mm512_set1_epi32(v); }
+
+    static auto add(f32 a, f32 b) -> f32 { return _mm512_add_ps(a, b); }
+
+    static auto sub(f32 a, f32 b) -> f32 { return _mm512_sub_ps(a, b); }
+
+    static auto mul(f32 a, f32 b) -> f32 { return _mm512_mul_ps(a, b); }
+
+    static auto div(f32 a, f32 b) -> f32 { return _mm512_div_ps(a, b); }
+
+    static auto min(f32 a, f32 b) -> f32 { return _mm512_min_ps(a, b); }
+
+    static auto max(f32 a, f32 b) -> f32 { return _mm512_max_ps(a, b); }
+
+    static auto gt(f32 a, f32 b) -> mask { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+
+    static auto lt(f32 a, f32 b) -> mask { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+
+    static auto ge(f32 a, f32 b) -> mask { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+
+    static auto le(f32 a, f32 b) -> mask { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+
+    static auto mask_and(mask a, mask b) -> mask { return static_cast<mask>(a & b); }
+
+    static auto mask_andnot(mask a, mask b) -> mask { return static_cast<mask>(~a & b); }
+
+    static auto mask_or(mask a, mask b) -> mask { return static_cast<mask>(a | b); }
+
+    static auto all(mask m) -> bool { return m == 0xFFFF; }
+
+    static auto select(mask m, f32 a, f32 b) -> f32 { return _mm512_mask_blend_ps(m, b, a); }
+
+    static auto select_i(mask m, i32 a, i32 b) -> i32 { return _mm512_mask_blend_epi32(m, b, a); }
+
+    static auto add_i(i32 a, i32 b) -> i32 { return _mm512_add_epi32(a, b); }
+
+    static auto mul_i(i32 a, i32 b) -> i32 { return _mm512_mullo_epi32(a, b); }
+
+    static auto xor_i(i32 a, i32 b) -> i32 { return _mm512_xor_si512(a, b); }
+
+    static auto and_i(i32 a, i32 b) -> i32 { return _mm512_and_si512(a, b); }
+
+    static auto or_i(i32 a, i32 b) -> i32 { return _mm512_or_si512(a, b); }
+
+    static auto srai(i32 a, int n) -> i32 { return _mm512_sra_epi32(a, _mm_cvtsi32_si128(n)); }
+
+    static auto srli(i32 a, int n) -> i32 { return _mm512_srl_epi32(a, _mm_cvtsi32_si128(n)); }
+
+    static auto slli(i32 a, int n) -> i32 { return _mm512_sll_epi32(a, _mm_cvtsi32_si128(n)); }
+
+    static auto as_int(f32 a) -> i32 { return _mm512_castps_si512(a); }
+
+    static auto as_float(i32 a) -> f32 { return _mm512_castsi512_ps(a); }
+
+    static auto to_float(i32 a) -> f32 { return _mm512_cvtepi32_ps(a); }
+
+    static auto truncate(f32 a) -> i32 { return _mm512_cvttps_epi32(a); }
+
+    static auto gather(const float *table, i32 idx) -> f32
+    {
+        return _mm512_i32gather_ps(idx, table, 4);
+    }
+
+    static auto gather_i(const int32_t *table, i32 idx) -> i32
+    {
+        return _mm512_i32gather_epi32(idx, table, 4);
+    }
+};
+#endif
+
+} // namespace
+
+} // namespace simd
+
+#endif // A_SIMD_H
@@ -0,0 +1,171 @@
+#include "slab_pool.hpp"
+#include <new>
+#include <utility>
+
+// Free list capacity of slab_pool() until ChunkFactory::from_config() sets it
+#define SLAB_DEFAULT_CAPACITY (64 * 1024 * 1024)
+
+static auto allocate_block(size_t bytes) -> void *
+{
+    return ::operator new(bytes, std::align_val_t(SLAB_ALIGNMENT));
+}
+
+static auto free_block(void *data) -> void
+{
+    ::operator delete(data, std::align_val_t(SLAB_ALIGNMENT));
+}
+
+SlabBlock::SlabBlock() : data_(nullptr), size_(0), pool(nullptr) {}
+
+SlabBlock::SlabBlock(SlabBlock &&other) noexcept
+    : data_(other.data_), size_(other.size_), pool(other.pool)
+{
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.pool = nullptr;
+}
+
+auto SlabBlock::operator=(SlabBlock &&other) noexcept -> SlabBlock &
+{
+    if (this != &other)
+    {
+        release();
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(pool, other.pool);
+    }
+    return *this;
+}
+
+SlabBlock::~SlabBlock()
+{
+    release();
+}
+
+auto SlabBlock::data() const -> void *
+{
+    return data_;
+}
+
+auto SlabBlock::size() const -> size_t
+{
+    return size_;
+}
+
+auto SlabBlock::release() -> void
+{
+    if (pool)
+        pool->release(*this);
+}
+
+SlabPool::SlabPool(size_t capacity_bytes)
+    : capacity_bytes(capacity_bytes), free_bytes(0), allocations_(0)
+{
+}
+
+SlabPool::~SlabPool()
+{
+    for (auto &blocks : free_blocks)
+    {
+        for (auto data : blocks)
+            free_block(data);
+    }
+}
+
+auto SlabPool::size_class(size_t bytes) -> size_t
+{
+    size_t size_class = 0;
+    while (class_size(size_class) < bytes)
+        ++size_class;
+    return size_class;
+}
+
+auto SlabPool::class_size(size_t size_class) -> size_t
+{
+    // SLAB_MIN_BLOCK * 2^(size_class / steps) * (1 + (size_class % steps) / steps)
+    size_t base = static_cast<size_t>(SLAB_MIN_BLOCK) << (size_class / SLAB_CLASS_STEPS);
+    return base + base / SLAB_CLASS_STEPS * (size_class % SLAB_CLASS_STEPS);
+}
+
+auto SlabPool::trim() -> void
+{
+    // Larger blocks go first, they are the least likely to be asked for again
+    for (size_t c = free_blocks.size(); c-- > 0 && free_bytes > capacity_bytes;)
+    {
+        while (!free_blocks[c].empty() && free_bytes > capacity_bytes)
+        {
+            free_block(free_blocks[c].back());
+            free_blocks[c].pop_back();
+            free_bytes -= class_size(c);
+        }
+    }
+}
+
+auto SlabPool::acquire(size_t bytes) -> SlabBlock
+{
+    auto c = size_class(bytes);
+    SlabBlock block;
+    block.size_ = class_size(c);
+    block.pool = this;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (c < free_blocks.size() && !free_blocks[c].empty())
+        {
+            block.data_ = free_blocks[c].back();
+            free_blocks[c].pop_back();
+            free_bytes -= block.size_;
+            return block;
+        }
+        ++allocations_;
+    }
+    block.data_ = allocate_block(block.size_);
+    return block;
+}
+
+auto SlabPool::release(SlabBlock &block) -> void
+{
+    if (!block.data_)
+        return;
+    auto c = size_class(block.size_);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (block.size_ <= capacity_bytes)
+        {
+            if (c >= free_blocks.size())
+                free_blocks.resize(c + 1);
+            free_blocks[c].push_back(block.data_);
+            free_bytes += block.size_;
+            trim();
+        }
+        else
+            free_block(block.data_);
+    }
+    block.data_ = nullptr;
+    block.size_ = 0;
+    block.pool = nullptr;
+}
+
+auto SlabPool::set_capacity(size_t capacity_bytes) -> void
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->capacity_bytes = capacity_bytes;
+    trim();
+}
+
+auto SlabPool::size() const -> size_t
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return free_bytes;
+}
+
+auto SlabPool::allocations() const -> size_t
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return allocations_;
+}
+
+auto slab_pool() -> SlabPool &
+{
+    static SlabPool pool(SLAB_DEFAULT_CAPACITY);
+    return pool;
+}
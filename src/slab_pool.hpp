@@ -0,0 +1,96 @@
+#ifndef A_SLAB_POOL_H
+#define A_SLAB_POOL_H
+
+#include <mutex>
+#include <stddef.h>
+#include <vector>
+
+// Alignment of every block of the pool, one cache line, also enough for any SIMD load
+#define SLAB_ALIGNMENT 64
+
+// Size classes start at SLAB_MIN_BLOCK bytes, with SLAB_CLASS_STEPS classes per doubling, so a
+// block wastes at most 1 / SLAB_CLASS_STEPS of its size
+#define SLAB_MIN_BLOCK 4096
+#define SLAB_CLASS_STEPS 4
+
+class SlabPool;
+
+// A block of memory from a SlabPool, given back to the pool when released or destroyed
+class SlabBlock
+{
+    void *data_;
+    size_t size_;
+    SlabPool *pool;
+
+    friend class SlabPool;
+
+  public:
+    SlabBlock();
+
+    SlabBlock(const SlabBlock &) = delete;
+
+    SlabBlock(SlabBlock &&other) noexcept;
+
+    auto operator=(const SlabBlock &) -> SlabBlock & = delete;
+
+    auto operator=(SlabBlock &&other) noexcept -> SlabBlock &;
+
+    ~SlabBlock();
+
+    auto data() const -> void *;
+
+    // Size of the size class of the block, at least the requested size
+    auto size() const -> size_t;
+
+    // Gives the block back to its pool, the block is then empty
+    auto release() -> void;
+};
+
+// Hands out SLAB_ALIGNMENT aligned blocks in size classes and keeps released blocks on a free list
+// per class, so that chunks which are created and destroyed in bulk (a config reload) reuse the
+// same blocks instead of going through the allocator. Released blocks beyond the capacity are
+// freed. Safe to use from several threads
+class SlabPool
+{
+    std::vector<std::vector<void *>> free_blocks;
+    size_t capacity_bytes;
+    size_t free_bytes;
+    size_t allocations_;
+    mutable std::mutex mutex;
+
+    static auto size_class(size_t bytes) -> size_t;
+
+    static auto class_size(size_t size_class) -> size_t;
+
+    // Frees free blocks until they fit in the capacity
+    auto trim() -> void;
+
+  public:
+    SlabPool(size_t capacity_bytes);
+
+    SlabPool(const SlabPool &) = delete;
+
+    auto operator=(const SlabPool &) -> SlabPool & = delete;
+
+    ~SlabPool();
+
+    // A block of at least bytes bytes, with undefined contents
+    auto acquire(size_t bytes) -> SlabBlock;
+
+    auto release(SlabBlock &block) -> void;
+
+    // Capacity in bytes of the free lists
+    auto set_capacity(size_t capacity_bytes) -> void;
+
+    // Bytes held in the free lists
+    auto size() const -> size_t;
+
+    // Number of blocks taken from the allocator so far, acquire() calls served by a free list are
+    // not counted
+    auto allocations() const -> size_t;
+};
+
+// The pool of the chunk storage, see Chunk::allocate()
+auto slab_pool() -> SlabPool &;
+
+#endif // A_SLAB_POOL_H
@@ -0,0 +1,384 @@
+#include "spectral.hpp"
+#include "kernels.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+FourierTransform::FourierTransform(size_t n)
+    : n(n), twiddle_real(n - 1), twiddle_imag(n - 1), reversed(n)
+{
+    if (n < 2 || (n & (n - 1)) != 0)
+        throw std::runtime_error("FFT size must be a power of two");
+
+    for (size_t length = 2; length <= n; length <<= 1)
+    {
+        for (size_t k = 0; k < length / 2; ++k)
+        {
+            double angle = -2.0 * M_PI * static_cast<double>(k) / static_cast<double>(length);
+            twiddle_real[length / 2 - 1 + k] = static_cast<float>(std::cos(angle));
+            twiddle_imag[length / 2 - 1 + k] = static_cast<float>(std::sin(angle));
+        }
+    }
+
+    int bits = 0;
+    while ((static_cast<size_t>(1) << bits) < n)
+        ++bits;
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint32_t r = 0;
+        for (int b = 0; b < bits; ++b)
+            r |= static_cast<uint32_t>((i >> b) & 1) << (bits - 1 - b);
+        reversed[i] = r;
+    }
+}
+
+auto FourierTransform::size() const -> size_t { return n; }
+
+auto FourierTransform::transform_columns(float *real, float *imag, bool inverse) const -> void
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (i < reversed[i])
+        {
+            std::swap_ranges(real + i * n, real + (i + 1) * n, real + reversed[i] * n);
+            std::swap_ranges(imag + i * n, imag + (i + 1) * n, imag + reversed[i] * n);
+        }
+    }
+
+    // The inverse transform uses the conjugate twiddles
+    const auto &table = kernels();
+    float sign = inverse ? -1.0f : 1.0f;
+    for (size_t length = 2; length <= n; length <<= 1)
+    {
+        size_t half = length / 2;
+        for (size_t start = 0; start < n; start += length)
+        {
+            for (size_t k = 0; k < half; ++k)
+            {
+                size_t a = (start + k) * n;
+                size_t b = (start + k + half) * n;
+                table.fft_butterfly(real + a, imag + a, real + b, imag + b,
+                                    twiddle_real[half - 1 + k], sign * twiddle_imag[half - 1 + k],
+                                    n);
+            }
+        }
+    }
+}
+
+// Transposes a square grid in blocks, so both sides of a swap stay in cache
+static auto transpose(float *grid, size_t n) -> void
+{
+    const size_t block = 32;
+    for (size_t bi = 0; bi < n; bi += block)
+    {
+        for (size_t bj = bi; bj < n; bj += block)
+        {
+            for (size_t i = bi; i < std::min(bi + block, n); ++i)
+            {
+                for (size_t j = std::max(bj, i + 1); j < std::min(bj + block, n); ++j)
+                    std::swap(grid[i * n + j], grid[j * n + i]);
+            }
+        }
+    }
+}
+
+auto FourierTransform::transform_2d(float *real, float *imag, bool inverse) const -> void
+{
+    transform_columns(real, imag, inverse);
+    transpose(real, n);
+    transpose(imag, n);
+    transform_columns(real, imag, inverse);
+}
+
+// Rounds towards negative infinity
+static auto floor_div(int64_t a, int64_t b) -> int64_t
+{
+    return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+static auto tile_key(int64_t tile_x, int64_t tile_y) -> uint64_t
+{
+    return (static_cast<uint64_t>(tile_x) << 32) ^ static_cast<uint32_t>(tile_y);
+}
+
+SpectralSynthesis::SpectralSynthesis(int seed, const std::vector<float> &amplitudes)
+    : seed(seed), amplitudes(amplitudes)
+{
+}
+
+auto SpectralSynthesis::build(const std::vector<float> &frequencies) const
+    -> std::shared_ptr<const Levels>
+{
+    auto levels = std::make_shared<Levels>();
+
+    // Peaks in cycles per node and amplitudes of the bands of every level
+    std::vector<std::vector<float>> peaks, band_amplitudes;
+    for (size_t i = 0; i < frequencies.size(); ++i)
+    {
+        float frequency = frequencies[i];
+        if (!(frequency > 0.0f && frequency < 0.5f) || amplitudes[i] == 0.0f)
+            continue;
+        int level = 0;
+        while (level < 30 && std::ldexp(frequency, level + 1) <= SPECTRAL_LEVEL_FREQUENCY)
+            ++level;
+        if (peaks.size() <= static_cast<size_t>(level))
+        {
+            peaks.resize(level + 1);
+            band_amplitudes.resize(level + 1);
+        }
+        peaks[level].push_back(std::ldexp(frequency, level));
+        band_amplitudes[level].push_back(amplitudes[i]);
+    }
+
+    for (size_t level = 0; level < peaks.size(); ++level)
+    {
+        if (peaks[level].empty())
+            continue;
+        auto grid = std::make_unique<Level>();
+        grid->level = static_cast<int>(level);
+        // Every level gets its own white noise
+        grid->seed = seed + 1013 * static_cast<int>(level);
+        build_filter(*grid, peaks[level], band_amplitudes[level]);
+        levels->push_back(std::move(grid));
+    }
+    return levels;
+}
+
+auto SpectralSynthesis::levels_of(const std::vector<float> &frequencies)
+    -> std::shared_ptr<const Levels>
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = band_sets.find(frequencies);
+    if (found != band_sets.end())
+        return found->second;
+    if (band_sets.size() >= SPECTRAL_CACHED_BAND_SETS)
+        band_sets.clear();
+    auto levels = build(frequencies);
+    band_sets.emplace(frequencies, levels);
+    return levels;
+}
+
+auto SpectralSynthesis::build_filter(Level &level, const std::vector<float> &peaks,
+                                     const std::vector<float> &band_amplitudes) -> void
+{
+    // The lowest band has the widest kernel, which decides the size of the FFT. Tiles cover at
+    // least three quarters of it
+    float lowest = *std::min_element(peaks.begin(), peaks.end());
+    level.radius =
+        static_cast<int>(std::ceil(SPECTRAL_KERNEL_RADIUS / (SPECTRAL_BANDWIDTH * lowest)));
+    size_t size = 16;
+    while (size < static_cast<size_t>(8 * level.radius))
+        size <<= 1;
+    level.tile_size = static_cast<int>(size) - 2 * level.radius;
+    level.fft = std::make_unique<FourierTransform>(size);
+
+    // Power spectrum with a band around every peak, each band normalized to a variance of 1
+    // (Parseval, sum of |H|^2 / size^2) before it is weighted by the squared amplitude
+    auto n = static_cast<int64_t>(size);
+    std::vector<float> radii(size * size);
+    for (int64_t ky = 0; ky < n; ++ky)
+    {
+        for (int64_t kx = 0; kx < n; ++kx)
+        {
+            auto fx = static_cast<float>(kx < n / 2 ? kx : kx - n) / static_cast<float>(n);
+            auto fy = static_cast<float>(ky < n / 2 ? ky : ky - n) / static_cast<float>(n);
+            radii[ky * n + kx] = std::sqrt(fx * fx + fy * fy);
+        }
+    }
+    std::vector<float> power(size * size, 0.0f), band(size * size);
+    for (size_t i = 0; i < peaks.size(); ++i)
+    {
+        float inv_deviation = 1.0f / (SPECTRAL_BANDWIDTH * peaks[i]);
+        double band_power = 0.0;
+        for (size_t k = 0; k < band.size(); ++k)
+        {
+            float distance = (radii[k] - peaks[i]) * inv_deviation;
+            band[k] = std::exp(-distance * distance);
+            band_power += band[k];
+        }
+        auto weight = static_cast<float>(band_amplitudes[i] * band_amplitudes[i] *
+                                         static_cast<double>(size * size) / band_power);
+        for (size_t k = 0; k < power.size(); ++k)
+            power[k] += weight * band[k];
+    }
+
+    // The spectrum is radially symmetric, so its transpose is itself and the inverse transform
+    // gives the kernel in the normal layout, centered on node (0, 0) and wrapped around
+    std::vector<float> real(size * size), imag(size * size, 0.0f);
+    for (size_t k = 0; k < real.size(); ++k)
+        real[k] = std::sqrt(power[k]);
+    level.fft->transform_2d(real.data(), imag.data(), true);
+
+    // Cut the kernel at the radius with a cosine taper over its outer half, then restore the
+    // variance lost outside of it
+    double variance_before = 0.0, variance_after = 0.0;
+    float inv_area = 1.0f / static_cast<float>(size * size);
+    for (int64_t y = 0; y < n; ++y)
+    {
+        for (int64_t x = 0; x < n; ++x)
+        {
+            auto dx = static_cast<float>(x < n / 2 ? x : x - n);
+            auto dy = static_cast<float>(y < n / 2 ? y : y - n);
+            float r = std::sqrt(dx * dx + dy * dy) / static_cast<float>(level.radius);
+            float window = 0.0f;
+            if (r <= 0.5f)
+                window = 1.0f;
+            else if (r < 1.0f)
+                window = 0.5f + 0.5f * std::cos(static_cast<float>(M_PI) * (2.0f * r - 1.0f));
+            float value = real[y * n + x] * inv_area;
+            variance_before += value * value;
+            value *= window;
+            variance_after += value * value;
+            real[y * n + x] = value;
+        }
+    }
+    std::fill(imag.begin(), imag.end(), 0.0f);
+    auto restore = static_cast<float>(std::sqrt(variance_before / variance_after));
+
+    level.fft->transform_2d(real.data(), imag.data(), false);
+    level.filter.resize(size * size);
+    for (size_t k = 0; k < level.filter.size(); ++k)
+        level.filter[k] = real[k] * restore * inv_area;
+}
+
+auto SpectralSynthesis::synthesize_pair(const Level &level, int64_t pair_x, int64_t tile_y)
+    -> std::pair<Tile, Tile>
+{
+    auto size = level.fft->size();
+    int radius = level.radius, tile_size = level.tile_size;
+    int64_t left_x = 2 * pair_x * tile_size - radius;
+    int64_t right_x = left_x + tile_size;
+    int64_t top_y = tile_y * tile_size - radius;
+
+    const auto &table = kernels();
+    std::vector<float> real(size * size), imag(size * size);
+    for (size_t y = 0; y < size; ++y)
+    {
+        auto row_y = static_cast<int>(top_y + static_cast<int64_t>(y));
+        table.white_noise(level.seed, static_cast<int>(left_x), row_y, &real[y * size], size);
+        table.white_noise(level.seed, static_cast<int>(right_x), row_y, &imag[y * size], size);
+    }
+
+    // The kernel is real, so the real and the imaginary part are convolved independently
+    level.fft->transform_2d(real.data(), imag.data(), false);
+    for (size_t k = 0; k < real.size(); ++k)
+    {
+        real[k] *= level.filter[k];
+        imag[k] *= level.filter[k];
+    }
+    level.fft->transform_2d(real.data(), imag.data(), true);
+
+    // Only the center of the grid is not wrapped around by the circular convolution
+    auto left = std::make_shared<std::vector<float>>(static_cast<size_t>(tile_size) * tile_size);
+    auto right = std::make_shared<std::vector<float>>(left->size());
+    for (int y = 0; y < tile_size; ++y)
+    {
+        auto source = (y + radius) * size + radius;
+        std::copy(&real[source], &real[source] + tile_size, &(*left)[y * tile_size]);
+        std::copy(&imag[source], &imag[source] + tile_size, &(*right)[y * tile_size]);
+    }
+    return {left, right};
+}
+
+auto SpectralSynthesis::store(Level &level, int64_t tile_x, int64_t tile_y, Tile values) -> void
+{
+    auto key = tile_key(tile_x, tile_y);
+    auto found = level.tile_index.find(key);
+    if (found != level.tile_index.end())
+    {
+        level.tiles.erase(found->second);
+        level.tile_index.erase(found);
+    }
+    level.tiles.emplace_front(key, std::move(values));
+    level.tile_index[key] = level.tiles.begin();
+    while (level.tiles.size() > SPECTRAL_CACHED_TILES)
+    {
+        level.tile_index.erase(level.tiles.back().first);
+        level.tiles.pop_back();
+    }
+}
+
+auto SpectralSynthesis::tile(Level &level, int64_t tile_x, int64_t tile_y) -> Tile
+{
+    {
+        std::lock_guard<std::mutex> lock(level.mutex);
+        auto found = level.tile_index.find(tile_key(tile_x, tile_y));
+        if (found != level.tile_index.end())
+        {
+            level.tiles.splice(level.tiles.begin(), level.tiles, found->second);
+            return found->second->second;
+        }
+    }
+
+    // Two chunks may synthesize the same pair at once, both get the same values
+    int64_t pair_x = floor_div(tile_x, 2);
+    auto [left, right] = synthesize_pair(level, pair_x, tile_y);
+    std::lock_guard<std::mutex> lock(level.mutex);
+    store(level, 2 * pair_x, tile_y, left);
+    store(level, 2 * pair_x + 1, tile_y, right);
+    return tile_x == 2 * pair_x ? left : right;
+}
+
+// Indices i in [0, count) of the nodes origin + i * stride in [begin, end)
+static auto strided_range(int64_t origin, int stride, int count, int64_t begin, int64_t end)
+    -> std::pair<int, int>
+{
+    int64_t first = std::max<int64_t>(0, floor_div(begin - origin + stride - 1, stride));
+    int64_t last = std::min<int64_t>(count, floor_div(end - origin + stride - 1, stride));
+    return {static_cast<int>(first), static_cast<int>(std::max(first, last))};
+}
+
+auto SpectralSynthesis::levels(const std::vector<float> &frequencies) -> std::vector<int>
+{
+    std::vector<int> result;
+    for (const auto &grid : *levels_of(frequencies))
+        result.push_back(grid->level);
+    return result;
+}
+
+auto SpectralSynthesis::fill(const std::vector<float> &frequencies, int level, int64_t origin_x,
+                             int64_t origin_y, int width, int height, float *out, int stride)
+    -> void
+{
+    auto levels = levels_of(frequencies);
+    auto grid = std::find_if(levels->begin(), levels->end(),
+                             [level](const auto &candidate) { return candidate->level == level; });
+    if (grid == levels->end())
+    {
+        std::fill(out, out + static_cast<size_t>(width) * height, 0.0f);
+        return;
+    }
+
+    int64_t tile_size = (*grid)->tile_size;
+    int64_t first_x = floor_div(origin_x, tile_size);
+    int64_t last_x = floor_div(origin_x + static_cast<int64_t>(width - 1) * stride, tile_size);
+    int64_t first_y = floor_div(origin_y, tile_size);
+    int64_t last_y = floor_div(origin_y + static_cast<int64_t>(height - 1) * stride, tile_size);
+    for (int64_t tile_y = first_y; tile_y <= last_y; ++tile_y)
+    {
+        // Rows and columns of out that fall on the tile, a tile can fall between two of them when
+        // the stride is larger than the tile
+        auto [y0, y1] =
+            strided_range(origin_y, stride, height, tile_y * tile_size, (tile_y + 1) * tile_size);
+        if (y0 == y1)
+            continue;
+        for (int64_t tile_x = first_x; tile_x <= last_x; ++tile_x)
+        {
+            auto [x0, x1] = strided_range(origin_x, stride, width, tile_x * tile_size,
+                                          (tile_x + 1) * tile_size);
+            if (x0 == x1)
+                continue;
+            auto values = tile(**grid, tile_x, tile_y);
+            for (int y = y0; y < y1; ++y)
+            {
+                auto source = values->begin() +
+                              (origin_y + static_cast<int64_t>(y) * stride - tile_y * tile_size) *
+                                  tile_size +
+                              (origin_x - tile_x * tile_size);
+                float *row = out + static_cast<size_t>(y) * width;
+                for (int x = x0; x < x1; ++x)
+                    row[x] = source[static_cast<int64_t>(x) * stride];
+            }
+        }
+    }
+}
@@ -0,0 +1,139 @@
+#ifndef A_SPECTRAL_H
+#define A_SPECTRAL_H
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+// Radix 2 fast Fourier transform of square grids of a fixed power of two size. Complex values are
+// stored as separate real and imaginary grids, every butterfly is applied to two whole rows at once
+// with the fft_butterfly kernel
+class FourierTransform
+{
+    size_t n;
+    // Real and imaginary parts of exp(-2 pi i k / length) for k < length / 2, for every stage of
+    // the transform, starting at length / 2 - 1
+    std::vector<float> twiddle_real, twiddle_imag;
+    // Index of every row after the bit reversal permutation
+    std::vector<uint32_t> reversed;
+
+    // Transforms every column of the grid
+    auto transform_columns(float *real, float *imag, bool inverse) const -> void;
+
+  public:
+    explicit FourierTransform(size_t n);
+
+    auto size() const -> size_t;
+
+    // In place transform of an n x n row-major grid, the inverse transform is not divided by n^2.
+    // The columns are transformed, the grid is transposed and the columns are transformed again,
+    // so the result is transposed. Applying the inverse to a transposed spectrum gives back the
+    // original layout
+    auto transform_2d(float *real, float *imag, bool inverse) const -> void;
+};
+
+// Power spectrum of an octave of OpenSimplex2S, measured by FFT. Its power is concentrated in a
+// ring around SPECTRAL_PEAK_FREQUENCY cycles per noise unit (at a generator frequency of 1), which
+// is close to exp(-((f - peak) / (SPECTRAL_BANDWIDTH * peak))^2)
+#define SPECTRAL_PEAK_FREQUENCY 0.74f
+#define SPECTRAL_BANDWIDTH 0.57f
+
+// Standard deviation of an octave of OpenSimplex2S mapped to [0, 1], measured
+#define SPECTRAL_NOISE_DEVIATION 0.21f
+
+// Radius of the convolution kernel in grid nodes, times the width (SPECTRAL_BANDWIDTH * peak, in
+// cycles per node) of the lowest band on the grid. Keeps about 99.9% of the power of every band
+#define SPECTRAL_KERNEL_RADIUS 1.05f
+
+// A band is synthesized on the coarsest grid, with a node every power of two pixels, on which its
+// peak stays below this many cycles per node. The bands of a grid then span at most one octave,
+// which keeps the kernel radius small, and bicubic interpolation of the coarse grids keeps most
+// of the amplitude of their bands
+#define SPECTRAL_LEVEL_FREQUENCY 0.125f
+
+// Number of synthesized tiles kept for the next chunks, for every grid
+#define SPECTRAL_CACHED_TILES 256
+
+// Number of sets of band frequencies whose levels are kept
+#define SPECTRAL_CACHED_BAND_SETS 16
+
+// Fractal noise by spectral synthesis. White noise, a hash of the grid node, is convolved with a
+// kernel whose power spectrum has a band around the frequency of every octave, weighted by the
+// square of its amplitude. The convolution is computed with FFTs over tiles that overlap by the
+// kernel radius (overlap-save), so every node gets the same value whichever tile computes it and
+// chunk borders are seamless. Low frequency bands are synthesized on coarse grids (levels), a grid
+// at level L has a node every 2^L pixels. The cost per pixel grows with the number of levels, not
+// with the number of octaves. Thread safe, tiles are synthesized outside of any lock so chunks
+// created in parallel do not wait for each other
+class SpectralSynthesis
+{
+    using Tile = std::shared_ptr<const std::vector<float>>;
+
+    struct Level
+    {
+        int level;
+        int seed;
+        int radius, tile_size;
+        std::unique_ptr<FourierTransform> fft;
+        // Transposed spectrum of the kernel (see FourierTransform::transform_2d) divided by
+        // size^2, real because the kernel is symmetric
+        std::vector<float> filter;
+        // Guards the tiles, the rest of the level does not change once it is built
+        std::mutex mutex;
+        std::list<std::pair<uint64_t, Tile>> tiles;
+        std::unordered_map<uint64_t, std::list<std::pair<uint64_t, Tile>>::iterator> tile_index;
+    };
+
+    // Levels built for one set of band frequencies, in increasing order
+    using Levels = std::vector<std::unique_ptr<Level>>;
+
+    int seed;
+    std::vector<float> amplitudes;
+
+    std::mutex mutex;
+    // Levels of every set of band frequencies (the peak of every octave in cycles per pixel),
+    // the calls that still read a set keep it alive when it is dropped
+    std::map<std::vector<float>, std::shared_ptr<const Levels>> band_sets;
+
+    auto build(const std::vector<float> &frequencies) const -> std::shared_ptr<const Levels>;
+
+    // Levels of a set of band frequencies, built the first time it is used
+    auto levels_of(const std::vector<float> &frequencies) -> std::shared_ptr<const Levels>;
+
+    // Kernel of a level for the peak frequencies (in cycles per node) and the amplitudes of its
+    // bands
+    static auto build_filter(Level &level, const std::vector<float> &peaks,
+                             const std::vector<float> &band_amplitudes) -> void;
+
+    // Tile with tile_size^2 values starting at node (tile_x, tile_y) * tile_size
+    static auto tile(Level &level, int64_t tile_x, int64_t tile_y) -> Tile;
+
+    // Synthesizes tiles (2 * pair_x, tile_y) and (2 * pair_x + 1, tile_y) with a single complex
+    // FFT, one in the real part and the other in the imaginary part
+    static auto synthesize_pair(const Level &level, int64_t pair_x, int64_t tile_y)
+        -> std::pair<Tile, Tile>;
+
+    // Adds a tile to the cache of the level, its mutex must be held
+    static auto store(Level &level, int64_t tile_x, int64_t tile_y, Tile values) -> void;
+
+  public:
+    SpectralSynthesis(int seed, const std::vector<float> &amplitudes);
+
+    // Levels that hold at least one band, in increasing order. frequencies is the peak frequency
+    // of every octave in cycles per pixel, the levels of each set of frequencies are built once.
+    // Frequencies above 0.5 cannot be represented and are left out
+    auto levels(const std::vector<float> &frequencies) -> std::vector<int>;
+
+    // Values of the bands of one level at width x height nodes of its grid into out, row-major,
+    // starting at node (origin_x, origin_y) with stride nodes between two values. Node (x, y) is
+    // at pixel (x, y) * 2^level. The sum of all levels has a mean of 0 and a variance of the sum
+    // of the squared amplitudes
+    auto fill(const std::vector<float> &frequencies, int level, int64_t origin_x, int64_t origin_y,
+              int width, int height, float *out, int stride = 1) -> void;
+};
+
+#endif // A_SPECTRAL_H
@@ -0,0 +1,118 @@
+#include "task_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+// Tasks of one call to TaskPool::run()
+struct TaskBatch
+{
+    std::atomic<size_t> remaining;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable done;
+};
+
+TaskPool::TaskPool(size_t threads) : stopping(false)
+{
+    for (size_t i = 0; i < threads; ++i)
+        workers.emplace_back([this]() { work(); });
+}
+
+TaskPool::~TaskPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers)
+        worker.join();
+}
+
+auto TaskPool::execute(const QueuedTask &queued) -> void
+{
+    auto &batch = *queued.batch;
+    try
+    {
+        (*queued.task)();
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock(batch.mutex);
+        if (!batch.error)
+            batch.error = std::current_exception();
+    }
+    // The submitting thread may return as soon as remaining is 0, the batch must not be touched
+    // after that without holding its mutex
+    std::lock_guard<std::mutex> lock(batch.mutex);
+    if (--batch.remaining == 0)
+        batch.done.notify_all();
+}
+
+auto TaskPool::try_pop(QueuedTask &queued) -> bool
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (queue.empty())
+        return false;
+    queued = queue.front();
+    queue.pop_front();
+    return true;
+}
+
+auto TaskPool::work() -> void
+{
+    while (true)
+    {
+        QueuedTask queued;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return stopping || !queue.empty(); });
+            // The queue is drained before stopping
+            if (queue.empty())
+                return;
+            queued = queue.front();
+            queue.pop_front();
+        }
+        execute(queued);
+    }
+}
+
+auto TaskPool::run(const std::vector<std::function<void()>> &tasks) -> void
+{
+    if (tasks.empty())
+        return;
+    TaskBatch batch;
+    batch.remaining = tasks.size();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto &task : tasks)
+            queue.push_back({&task, &batch});
+    }
+    if (tasks.size() > 1)
+        wake.notify_all();
+    else
+        wake.notify_one();
+
+    // Helps with the queued tasks, which may belong to other batches, until the queue is empty
+    QueuedTask queued;
+    while (batch.remaining > 0 && try_pop(queued))
+        execute(queued);
+    {
+        std::unique_lock<std::mutex> lock(batch.mutex);
+        batch.done.wait(lock, [&batch]() { return batch.remaining == 0; });
+    }
+    if (batch.error)
+        std::rethrow_exception(batch.error);
+}
+
+auto TaskPool::size() const -> size_t
+{
+    return workers.size();
+}
+
+auto task_pool() -> TaskPool &
+{
+    // hardware_concurrency() is 0 when unknown
+    static TaskPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
@@ -0,0 +1,59 @@
+#ifndef A_TASK_POOL_H
+#define A_TASK_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stddef.h>
+#include <thread>
+#include <vector>
+
+struct TaskBatch;
+
+// Worker threads that run batches of tasks. The thread that submits a batch runs queued tasks too
+// until its batch is done, so a task may submit a batch of its own without blocking a worker, and
+// a pool without workers runs every task on the calling thread. Safe to use from several threads
+class TaskPool
+{
+    struct QueuedTask
+    {
+        const std::function<void()> *task;
+        TaskBatch *batch;
+    };
+
+    std::vector<std::thread> workers;
+    std::deque<QueuedTask> queue;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+
+    static auto execute(const QueuedTask &queued) -> void;
+
+    // Takes the oldest queued task, false if the queue is empty
+    auto try_pop(QueuedTask &queued) -> bool;
+
+    auto work() -> void;
+
+  public:
+    TaskPool(size_t threads);
+
+    TaskPool(const TaskPool &) = delete;
+
+    auto operator=(const TaskPool &) -> TaskPool & = delete;
+
+    // Waits for the queued tasks to finish
+    ~TaskPool();
+
+    // Runs every task, returns once all of them are done. Rethrows the first exception thrown by a
+    // task, after the other tasks are done
+    auto run(const std::vector<std::function<void()>> &tasks) -> void;
+
+    // Number of worker threads, not counting the threads that submit tasks
+    auto size() const -> size_t;
+};
+
+// The pool of the chunk pipeline, with one worker less than the hardware threads
+auto task_pool() -> TaskPool &;
+
+#endif // A_TASK_POOL_H